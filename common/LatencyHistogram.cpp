@@ -0,0 +1,66 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace energi
+{
+
+void LatencyHistogram::add(std::chrono::milliseconds latency)
+{
+    const uint64_t ms = uint64_t(std::max<int64_t>(latency.count(), 0));
+    size_t bucket = 0;
+    while (bucket + 1 < c_buckets && (uint64_t(1) << bucket) <= ms) {
+        ++bucket;
+    }
+    ++m_buckets[bucket];
+    ++m_count;
+    m_max = std::max(m_max, ms);
+}
+
+uint64_t LatencyHistogram::quantile(double q) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(uint64_t(q * m_count + 0.5), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < c_buckets; ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            return std::min(uint64_t(1) << i, m_max);
+        }
+    }
+    return m_max;
+}
+
+std::string LatencyHistogram::ToString() const
+{
+    std::stringstream ss;
+    ss << "p50 <" << quantile(0.5) << " ms, p90 <" << quantile(0.9) << " ms, p99 <"
+       << quantile(0.99) << " ms, max " << m_max << " ms";
+    return ss.str();
+}
+
+Json::Value LatencyHistogram::toJson() const
+{
+    Json::Value json(Json::objectValue);
+    json["count"] = Json::UInt64(m_count);
+    json["p50_ms"] = Json::UInt64(quantile(0.5));
+    json["p90_ms"] = Json::UInt64(quantile(0.9));
+    json["p99_ms"] = Json::UInt64(quantile(0.99));
+    json["max_ms"] = Json::UInt64(m_max);
+    json["buckets"] = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < c_buckets; ++i) {
+        if (m_buckets[i] == 0) {
+            continue;
+        }
+        Json::Value bucket(Json::objectValue);
+        bucket["lt_ms"] = Json::UInt64(uint64_t(1) << i);
+        bucket["count"] = Json::UInt64(m_buckets[i]);
+        json["buckets"].append(bucket);
+    }
+    return json;
+}
+
+} /* namespace energi */
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <json/json.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace energi
+{
+
+// Log2 buckets of milliseconds, bucket i holds [2^(i-1), 2^i)
+class LatencyHistogram
+{
+public:
+    static const size_t c_buckets = 24;
+
+    void add(std::chrono::milliseconds latency);
+    uint64_t count() const { return m_count; }
+    //! Upper bound of the bucket holding the given quantile, in ms
+    uint64_t quantile(double q) const;
+    uint64_t max() const { return m_max; }
+
+    std::string ToString() const;
+    Json::Value toJson() const;
+
+private:
+    uint64_t m_buckets[c_buckets] = {};
+    uint64_t m_count = 0;
+    uint64_t m_max = 0;
+};
+
+} /* namespace energi */
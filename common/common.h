@@ -10,6 +10,7 @@
 
 #include "Log.h"
 #include "portable_endian.h"
+#include "utilstrencodings.h"
 #include <cstdint>
 #include <cstring>
 #include <iomanip>
@@ -183,15 +184,9 @@ inline void setBuffer(const uint8_t* ptr, uint32_t value)
 
 inline std::string strToHex(const std::string& str)
 {
-    std::ostringstream result;
-    for (const auto& item : str) {
-        result << std::hex
-              << std::setfill('0')
-              << std::setw(2)
-              << std::nouppercase
-              << static_cast<unsigned int>(static_cast<unsigned char>(item));
-    }
-    return result.str();
+    std::string result(str.size() * 2, '\0');
+    EncodeHex(&result[0], reinterpret_cast<const unsigned char*>(str.data()), str.size());
+    return result;
 }
 
 inline bool setenv(const char name[], const char value[], bool over = false)
@@ -12,6 +12,12 @@
 #include <errno.h>
 #include <limits>
 
+// SSE2 is part of every x86-64 CPU, no runtime check needed
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_SSE2_HEX
+#endif
+
 using namespace std;
 
 static const string CHARS_ALPHA_NUM = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -68,21 +74,22 @@ bool IsHex(const string& str)
 
 vector<unsigned char> ParseHex(const char* psz)
 {
-    // convert hex dump to vector
+    // convert hex dump to vector, runs of hex digits between spaces at once
     vector<unsigned char> vch;
     while (true)
     {
         while (isspace(*psz))
             psz++;
-        signed char c = HexDigit(*psz++);
-        if (c == (signed char)-1)
-            break;
-        unsigned char n = (c << 4);
-        c = HexDigit(*psz++);
-        if (c == (signed char)-1)
+        const char* run = psz;
+        while (HexDigit(*psz) >= 0)
+            psz++;
+        const size_t digits = psz - run;
+        const size_t start = vch.size();
+        vch.resize(start + digits / 2);
+        DecodeHex(vch.data() + start, run, digits - digits % 2);
+        // an odd digit, or no digit at all, ends the dump
+        if (digits % 2 != 0 || digits == 0)
             break;
-        n |= c;
-        vch.push_back(n);
     }
     return vch;
 }
@@ -92,6 +99,139 @@ vector<unsigned char> ParseHex(const string& str)
     return ParseHex(str.c_str());
 }
 
+bool AppendHex(vector<unsigned char>& out, const char* hex, size_t size)
+{
+    if (size % 2 != 0)
+        return false;
+    const size_t start = out.size();
+    out.resize(start + size / 2);
+    if (!DecodeHex(out.data() + start, hex, size))
+    {
+        out.resize(start);
+        return false;
+    }
+    return true;
+}
+
+namespace
+{
+
+const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                          '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+
+#if defined(HAVE_SSE2_HEX)
+/** Nibbles 0..15, one per byte, to their lowercase hex characters */
+inline __m128i NibblesToHex(__m128i n)
+{
+    const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), letters);
+}
+
+/** 16 bytes to their 32 hex characters */
+inline void EncodeHex16(char* out, __m128i bytes)
+{
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    const __m128i lo = _mm_and_si128(bytes, mask);
+    _mm_storeu_si128((__m128i*)out, NibblesToHex(_mm_unpacklo_epi8(hi, lo)));
+    _mm_storeu_si128((__m128i*)(out + 16), NibblesToHex(_mm_unpackhi_epi8(hi, lo)));
+}
+
+/** Byte 15 first, SSE2 has no byte shuffle */
+inline __m128i ReverseBytes(__m128i v)
+{
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+/** 16 hex characters to their nibbles, false if one of them is not a hex character */
+inline bool HexToNibbles(__m128i c, __m128i& n)
+{
+    const __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                          _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    // Upper case letters to lower case, nothing else lands on a..f
+    const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    const __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                           _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    n = _mm_or_si128(_mm_and_si128(isDigit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                     _mm_and_si128(isLetter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    return _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) == 0xffff;
+}
+
+/** 32 hex characters to their 16 bytes */
+inline bool DecodeHex32(unsigned char* out, const char* hex)
+{
+    __m128i n0, n1;
+    const bool ok0 = HexToNibbles(_mm_loadu_si128((const __m128i*)hex), n0);
+    const bool ok1 = HexToNibbles(_mm_loadu_si128((const __m128i*)(hex + 16)), n1);
+    // Each 16-bit lane holds the high nibble in its low byte and the low nibble above it
+    const __m128i mask = _mm_set1_epi16(0xff);
+    const __m128i b0 = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(n0, 4), _mm_srli_epi16(n0, 8)), mask);
+    const __m128i b1 = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(n1, 4), _mm_srli_epi16(n1, 8)), mask);
+    _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(b0, b1));
+    return ok0 && ok1;
+}
+#endif
+
+} // namespace
+
+void EncodeHex(char* out, const unsigned char* data, size_t size)
+{
+    const unsigned char* end = data + size;
+#if defined(HAVE_SSE2_HEX)
+    for (; end - data >= 16; data += 16, out += 32)
+        EncodeHex16(out, _mm_loadu_si128((const __m128i*)data));
+#endif
+    for (; data != end; ++data)
+    {
+        *out++ = hexmap[*data >> 4];
+        *out++ = hexmap[*data & 15];
+    }
+}
+
+void EncodeHexReversed(char* out, const unsigned char* data, size_t size)
+{
+    const unsigned char* end = data + size;
+#if defined(HAVE_SSE2_HEX)
+    for (; end - data >= 16; out += 32)
+    {
+        end -= 16;
+        EncodeHex16(out, ReverseBytes(_mm_loadu_si128((const __m128i*)end)));
+    }
+#endif
+    while (end != data)
+    {
+        --end;
+        *out++ = hexmap[*end >> 4];
+        *out++ = hexmap[*end & 15];
+    }
+}
+
+bool DecodeHex(unsigned char* out, const char* hex, size_t size)
+{
+    if (size % 2 != 0)
+        return false;
+    const char* end = hex + size;
+#if defined(HAVE_SSE2_HEX)
+    for (; end - hex >= 32; hex += 32, out += 16)
+    {
+        if (!DecodeHex32(out, hex))
+            return false;
+    }
+#endif
+    for (; hex != end; hex += 2)
+    {
+        signed char hi = HexDigit(hex[0]);
+        signed char lo = HexDigit(hex[1]);
+        if ((hi | lo) < 0)
+            return false;
+        *out++ = (unsigned char)((hi << 4) | lo);
+    }
+    return true;
+}
+
 string EncodeBase64(const unsigned char* pch, size_t len)
 {
     static const char *pbase64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
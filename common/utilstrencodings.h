@@ -39,6 +39,17 @@ enum SafeChars
 std::string SanitizeString(const std::string& str, int rule = SAFE_CHARS_DEFAULT);
 std::vector<unsigned char> ParseHex(const char* psz);
 std::vector<unsigned char> ParseHex(const std::string& str);
+/** Decodes exactly size hex characters onto out, false on odd size or a non hex character */
+bool AppendHex(std::vector<unsigned char>& out, const char* hex, size_t size);
+/** Writes the 2 * size lowercase hex characters of data to out, without a terminator */
+void EncodeHex(char* out, const unsigned char* data, size_t size);
+/** Same as EncodeHex with the bytes taken last to first, the order uint256::GetHex prints */
+void EncodeHexReversed(char* out, const unsigned char* data, size_t size);
+/**
+ * Decodes exactly size hex characters to the size / 2 bytes at out. False on
+ * odd size or a non hex character, out may then be partly written.
+ */
+bool DecodeHex(unsigned char* out, const char* hex, size_t size);
 signed char HexDigit(char c);
 bool IsHex(const std::string& str);
 std::vector<unsigned char> DecodeBase64(const char* p, bool* pfInvalid = NULL);
@@ -81,6 +92,24 @@ template<typename T>
 std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
 {
     std::string rv;
+    if (!fSpaces)
+    {
+        // Through a small buffer, so that any byte iterator gets EncodeHex
+        rv.resize((itend-itbegin)*2);
+        unsigned char buf[256];
+        size_t pos = 0;
+        T it = itbegin;
+        while (it < itend)
+        {
+            size_t n = 0;
+            for (; n < sizeof(buf) && it < itend; ++n, ++it)
+                buf[n] = (unsigned char)(*it);
+            EncodeHex(&rv[pos], buf, n);
+            pos += n*2;
+        }
+        return rv;
+    }
+
     static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
     rv.reserve((itend-itbegin)*3);
@@ -0,0 +1,228 @@
+#include "Benchmark.h"
+
+#include "common/Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <thread>
+
+namespace energi
+{
+
+namespace
+{
+
+// Time allowed for the DAG to be built or loaded before a device counts as failed
+const std::chrono::minutes c_dagTimeout(10);
+// Time allowed for every miner to pick up a new job
+const std::chrono::seconds c_switchTimeout(10);
+
+Json::Value summarize(const std::vector<double>& samples)
+{
+    Json::Value json(Json::objectValue);
+    json["samples"] = Json::Value(Json::arrayValue);
+    for (auto sample : samples) {
+        json["samples"].append(sample);
+    }
+    if (samples.empty()) {
+        return json;
+    }
+    const double n = double(samples.size());
+    const double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / n;
+    double variance = 0.0;
+    for (auto sample : samples) {
+        variance += (sample - mean) * (sample - mean);
+    }
+    json["mean"] = mean;
+    json["stddev"] = samples.size() > 1 ? std::sqrt(variance / (n - 1)) : 0.0;
+    json["min"] = *std::min_element(samples.begin(), samples.end());
+    json["max"] = *std::max_element(samples.begin(), samples.end());
+    return json;
+}
+
+} // namespace
+
+Benchmark::Benchmark(MinePlant& plant,
+                     const std::vector<EnumMinerEngine>& engines,
+                     unsigned block,
+                     unsigned warmup,
+                     unsigned trialSeconds,
+                     unsigned trials)
+    : m_plant(plant)
+    , m_engines(engines)
+    , m_height(std::max(block, 1u)) // height 0 is treated as no work
+    , m_warmup(warmup)
+    , m_trialSeconds(std::max(trialSeconds, 1u))
+    , m_trials(std::max(trials, 1u))
+{
+}
+
+Work Benchmark::makeWork(unsigned height, unsigned sequence)
+{
+    // Kernels need a nonzero boundary, one in its lowest bit is never met in
+    // practice so nothing gets submitted
+    return Work::synthetic(height, ArithToUint256(arith_uint256(sequence + 1)), arith_uint256(1) << 192,
+            "benchmark" + std::to_string(sequence));
+}
+
+bool Benchmark::sleepFor(std::chrono::milliseconds duration, const KeepRunning& keepRunning) const
+{
+    using namespace std::chrono;
+    const auto deadline = steady_clock::now() + duration;
+    while (steady_clock::now() < deadline) {
+        if (!keepRunning()) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::min(milliseconds(100),
+                    duration_cast<milliseconds>(deadline - steady_clock::now())));
+    }
+    return keepRunning();
+}
+
+bool Benchmark::waitFirstHashes(const KeepRunning& keepRunning)
+{
+    using namespace std::chrono;
+    const auto launched = steady_clock::now();
+    size_t pending = m_miners.size();
+    while (pending > 0) {
+        if (!keepRunning()) {
+            return false;
+        }
+        auto elapsed = steady_clock::now() - launched;
+        if (elapsed > c_dagTimeout) {
+            cwarn << "Benchmark: " << pending << " device(s) did not start hashing";
+            return false;
+        }
+        for (size_t i = 0; i < m_miners.size(); ++i) {
+            auto& result = m_results[i];
+            if (result.firstHashMs == 0 && m_miners[i]->hashCount() > 0) {
+                result.firstHashMs = std::max<int64_t>(duration_cast<milliseconds>(elapsed).count(), 1);
+                result.dagLoadMs = m_miners[i]->dagLoadTime().count();
+                --pending;
+            }
+        }
+        std::this_thread::sleep_for(milliseconds(100));
+    }
+    return true;
+}
+
+bool Benchmark::switchJob(const KeepRunning& keepRunning)
+{
+    using namespace std::chrono;
+    std::vector<unsigned> before;
+    for (const auto& miner : m_miners) {
+        before.push_back(miner->switchCount());
+    }
+    m_plant.setWork(makeWork(m_height, m_sequence++));
+
+    const auto deadline = steady_clock::now() + c_switchTimeout;
+    std::vector<bool> done(m_miners.size(), false);
+    size_t pending = m_miners.size();
+    while (pending > 0 && steady_clock::now() < deadline) {
+        if (!keepRunning()) {
+            return false;
+        }
+        for (size_t i = 0; i < m_miners.size(); ++i) {
+            if (!done[i] && m_miners[i]->switchCount() != before[i]) {
+                done[i] = true;
+                m_results[i].switchLatencies.push_back(double(m_miners[i]->lastSwitchLatency().count()));
+                --pending;
+            }
+        }
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    if (pending > 0) {
+        cwarn << "Benchmark: " << pending << " device(s) did not switch job within "
+              << c_switchTimeout.count() << " s";
+    }
+    return true;
+}
+
+bool Benchmark::run(const KeepRunning& keepRunning)
+{
+    using namespace std::chrono;
+
+    m_plant.setWork(makeWork(m_height, m_sequence++));
+    if (!m_plant.start(m_engines)) {
+        return false;
+    }
+    m_miners = m_plant.getMiners();
+    if (m_miners.empty()) {
+        cwarn << "Benchmark: no device to benchmark";
+        return false;
+    }
+    m_results.clear();
+    m_results.resize(m_miners.size());
+    for (size_t i = 0; i < m_miners.size(); ++i) {
+        m_results[i].name = m_miners[i]->name();
+    }
+
+    cnote << "Benchmarking block " << m_height << " (epoch "
+          << m_height / nrghash::constants::EPOCH_LENGTH << ") on " << m_miners.size() << " device(s)";
+    if (!waitFirstHashes(keepRunning)) {
+        return false;
+    }
+    for (const auto& result : m_results) {
+        cnote << result.name << " DAG ready in " << result.dagLoadMs << " ms, first hashes after "
+              << result.firstHashMs << " ms";
+    }
+
+    cnote << "Warming up for " << m_warmup << " s";
+    if (!sleepFor(seconds(m_warmup), keepRunning)) {
+        return false;
+    }
+
+    m_totalHashRates.clear();
+    for (unsigned trial = 1; trial <= m_trials; ++trial) {
+        if (!switchJob(keepRunning)) {
+            return false;
+        }
+        std::vector<uint64_t> start;
+        for (const auto& miner : m_miners) {
+            start.push_back(miner->hashCount());
+        }
+        const auto begin = steady_clock::now();
+        if (!sleepFor(seconds(m_trialSeconds), keepRunning)) {
+            return false;
+        }
+        const double elapsed = duration_cast<duration<double>>(steady_clock::now() - begin).count();
+
+        double total = 0.0;
+        for (size_t i = 0; i < m_miners.size(); ++i) {
+            double rate = double(m_miners[i]->hashCount() - start[i]) / elapsed;
+            m_results[i].hashRates.push_back(rate);
+            total += rate;
+        }
+        m_totalHashRates.push_back(total);
+        cnote << "Trial " << trial << "/" << m_trials << ": "
+              << std::fixed << std::setprecision(2) << total / 1000000.0 << " Mh/s";
+    }
+    return true;
+}
+
+Json::Value Benchmark::report() const
+{
+    Json::Value json(Json::objectValue);
+    json["block"] = m_height;
+    json["epoch"] = unsigned(m_height / nrghash::constants::EPOCH_LENGTH);
+    json["warmup_s"] = m_warmup;
+    json["trial_s"] = m_trialSeconds;
+    json["trials"] = m_trials;
+
+    json["devices"] = Json::Value(Json::arrayValue);
+    for (const auto& result : m_results) {
+        Json::Value device(Json::objectValue);
+        device["name"] = result.name;
+        device["dag_load_ms"] = Json::Int64(result.dagLoadMs);
+        device["first_hash_ms"] = Json::Int64(result.firstHashMs);
+        device["hashrate"] = summarize(result.hashRates);
+        device["job_switch_us"] = summarize(result.switchLatencies);
+        json["devices"].append(device);
+    }
+    json["hashrate"] = summarize(m_totalHashRates);
+    return json;
+}
+
+} /* namespace energi */
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "nrgcore/mineplant.h"
+
+#include <json/json.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace energi
+{
+
+/**
+ * @brief Offline benchmark of the configured engines.
+ *
+ * Feeds synthetic jobs for a fixed block height through the MinePlant, so the
+ * DAG for that epoch is built or loaded exactly as when mining. After a warmup
+ * every device is measured over a number of fixed length trials. A new job is
+ * pushed at the start of each trial to measure how long miners take to switch.
+ */
+class Benchmark
+{
+public:
+    using KeepRunning = std::function<bool()>;
+
+    Benchmark(MinePlant& plant,
+              const std::vector<EnumMinerEngine>& engines,
+              unsigned block,
+              unsigned warmup,
+              unsigned trialSeconds,
+              unsigned trials);
+
+    //! Returns false when interrupted or when no device could be started
+    bool run(const KeepRunning& keepRunning);
+
+    //! Per device and whole rig results, meant to be written as JSON
+    Json::Value report() const;
+
+    //! Unsolvable work for the given height, sequence selects the previous block hash
+    static Work makeWork(unsigned height, unsigned sequence);
+
+private:
+    struct DeviceResult
+    {
+        std::string         name;
+        int64_t             dagLoadMs = 0;
+        int64_t             firstHashMs = 0;
+        std::vector<double> hashRates;      // H/s, one per trial
+        std::vector<double> switchLatencies; // us, one per job switch
+    };
+
+    bool sleepFor(std::chrono::milliseconds duration, const KeepRunning& keepRunning) const;
+    bool waitFirstHashes(const KeepRunning& keepRunning);
+    bool switchJob(const KeepRunning& keepRunning);
+
+    MinePlant&                   m_plant;
+    std::vector<EnumMinerEngine> m_engines;
+    unsigned                     m_height;
+    unsigned                     m_warmup;
+    unsigned                     m_trialSeconds;
+    unsigned                     m_trials;
+    unsigned                     m_sequence = 0;
+
+    Miners                       m_miners;
+    std::vector<DeviceResult>    m_results;
+    std::vector<double>          m_totalHashRates;
+};
+
+} /* namespace energi */
@@ -21,10 +21,9 @@ void CpuMiner::trun()
     uint64_t startNonce = 0;
     try {
         while (true) {
-            Work work = this->getWork(); // This work is a copy of last assigned work the worker was provided by plant
-            if ( !work.isValid() ) {
-                cnote << "No work received. Pause for 1 s.";
-                std::this_thread::sleep_for(std::chrono::seconds(1));
+            Job job = this->getWork(); // Miner local job built over the work snapshot shared by the plant
+            if ( !job.isValid() ) {
+                waitMoreWork();
                 if ( this->shouldStop() ) {
                     break;
                 }
@@ -33,40 +32,42 @@ void CpuMiner::trun()
                 //cnote << "Valid work.";
             }
 
-            if (!m_dagLoaded || ((work.nHeight / nrghash::constants::EPOCH_LENGTH) != (m_lastHeight / nrghash::constants::EPOCH_LENGTH))) {
+            if (!m_dagLoaded || (job.getEpoch() != (m_lastHeight / nrghash::constants::EPOCH_LENGTH))) {
                 static std::mutex mtx;
                 std::lock_guard<std::mutex> lock(mtx);
-                LoadNrgHashDAG(work.nHeight);
+                auto dagStart = std::chrono::steady_clock::now();
+                LoadNrgHashDAG(job.nHeight);
+                setDagLoadTime(std::chrono::steady_clock::now() - dagStart);
                 cnote << "End initialising";
                 m_dagLoaded = true;
             }
-            m_lastHeight = work.nHeight;
+            m_lastHeight = job.nHeight;
 
-            startNonce = m_plant.getStartNonce(work, m_index);
+            startNonce = m_plant.getStartNonce(job.getWork(), m_index);
 
-            work.nNonce = startNonce;
+            job.nNonce = startNonce;
             uint64_t lastNonce = startNonce;
 
             // we dont use mixHash part to calculate hash but fill it later (below)
             do {
-                auto hash = GetPOWHash(work);
-                if (UintToArith256(hash) < work.hashTarget) {
-                    updateHashRate(work.nNonce + 1 - lastNonce);
-                    Solution sol = Solution(work);
-                    cnote << name() << "Submitting block blockhash: " << work.GetHash().ToString() << " height: " << work.nHeight << "nonce: " << work.nNonce;
+                auto hash = GetPOWHash(job);
+                if (UintToArith256(hash) < job.getTarget()) {
+                    updateHashRate(job.nNonce + 1 - lastNonce);
+                    Solution sol = Solution(job);
+                    cnote << name() << "Submitting block blockhash: " << job.GetHash().ToString() << " height: " << job.nHeight << "nonce: " << job.nNonce;
                     m_plant.submitProof(sol);
-                    ++work.nNonce;
+                    ++job.nNonce;
                     break;
                 } else {
-                    ++work.nNonce;
+                    ++job.nNonce;
                 }
                 // rough guess
-                if ( work.nNonce % 10000 == 0 ) {
-                    updateHashRate(work.nNonce - lastNonce);
-                    lastNonce = work.nNonce;
+                if ( job.nNonce % 10000 == 0 ) {
+                    updateHashRate(job.nNonce - lastNonce);
+                    lastNonce = job.nNonce;
                 }
             } while (!haveNewWork() && !this->shouldStop());
-            updateHashRate(work.nNonce - lastNonce);
+            updateHashRate(job.nNonce - lastNonce);
         }
     } catch(WorkException &ex) {
         cnote << ex.what();
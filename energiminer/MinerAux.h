@@ -82,7 +82,9 @@ public:
 		Benchmark,
 		Simulation,
 		GBT,
-		Stratum
+		Stratum,
+		Replay,
+		TemplateBenchmark
 	};
 
 	static void signalHandler(int sig)
@@ -144,9 +146,30 @@ private:
     */
     void doMiner();
 
+    /*
+       doBenchmark starts the Plant offline with synthetic work for m_benchmarkBlock,
+       runs the warmup and trials and writes the JSON report to m_benchmarkReport.
+    */
+    void doBenchmark();
+
+    /*
+       doReplay plays the capture in m_replayCapture back through a local server to the
+       regular pool client and writes job switch and submit latencies to m_replayReport.
+    */
+    void doReplay();
+
+    /*
+       doTemplateBenchmark reads the block templates recorded in m_templateCapture parsed
+       whole and streamed, and writes how long each took to m_benchmarkReport.
+    */
+    void doTemplateBenchmark();
+
 private:
+    /// Stamps report with this build and host and writes it to path, false when that failed
+    bool writeReport(Json::Value& report, const std::string& path, const std::string& what, bool completed);
+
     /// Operating mode.
-    OperationMode m_mode;
+    OperationMode m_mode = OperationMode::None;
 
     /// Global boost's io_service
     std::thread m_io_thread;									// The IO service thread
@@ -189,17 +212,31 @@ private:
 
     /// Benchmarking params
     unsigned m_benchmarkWarmup = 15;
-    unsigned m_benchmarkTrial = 3;
+    unsigned m_benchmarkDuration = 3;
     unsigned m_benchmarkTrials = 5;
     unsigned m_benchmarkBlock = 0;
+    std::string m_benchmarkReport = "benchmark.json";
+
+    /// Simulation params
+    unsigned m_simulationBlockTime = 60;
+    unsigned m_simulationShareTime = 5;
     std::vector<URI> m_endpoints;
 
+    /// Session capture and replay params
+    std::string m_captureFile;
+    std::string m_replayCapture;
+    double m_replaySpeed = 1.0;
+    std::string m_replayReport = "replay.json";
+    std::string m_templateCapture;
+
     /// Farm params
     int m_worktimeout = 240;
     // Number of seconds to wait before triggering a response timeout from pool
     int m_responsetimeout = 4;
     // Number of minutes to wait on a failover pool before trying to go back to primary. In minutes !!
     unsigned m_failovertimeout = 0;
+    // Keep the next failover pool logged in to switch without a reconnect
+    bool m_failoverStandby = false;
 
     bool m_show_hwmonitors = false;
     bool m_show_power = false;
@@ -209,6 +246,10 @@ private:
 
     unsigned m_maxFarmRetries = 3;
     unsigned m_farmRecheckPeriod = 500;
+    // UDP port on 127.0.0.1 the node announces new blocks to in getwork mode, 0 none
+    unsigned short m_blockNotifyPort = 0;
+    // More nodes found blocks are submitted to in getwork mode
+    std::vector<URI> m_submitNodes;
     unsigned m_displayInterval = 5;
     bool m_farmRecheckSet = false;
 
@@ -0,0 +1,740 @@
+#include "Replay.h"
+
+#include "common/Log.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+using boost::asio::ip::tcp;
+
+namespace energi
+{
+
+namespace
+{
+
+// Time allowed for the DAG to be built or loaded before replay starts anyway
+const std::chrono::minutes c_dagTimeout(10);
+// A job the miners did not pick up within this time did not change their work
+const std::chrono::seconds c_switchTimeout(5);
+// Solutions waiting for their submit to show up on the server
+const size_t c_maxHanded = 1024;
+
+// Stratum ids are numbers or strings depending on the pool
+std::string idKey(const Json::Value& id)
+{
+    if (id.isString()) {
+        return id.asString();
+    }
+    if (id.isIntegral()) {
+        return std::to_string(id.asLargestInt());
+    }
+    return std::string();
+}
+
+// Job a pool message announces, empty when it does not carry one
+std::string announcedJob(const Json::Value& msg)
+{
+    if (msg.get("method", "").asString() == "mining.notify" && msg["params"].isArray()) {
+        return msg["params"].get(Json::Value::ArrayIndex(0), "").asString();
+    }
+    // nrg-proxy pushes jobs as results without a method
+    if (!msg.isMember("method") && msg["result"].isArray() && msg["result"].size() > 8) {
+        return msg["result"].get(Json::Value::ArrayIndex(0), "").asString();
+    }
+    return std::string();
+}
+
+Json::Value summarize(std::vector<double> samples)
+{
+    Json::Value json(Json::objectValue);
+    json["count"] = Json::UInt64(samples.size());
+    if (samples.empty()) {
+        return json;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        return samples[std::min(samples.size() - 1, size_t(p * samples.size()))];
+    };
+    json["mean"] = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    json["p50"] = percentile(0.5);
+    json["p90"] = percentile(0.9);
+    json["p99"] = percentile(0.99);
+    json["max"] = samples.back();
+    return json;
+}
+
+} // namespace
+
+// One client connection to the replay server, speaks line based stratum or
+// HTTP JSON-RPC for getwork. Lives on the io_service thread only.
+class Replay::Connection : public std::enable_shared_from_this<Replay::Connection>
+{
+public:
+    explicit Connection(Replay& replay)
+        : m_replay(replay)
+        , m_socket(replay.m_io)
+        , m_pushTimer(replay.m_io)
+        , m_sendTimer(replay.m_io)
+    {}
+
+    tcp::socket& socket()
+    {
+        return m_socket;
+    }
+
+    void start()
+    {
+        m_start = std::chrono::steady_clock::now();
+        if (m_replay.m_getwork) {
+            readRequest();
+            return;
+        }
+        m_script = m_replay.nextScript();
+        if (m_script) {
+            cnote << "Replaying recorded connection, " << m_script->pushes.size() << " pool messages";
+        }
+        schedulePush();
+        readLine();
+    }
+
+private:
+    struct Outgoing
+    {
+        std::chrono::steady_clock::time_point due;
+        std::string payload;
+        std::string job; // announced to the miners once written
+        int64_t     us = 0;
+    };
+
+    void close()
+    {
+        if (m_closed) {
+            return;
+        }
+        m_closed = true;
+        boost::system::error_code ec;
+        m_pushTimer.cancel(ec);
+        m_sendTimer.cancel(ec);
+        m_socket.shutdown(tcp::socket::shutdown_both, ec);
+        m_socket.close(ec);
+        endScript();
+    }
+
+    void endScript()
+    {
+        if (m_script && !m_scriptDone) {
+            m_scriptDone = true;
+            if (m_replay.m_scripts.empty()) {
+                m_replay.finished();
+            }
+        }
+    }
+
+    void schedulePush()
+    {
+        if (!m_script || m_next >= m_script->pushes.size()) {
+            endScript();
+            return;
+        }
+        const Push& push = m_script->pushes[m_next];
+        auto self = shared_from_this();
+        m_pushTimer.expires_at(m_start + m_replay.scaled(push.us - m_script->startUs));
+        m_pushTimer.async_wait([self](const boost::system::error_code& ec) {
+            if (ec || self->m_closed) {
+                return;
+            }
+            const Push& push = self->m_script->pushes[self->m_next++];
+            if (push.payload.empty()) {
+                // The recorded connection was dropped here
+                self->close();
+                return;
+            }
+            self->send(push.payload, std::chrono::steady_clock::now(), push.job, push.us);
+            self->schedulePush();
+        });
+    }
+
+    void readLine()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(m_socket, m_recvBuffer, "\n",
+                [self](const boost::system::error_code& ec, std::size_t) {
+            if (ec) {
+                self->close();
+                return;
+            }
+            std::istream is(&self->m_recvBuffer);
+            std::string line;
+            std::getline(is, line);
+            Json::Value request;
+            if (!line.empty() && Json::Reader().parse(line, request)) {
+                self->handleStratum(request);
+            }
+            if (!self->m_closed) {
+                self->readLine();
+            }
+        });
+    }
+
+    void handleStratum(const Json::Value& request)
+    {
+        const std::string method = request.get("method", "").asString();
+        if (method == "mining.submit" && request["params"].isArray()) {
+            m_replay.submitted(request["params"].get(Json::Value::ArrayIndex(1), "").asString(),
+                               request["params"].get(Json::Value::ArrayIndex(4), "").asString());
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (m_script) {
+            auto& queue = m_script->responses[method];
+            if (!queue.empty()) {
+                // Recorded answer with the recorded delay, the verdict of the pool included.
+                // Submit ids depend on the order shares are found, answer with the one asked.
+                Response response = queue.front();
+                queue.pop_front();
+                Json::Value reply;
+                if (Json::Reader().parse(response.payload, reply) && reply.isObject()) {
+                    reply["id"] = request.get("id", Json::Value::null);
+                    response.payload = Json::FastWriter().write(reply);
+                }
+                send(response.payload, now + m_replay.scaled(response.delayUs));
+                return;
+            }
+        }
+        // Nothing recorded, e.g. a share the original session never found
+        Json::Value reply;
+        reply["id"] = request.get("id", Json::Value::null);
+        if (request.isMember("jsonrpc")) {
+            reply["jsonrpc"] = "2.0";
+        } else {
+            reply["error"] = Json::Value::null;
+        }
+        reply["result"] = true;
+        send(Json::FastWriter().write(reply), now);
+    }
+
+    void readRequest()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(m_socket, m_recvBuffer, "\r\n\r\n",
+                [self](const boost::system::error_code& ec, std::size_t headerSize) {
+            if (ec) {
+                self->close();
+                return;
+            }
+            std::string headers(boost::asio::buffers_begin(self->m_recvBuffer.data()),
+                                boost::asio::buffers_begin(self->m_recvBuffer.data()) + headerSize);
+            self->m_recvBuffer.consume(headerSize);
+            std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+            size_t length = 0;
+            auto pos = headers.find("content-length:");
+            if (pos != std::string::npos) {
+                length = std::strtoul(headers.c_str() + pos + 15, nullptr, 10);
+            }
+            const size_t buffered = self->m_recvBuffer.size();
+            boost::asio::async_read(self->m_socket, self->m_recvBuffer,
+                    boost::asio::transfer_exactly(length > buffered ? length - buffered : 0),
+                    [self, length](const boost::system::error_code& ec, std::size_t) {
+                if (ec) {
+                    self->close();
+                    return;
+                }
+                std::string body(boost::asio::buffers_begin(self->m_recvBuffer.data()),
+                                 boost::asio::buffers_begin(self->m_recvBuffer.data()) + length);
+                self->m_recvBuffer.consume(length);
+                self->handleHttp(body);
+                if (!self->m_closed) {
+                    self->readRequest();
+                }
+            });
+        });
+    }
+
+    void handleHttp(const std::string& body)
+    {
+        Json::Value request;
+        Json::Value reply;
+        Json::Reader().parse(body, request);
+        reply["id"] = request.get("id", Json::Value::null);
+        reply["error"] = Json::Value::null;
+
+        const std::string method = request.get("method", "").asString();
+        auto due = std::chrono::steady_clock::now();
+        std::string job;
+        int64_t us = 0;
+        if (method == "getblocktemplate") {
+            const Template* tpl = m_replay.currentTemplate();
+            reply["result"] = tpl->result;
+            due += m_replay.scaled(tpl->delayUs);
+            const std::string prevHash = uint256S(tpl->result["previousblockhash"].asString()).GetHex();
+            if (prevHash != m_replay.m_lastPrevHash) {
+                m_replay.m_lastPrevHash = prevHash;
+                job = prevHash;
+                us = tpl->us;
+            }
+        } else if (method == "submitblock") {
+            m_replay.submitted(std::string(), std::string());
+            reply["result"] = Json::Value::null;
+        } else {
+            reply["result"] = Json::Value::null;
+            reply["error"]["code"] = -32601;
+            reply["error"]["message"] = "Method not found";
+        }
+
+        const std::string content = Json::FastWriter().write(reply);
+        std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+            std::to_string(content.size()) + "\r\n\r\n" + content;
+        send(response, due, job, us);
+    }
+
+    void send(const std::string& payload, std::chrono::steady_clock::time_point due,
+              const std::string& job = std::string(), int64_t us = 0)
+    {
+        if (m_closed) {
+            return;
+        }
+        // Never reorder, a late response holds back what follows it like on a real socket
+        Outgoing out;
+        out.due = std::max(due, m_outbox.empty() ? due : m_outbox.back().due);
+        out.payload = payload;
+        out.job = job;
+        out.us = us;
+        m_outbox.push_back(std::move(out));
+        if (!m_writing) {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        if (m_closed || m_outbox.empty()) {
+            m_writing = false;
+            return;
+        }
+        m_writing = true;
+        auto self = shared_from_this();
+        if (m_outbox.front().due > std::chrono::steady_clock::now()) {
+            m_sendTimer.expires_at(m_outbox.front().due);
+            m_sendTimer.async_wait([self](const boost::system::error_code& ec) {
+                if (!ec) {
+                    self->flush();
+                }
+            });
+            return;
+        }
+        if (!m_outbox.front().job.empty()) {
+            m_replay.announced(m_outbox.front().job, m_outbox.front().us);
+        }
+        boost::asio::async_write(m_socket, boost::asio::buffer(m_outbox.front().payload),
+                [self](const boost::system::error_code& ec, std::size_t) {
+            if (ec) {
+                self->close();
+                return;
+            }
+            self->m_outbox.pop_front();
+            self->flush();
+        });
+    }
+
+    Replay& m_replay;
+    tcp::socket m_socket;
+    boost::asio::steady_timer m_pushTimer;
+    boost::asio::steady_timer m_sendTimer;
+    boost::asio::streambuf m_recvBuffer;
+    std::chrono::steady_clock::time_point m_start;
+
+    std::unique_ptr<Script> m_script;
+    size_t m_next = 0;
+    bool m_scriptDone = false;
+
+    std::deque<Outgoing> m_outbox;
+    bool m_writing = false;
+    bool m_closed = false;
+};
+
+Replay::Replay(boost::asio::io_service& io, const std::string& capture, double speed)
+    : m_io(io)
+    , m_capturePath(capture)
+    , m_speed(speed > 0 ? speed : 1.0)
+    , m_acceptor(io)
+{
+    std::vector<SessionCapture::Event> events;
+    const std::string protocol = SessionCapture::load(capture, events);
+    if (protocol == "getwork") {
+        m_getwork = true;
+        loadGetwork(events);
+    } else if (protocol == "stratum") {
+        loadStratum(events);
+    } else {
+        throw std::runtime_error("Unknown capture protocol " + protocol);
+    }
+}
+
+Replay::~Replay()
+{
+    boost::system::error_code ec;
+    m_acceptor.close(ec);
+}
+
+void Replay::loadStratum(const std::vector<SessionCapture::Event>& events)
+{
+    Script script;
+    bool confirmed = false;
+    // Request id -> capture time and method, responses are replayed per method
+    std::map<std::string, std::pair<int64_t, std::string>> requested;
+    auto keep = [&]() {
+        // Connections that never got past subscribe are autodetection attempts
+        if (confirmed && !script.pushes.empty()) {
+            m_scripts.push_back(std::move(script));
+        }
+        script = Script();
+        confirmed = false;
+        requested.clear();
+    };
+
+    for (const auto& event : events) {
+        Json::Value msg;
+        switch (event.kind) {
+        case SessionCapture::Connected:
+            keep();
+            script.startUs = event.us;
+            break;
+        case SessionCapture::Mode:
+            confirmed = true;
+            m_mode = std::stoul(event.payload);
+            break;
+        case SessionCapture::Disconnected:
+            script.pushes.push_back(Push{event.us, std::string(), std::string()});
+            break;
+        case SessionCapture::Sent:
+            if (Json::Reader().parse(event.payload, msg)) {
+                requested[idKey(msg["id"])] = std::make_pair(event.us, msg.get("method", "").asString());
+            }
+            break;
+        case SessionCapture::Received: {
+            if (!Json::Reader().parse(event.payload, msg)) {
+                break;
+            }
+            const std::string id = idKey(msg["id"]);
+            if (msg.isMember("method") || id.empty() || id == "0") {
+                script.pushes.push_back(Push{event.us, event.payload + "\n", announcedJob(msg)});
+            } else {
+                auto sent = requested.find(id);
+                if (sent == requested.end()) {
+                    break;
+                }
+                int64_t delay = std::max<int64_t>(event.us - sent->second.first, 0);
+                script.responses[sent->second.second].push_back(Response{delay, event.payload + "\n"});
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    keep();
+
+    if (m_scripts.empty()) {
+        throw std::runtime_error("Capture holds no subscribed stratum session");
+    }
+    m_captureStart = m_scripts.front().startUs;
+}
+
+void Replay::loadGetwork(const std::vector<SessionCapture::Event>& events)
+{
+    int64_t requestedAt = -1;
+    for (const auto& event : events) {
+        Json::Value msg;
+        if (!Json::Reader().parse(event.payload, msg)) {
+            continue;
+        }
+        if (event.kind == SessionCapture::Sent) {
+            requestedAt = msg.get("method", "").asString() == "getblocktemplate" ? event.us : -1;
+        } else if (event.kind == SessionCapture::Received && requestedAt >= 0 && msg["result"].isObject()) {
+            m_templates.push_back(Template{event.us, event.us - requestedAt, msg["result"]});
+            requestedAt = -1;
+        }
+    }
+    if (m_templates.empty()) {
+        throw std::runtime_error("Capture holds no block template");
+    }
+    m_captureStart = m_templates.front().us;
+}
+
+unsigned Replay::firstHeight() const
+{
+    if (m_getwork) {
+        return m_templates.front().result.get("height", 1).asUInt();
+    }
+    for (const auto& script : m_scripts) {
+        for (const auto& push : script.pushes) {
+            Json::Value msg;
+            if (push.job.empty() || !Json::Reader().parse(push.payload, msg)) {
+                continue;
+            }
+            const Json::Value& params = msg.isMember("params") ? msg["params"] : msg["result"];
+            return params.get(Json::Value::ArrayIndex(9), 1).asUInt();
+        }
+    }
+    return 1;
+}
+
+bool Replay::prepare(MinePlant& plant, const std::vector<EnumMinerEngine>& engines,
+                     const KeepRunning& keepRunning)
+{
+    using namespace std::chrono;
+    m_plant = &plant;
+
+    // Replays only ever talk to this process
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), 0);
+    m_acceptor.open(endpoint.protocol());
+    m_acceptor.bind(endpoint);
+    m_acceptor.listen();
+    const std::string host = "127.0.0.1:" + std::to_string(m_acceptor.local_endpoint().port());
+    m_uri.reset(new URI(m_getwork ? "http://replay:x@" + host
+                                  : "stratum" + std::to_string(m_mode) + "://replay:x@" + host));
+
+    // Build the DAG before the first recorded job so it does not count as switch latency
+    const unsigned height = std::max(firstHeight(), 1u);
+    plant.setWork(Work::synthetic(height, ArithToUint256(arith_uint256(1)), arith_uint256(1) << 192, "replay"));
+    if (!plant.start(engines)) {
+        return false;
+    }
+    const auto launched = steady_clock::now();
+    for (const auto& miner : plant.getMiners()) {
+        while (miner->hashCount() == 0) {
+            if (!keepRunning()) {
+                return false;
+            }
+            if (steady_clock::now() - launched > c_dagTimeout) {
+                cwarn << "Replay: " << miner->name() << " did not start hashing";
+                break;
+            }
+            std::this_thread::sleep_for(milliseconds(100));
+        }
+    }
+
+    cnote << "Replaying " << m_capturePath << " at " << m_speed << "x on " << m_uri->String();
+    m_io.post([this] { accept(); });
+    return true;
+}
+
+void Replay::observeSolutions(MinePlant& plant, PoolClient& client)
+{
+    plant.onSolutionFound([this, &client](const Solution& solution) -> bool {
+        if (!client.isConnected()) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(x_state);
+            m_handed.emplace_back(m_getwork ? std::string() : solution.getJobName() + solution.getNonce(),
+                                  std::chrono::steady_clock::now());
+            if (m_handed.size() > c_maxHanded) {
+                m_handed.pop_front();
+            }
+        }
+        return client.submitSolution(solution);
+    });
+}
+
+URI& Replay::uri()
+{
+    return *m_uri;
+}
+
+void Replay::accept()
+{
+    auto connection = std::make_shared<Connection>(*this);
+    m_acceptor.async_accept(connection->socket(), [this, connection](const boost::system::error_code& ec) {
+        if (ec) {
+            return;
+        }
+        if (!m_startedSet) {
+            // The recording plays from the first connection on
+            m_startedSet = true;
+            m_started = std::chrono::steady_clock::now();
+        }
+        connection->start();
+        accept();
+    });
+}
+
+std::unique_ptr<Replay::Script> Replay::nextScript()
+{
+    if (m_scripts.empty()) {
+        return nullptr;
+    }
+    std::unique_ptr<Script> script(new Script(std::move(m_scripts.front())));
+    m_scripts.pop_front();
+    return script;
+}
+
+const Replay::Template* Replay::currentTemplate()
+{
+    const int64_t position = captureTime(std::chrono::steady_clock::now());
+    auto next = std::upper_bound(m_templates.begin(), m_templates.end(), position,
+            [](int64_t us, const Template& tpl) { return us < tpl.us; });
+    if (next == m_templates.end()) {
+        finished();
+    }
+    return &*(next == m_templates.begin() ? next : next - 1);
+}
+
+int64_t Replay::captureTime(std::chrono::steady_clock::time_point now) const
+{
+    const int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - m_started).count();
+    return m_captureStart + int64_t(elapsed * m_speed);
+}
+
+void Replay::finished()
+{
+    std::lock_guard<std::mutex> lock(x_state);
+    if (!m_done) {
+        m_done = true;
+        cnote << "Replay: end of capture reached";
+    }
+}
+
+void Replay::announced(const std::string& job, int64_t us)
+{
+    std::lock_guard<std::mutex> lock(x_state);
+    m_pending.push_back(PendingSwitch{job, us, std::chrono::steady_clock::now()});
+}
+
+void Replay::submitted(const std::string& job, const std::string& nonce)
+{
+    using namespace std::chrono;
+    std::lock_guard<std::mutex> lock(x_state);
+    const auto now = steady_clock::now();
+    const std::string key = job + nonce;
+    auto handed = m_handed.begin();
+    if (!key.empty()) {
+        handed = std::find_if(m_handed.begin(), m_handed.end(),
+                [&key](const std::pair<std::string, steady_clock::time_point>& h) { return h.first == key; });
+    }
+    Result result{"submit", job, captureTime(now), -1, "unmatched"};
+    if (handed != m_handed.end()) {
+        result.latencyUs = duration_cast<microseconds>(now - handed->second).count();
+        result.outcome = "received";
+        m_handed.erase(handed);
+    }
+    m_results.push_back(std::move(result));
+}
+
+std::string Replay::workKey(const WorkPtr& work)
+{
+    if (!work) {
+        return std::string();
+    }
+    // Getwork templates carry no job id, a new previous block is what makes a new job
+    return work->getJobName().empty() ? work->hashPrevBlock.GetHex() : work->getJobName();
+}
+
+bool Replay::resolveSwitches()
+{
+    using namespace std::chrono;
+    std::vector<std::pair<WorkPtr, steady_clock::time_point>> switches;
+    for (const auto& miner : m_plant->getMiners()) {
+        switches.push_back(miner->lastSwitch());
+    }
+    const auto now = steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(x_state);
+    while (!m_pending.empty()) {
+        const PendingSwitch& pending = m_pending.front();
+        Result result{"switch", pending.job, pending.us, -1, std::string()};
+
+        bool all = !switches.empty();
+        steady_clock::time_point last = pending.sentAt;
+        for (const auto& s : switches) {
+            if (workKey(s.first) == pending.job && s.second >= pending.sentAt) {
+                last = std::max(last, s.second);
+            } else {
+                all = false;
+            }
+        }
+        bool superseded = false;
+        for (size_t i = 1; i < m_pending.size() && !superseded; ++i) {
+            for (const auto& s : switches) {
+                if (workKey(s.first) == m_pending[i].job && s.second >= m_pending[i].sentAt) {
+                    superseded = true;
+                }
+            }
+        }
+
+        if (all) {
+            result.latencyUs = duration_cast<microseconds>(last - pending.sentAt).count();
+            result.outcome = "switched";
+        } else if (superseded) {
+            result.outcome = "superseded";
+        } else if (now - pending.sentAt > c_switchTimeout) {
+            // Same work as before as far as the client is concerned
+            result.outcome = "unchanged";
+        } else {
+            break;
+        }
+        m_results.push_back(std::move(result));
+        m_pending.pop_front();
+    }
+    return m_pending.empty();
+}
+
+bool Replay::run(const KeepRunning& keepRunning)
+{
+    while (keepRunning()) {
+        const bool settled = resolveSwitches();
+        {
+            std::lock_guard<std::mutex> lock(x_state);
+            if (m_done && settled && m_pending.empty()) {
+                return true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+Json::Value Replay::report() const
+{
+    Json::Value json(Json::objectValue);
+    json["capture"] = m_capturePath;
+    json["protocol"] = m_getwork ? "getwork" : "stratum";
+    if (!m_getwork) {
+        json["stratum_mode"] = m_mode;
+    }
+    json["speed"] = m_speed;
+
+    std::vector<double> switchLatencies;
+    std::vector<double> submitLatencies;
+    std::map<std::string, unsigned> outcomes;
+    json["events"] = Json::Value(Json::arrayValue);
+
+    std::lock_guard<std::mutex> lock(x_state);
+    for (const auto& result : m_results) {
+        Json::Value event(Json::objectValue);
+        event["type"] = result.type;
+        event["job"] = result.job;
+        event["t_ms"] = double(result.us) / 1000.0;
+        event["outcome"] = result.outcome;
+        if (result.latencyUs >= 0) {
+            event["latency_us"] = Json::Int64(result.latencyUs);
+            (result.type == "switch" ? switchLatencies : submitLatencies).push_back(double(result.latencyUs));
+        }
+        ++outcomes[result.type + "_" + result.outcome];
+        json["events"].append(event);
+    }
+    json["job_switch_us"] = summarize(switchLatencies);
+    json["submit_us"] = summarize(submitLatencies);
+    for (const auto& outcome : outcomes) {
+        json["outcomes"][outcome.first] = outcome.second;
+    }
+    if (m_plant) {
+        json["submit_queue_max_us"] = Json::Int64(m_plant->getSolutionQueueStats().maxTimeToSubmit.count());
+    }
+    return json;
+}
+
+} /* namespace energi */
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "nrgcore/mineplant.h"
+#include "protocol/PoolClient.h"
+#include "protocol/SessionCapture.h"
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <json/json.h>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace energi
+{
+
+/**
+ * @brief Plays a recorded pool session (--capture) back to the real client stack.
+ *
+ * A local server on 127.0.0.1 sends the recorded pool messages with their
+ * original pacing, divided by speed, and answers requests with the recorded
+ * responses and response delays. Stratum captures replay one recorded
+ * connection per client connection, getwork captures serve the template that
+ * was current at the same point of the recording.
+ *
+ * For every job the pool pushed, the time until all miners hash it is
+ * measured; for every share, the time from the plant handing it to the client
+ * until it reaches the server.
+ */
+class Replay
+{
+public:
+    using KeepRunning = std::function<bool()>;
+
+    //! Throws std::runtime_error when the capture can't be used
+    Replay(boost::asio::io_service& io, const std::string& capture, double speed);
+    ~Replay();
+
+    bool isGetwork() const
+    {
+        return m_getwork;
+    }
+
+    //! Starts the local server and brings the miners up on the first recorded block
+    bool prepare(MinePlant& plant, const std::vector<EnumMinerEngine>& engines,
+                 const KeepRunning& keepRunning);
+
+    //! Routes found solutions through the replay so submits can be timed. Call it
+    //! after the PoolManager was created, it takes over the plant's submit handler.
+    void observeSolutions(MinePlant& plant, PoolClient& client);
+
+    //! Endpoint of the local server, valid after prepare()
+    URI& uri();
+
+    //! Returns false when interrupted before the capture was fully played
+    bool run(const KeepRunning& keepRunning);
+
+    Json::Value report() const;
+
+private:
+    class Connection;
+
+    struct Push
+    {
+        int64_t     us;      // capture time
+        std::string payload; // empty to close the connection
+        std::string job;     // job the message announces, if any
+    };
+
+    struct Response
+    {
+        int64_t     delayUs; // recorded time the pool took to answer
+        std::string payload;
+    };
+
+    // One recorded stratum connection
+    struct Script
+    {
+        int64_t                                        startUs = 0; // capture time of the connect
+        std::vector<Push>                              pushes;
+        std::map<std::string, std::deque<Response>>    responses; // by request method
+    };
+
+    struct Template
+    {
+        int64_t     us;
+        int64_t     delayUs;
+        Json::Value result;
+    };
+
+    // A job announced to the client, waiting for the miners to pick it up
+    struct PendingSwitch
+    {
+        std::string                           job;
+        int64_t                               us;
+        std::chrono::steady_clock::time_point sentAt;
+    };
+
+    struct Result
+    {
+        std::string type;    // "switch" or "submit"
+        std::string job;
+        int64_t     us;      // capture time of the event
+        int64_t     latencyUs; // -1 when not measured
+        std::string outcome;
+    };
+
+    void loadStratum(const std::vector<SessionCapture::Event>& events);
+    void loadGetwork(const std::vector<SessionCapture::Event>& events);
+    unsigned firstHeight() const;
+
+    void accept();
+    std::unique_ptr<Script> nextScript();
+    const Template* currentTemplate();
+    void finished();
+
+    void announced(const std::string& job, int64_t us);
+    void submitted(const std::string& job, const std::string& nonce);
+    bool resolveSwitches();
+
+    std::chrono::steady_clock::duration scaled(int64_t us) const
+    {
+        return std::chrono::microseconds(int64_t(us / m_speed));
+    }
+
+    //! Point of the capture the replay is at
+    int64_t captureTime(std::chrono::steady_clock::time_point now) const;
+
+    static std::string workKey(const WorkPtr& work);
+
+    boost::asio::io_service&       m_io;
+    const std::string              m_capturePath;
+    const double                   m_speed;
+    bool                           m_getwork = false;
+    unsigned                       m_mode = 2;
+
+    std::deque<Script>             m_scripts;
+    std::vector<Template>          m_templates;
+    std::string                    m_lastPrevHash;
+    int64_t                        m_captureStart = 0;
+    std::chrono::steady_clock::time_point m_started;
+    bool                           m_startedSet = false;
+
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    std::unique_ptr<URI>           m_uri;
+    MinePlant*                     m_plant = nullptr;
+
+    mutable std::mutex             x_state;
+    std::deque<PendingSwitch>      m_pending;
+    std::deque<std::pair<std::string, std::chrono::steady_clock::time_point>> m_handed;
+    std::vector<Result>            m_results;
+    bool                           m_done = false;
+};
+
+} /* namespace energi */
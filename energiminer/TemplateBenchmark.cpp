@@ -0,0 +1,182 @@
+#include "TemplateBenchmark.h"
+
+#include "common/Log.h"
+#include "primitives/work.h"
+#include "protocol/SessionCapture.h"
+#include "protocol/getwork/TemplateParser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+namespace energi
+{
+
+namespace
+{
+
+// Pieces the body is fed in, as HttpSession reads it off the socket
+const size_t c_chunk = 64 * 1024;
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedUs(Clock::time_point since)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - since).count();
+}
+
+// What has to agree between the ways a template is read
+bool same(const Work& a, const Work& b)
+{
+    return a.merkleRoot(0) == b.merkleRoot(0) && a.maxTime == b.maxTime &&
+           a.txCoinbase.GetHash() == b.txCoinbase.GetHash() &&
+           a.vtxRawHex && b.vtxRawHex && *a.vtxRawHex == *b.vtxRawHex;
+}
+
+} // namespace
+
+TemplateBenchmark::TemplateBenchmark(const std::string& capture, const std::string& coinbaseAddress)
+    : m_capturePath(capture)
+    , m_coinbase(coinbaseAddress)
+{
+    std::vector<SessionCapture::Event> events;
+    if (SessionCapture::load(capture, events) != "getwork") {
+        throw std::runtime_error("Not a getwork capture: " + capture);
+    }
+    bool requested = false;
+    for (auto& event : events) {
+        Json::Value msg;
+        if (event.kind == SessionCapture::Sent) {
+            requested = Json::Reader().parse(event.payload, msg) &&
+                        msg.get("method", "").asString() == "getblocktemplate";
+        } else if (event.kind == SessionCapture::Received && requested &&
+                   Json::Reader().parse(event.payload, msg) && msg["result"].isObject()) {
+            Sample sample;
+            sample.us = event.us;
+            sample.reply = std::move(event.payload);
+            m_samples.push_back(std::move(sample));
+            requested = false;
+        }
+    }
+    if (m_samples.empty()) {
+        throw std::runtime_error("Capture holds no block template");
+    }
+}
+
+bool TemplateBenchmark::run(const KeepRunning& keepRunning, unsigned passes)
+{
+    for (auto& sample : m_samples) {
+        sample.domUs = sample.streamUs = sample.cachedUs = std::numeric_limits<double>::max();
+        sample.match = true;
+    }
+
+    TemplateParser parser;
+    auto stream = [&parser](const std::string& reply, RawTransactionCache* cache) {
+        parser.reset(cache);
+        for (size_t pos = 0; pos < reply.size(); pos += c_chunk) {
+            if (!parser.feed(reply.data() + pos, std::min(c_chunk, reply.size() - pos))) {
+                throw WorkException(parser.error());
+            }
+        }
+        if (!parser.complete()) {
+            throw WorkException("Incomplete reply");
+        }
+    };
+
+    for (m_passes = 0; m_passes < passes; ++m_passes) {
+        // Each pass polls the capture from its start
+        TemplateCache cache;
+        for (auto& sample : m_samples) {
+            if (!keepRunning()) {
+                return false;
+            }
+            try {
+                auto start = Clock::now();
+                Json::Value reply;
+                if (!Json::Reader().parse(sample.reply, reply)) {
+                    throw WorkException("Not JSON");
+                }
+                Work dom(reply["result"], m_coinbase);
+                sample.domUs = std::min(sample.domUs, elapsedUs(start));
+
+                start = Clock::now();
+                stream(sample.reply, nullptr);
+                Work streamed(parser.reply()["result"], parser.takeTransactions(), m_coinbase);
+                sample.streamUs = std::min(sample.streamUs, elapsedUs(start));
+
+                start = Clock::now();
+                stream(sample.reply, &cache.transactions);
+                Work cached(parser.reply()["result"], parser.takeTransactions(), m_coinbase, &cache);
+                sample.cachedUs = std::min(sample.cachedUs, elapsedUs(start));
+
+                sample.transactions = dom.vtxRaw.size();
+                sample.match = sample.match && same(dom, streamed) && same(dom, cached);
+            } catch (const std::exception& ex) {
+                if (sample.match) {
+                    cwarn << "Template recorded at " << sample.us << " us: " << ex.what();
+                }
+                sample.match = false;
+                sample.domUs = sample.streamUs = sample.cachedUs = 0;
+            }
+        }
+    }
+
+    double bytes = 0;
+    double dom = 0;
+    double streamed = 0;
+    double cached = 0;
+    bool match = true;
+    for (const auto& sample : m_samples) {
+        bytes += sample.reply.size();
+        dom += sample.domUs;
+        streamed += sample.streamUs;
+        cached += sample.cachedUs;
+        match = match && sample.match;
+    }
+    cnote << "Read " << m_samples.size() << " templates, " << int64_t(bytes / 1024) << " KiB: "
+          << int64_t(dom / 1000) << " ms parsed whole, " << int64_t(streamed / 1000) << " ms streamed, "
+          << int64_t(cached / 1000) << " ms streamed with the template cache";
+    if (!match) {
+        cwarn << "Streamed templates differ from the ones parsed whole";
+    }
+    return match;
+}
+
+Json::Value TemplateBenchmark::report() const
+{
+    Json::Value report(Json::objectValue);
+    report["capture"] = m_capturePath;
+    report["passes"] = m_passes;
+    report["chunkBytes"] = Json::UInt64(c_chunk);
+
+    Json::Value totals(Json::objectValue);
+    Json::UInt64 bytes = 0;
+    double dom = 0;
+    double streamed = 0;
+    double cached = 0;
+    report["templates"] = Json::Value(Json::arrayValue);
+    for (const auto& sample : m_samples) {
+        Json::Value entry(Json::objectValue);
+        entry["us"] = Json::Int64(sample.us);
+        entry["bytes"] = Json::UInt64(sample.reply.size());
+        entry["transactions"] = Json::UInt64(sample.transactions);
+        entry["domUs"] = sample.domUs;
+        entry["streamUs"] = sample.streamUs;
+        entry["cachedUs"] = sample.cachedUs;
+        entry["match"] = sample.match;
+        report["templates"].append(entry);
+        bytes += sample.reply.size();
+        dom += sample.domUs;
+        streamed += sample.streamUs;
+        cached += sample.cachedUs;
+    }
+    totals["bytes"] = bytes;
+    totals["domUs"] = dom;
+    totals["streamUs"] = streamed;
+    totals["cachedUs"] = cached;
+    report["totals"] = totals;
+    return report;
+}
+
+} /* namespace energi */
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <json/json.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace energi
+{
+
+/**
+ * @brief Times how block templates recorded in a getwork capture are read.
+ *
+ * Every recorded getblocktemplate reply is made into work three ways: parsed
+ * whole into a Json::Value, streamed through TemplateParser in the chunks
+ * HttpSession reads, and streamed with the template cache holding the
+ * previous template, as when polling a node. All three must give the same
+ * block.
+ */
+class TemplateBenchmark
+{
+public:
+    using KeepRunning = std::function<bool()>;
+
+    //! Throws std::runtime_error when the capture holds no template
+    TemplateBenchmark(const std::string& capture, const std::string& coinbaseAddress);
+
+    //! Returns false when interrupted or when the ways disagree on a template
+    bool run(const KeepRunning& keepRunning, unsigned passes);
+
+    Json::Value report() const;
+
+private:
+    struct Sample
+    {
+        int64_t     us;      // capture time
+        std::string reply;   // body as received
+        size_t      transactions = 0;
+        double      domUs = 0;
+        double      streamUs = 0;
+        double      cachedUs = 0;
+        bool        match = true;
+    };
+
+    const std::string    m_capturePath;
+    const std::string    m_coinbase;
+    std::vector<Sample>  m_samples;
+    unsigned             m_passes = 0;
+};
+
+} /* namespace energi */
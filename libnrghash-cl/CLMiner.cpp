@@ -313,7 +313,7 @@ void CLMiner::trun()
                 }
 
                 auto height = m_current.nHeight;
-                uint32_t new_epoch = height / nrghash::constants::EPOCH_LENGTH;
+                uint32_t new_epoch = m_current.getEpoch();
                 uint32_t last_epoch = m_lastHeight / nrghash::constants::EPOCH_LENGTH;
 
                 if (!m_dagLoaded || (new_epoch != last_epoch)) {
@@ -327,7 +327,9 @@ void CLMiner::trun()
                     }
 
                     m_abortqueue.clear();
+                    auto dagStart = std::chrono::steady_clock::now();
                     init(height);
+                    setDagLoadTime(std::chrono::steady_clock::now() - dagStart);
                     //m_abortqueue.push_back(cl::CommandQueue(m_context[0], m_device));
                     m_dagLoaded = true;
                 }
@@ -337,11 +339,10 @@ void CLMiner::trun()
                 assert(!m_queue.empty());
                 curr_queue = &m_queue[0];
 
-                energi::CBlockHeaderTruncatedLE truncatedBlockHeader(m_current);
-                nrghash::h256_t hash_header(&truncatedBlockHeader, sizeof(truncatedBlockHeader));
+                const auto& hash_header = m_current.getHeaderHash();
 
                 // Upper 64 bits of the boundary.
-                const uint64_t target = *reinterpret_cast<uint64_t const *>((m_current.hashTarget >> 192).data());
+                const uint64_t target = m_current.getBoundary();
                 assert(target > 0);
 
                 // Update header constant buffer.
@@ -353,7 +354,7 @@ void CLMiner::trun()
                 curr_queue->enqueueWriteBuffer(m_searchBuffer[1], CL_FALSE,
                     offsetof(SearchResults, count), sizeof(zerox3), zerox3);
 
-                startNonce = m_plant.getStartNonce(m_current, m_index);
+                startNonce = m_plant.getStartNonce(m_current.getWork(), m_index);
 
                 m_searchKernel.setArg(1, m_header[0]);        // Supply header buffer to kernel.
                 m_searchKernel.setArg(2, m_dag[0]);           // Supply DAG buffer to kernel.
@@ -423,7 +424,7 @@ void CLMiner::trun()
 
                 auto const powHash = GetPOWHash(m_current);
 
-                if (UintToArith256(powHash) <= m_current.hashTarget) {
+                if (UintToArith256(powHash) <= m_current.getTarget()) {
                     cllog << name()
                         << " Submitting block blockhash: " << m_current.GetHash().ToString()
                         << " height: " << m_current.nHeight << " nonce: " << nonce;
@@ -102,11 +102,13 @@ void CUDAMiner::trun()
                 }
 
                 auto height = m_current.nHeight;
-                auto new_epoch = height / nrghash::constants::EPOCH_LENGTH;
+                auto new_epoch = m_current.getEpoch();
                 auto last_epoch = m_lastHeight / nrghash::constants::EPOCH_LENGTH;
 
                 if (!m_dagLoaded || (new_epoch != last_epoch)) {
+                    auto dagStart = std::chrono::steady_clock::now();
                     init_dag(height);
+                    setDagLoadTime(std::chrono::steady_clock::now() - dagStart);
                     cnote << "End initialising";
                     m_dagLoaded = true;
                 }
@@ -119,15 +121,12 @@ void CUDAMiner::trun()
                 continue;
             }
 
-            energi::CBlockHeaderTruncatedLE truncatedBlockHeader(m_current);
-            nrghash::h256_t hash_header(&truncatedBlockHeader, sizeof(truncatedBlockHeader));
-
             // Upper 64 bits of the boundary.
-            const uint64_t upper64OfBoundary = *reinterpret_cast<uint64_t const *>((m_current.hashTarget >> 192).data());
+            const uint64_t upper64OfBoundary = m_current.getBoundary();
             assert(upper64OfBoundary > 0);
-            uint64_t startN = m_plant.getStartNonce(m_current, m_index);
+            uint64_t startN = m_plant.getStartNonce(m_current.getWork(), m_index);
 
-            search(hash_header.data(), upper64OfBoundary, startN, m_current);
+            search(m_current.getHeaderHash().data(), upper64OfBoundary, startN, m_current);
         }
         // Reset miner and stop working
         CUDA_SAFE_CALL(cudaDeviceReset());
@@ -450,7 +449,7 @@ void CUDAMiner::search(
     uint8_t const* header,
     uint64_t target,
     uint64_t startN,
-    Work& work)
+    Job& work)
 {
     set_header(*reinterpret_cast<hash32_t const *>(header));
     if (m_current_target != target) {
@@ -505,7 +504,7 @@ void CUDAMiner::search(
                     
                     auto const powHash = GetPOWHash(work);
                     
-                    if (UintToArith256(powHash) <= work.hashTarget) {
+                    if (UintToArith256(powHash) <= work.getTarget()) {
                         cudalog << name()
                                 << " Submitting block blockhash: "
                                 << work.GetHash().ToString()
@@ -0,0 +1,596 @@
+#include "MockPool.h"
+
+#include "common/Log.h"
+#include "primitives/job.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+using boost::asio::ip::tcp;
+
+namespace energi
+{
+
+namespace
+{
+
+// Same conversion as StratumClient, shares are checked against what the miner sees
+const arith_uint256 c_diff1Target("0x00000000ffff0000000000000000000000000000000000000000000000000000");
+const double c_diffMult = 10e4;
+
+arith_uint256 diffToTarget(double diff)
+{
+    arith_uint256 target = c_diff1Target;
+    target /= uint64_t(std::max(diff, 0.0001) * c_diffMult);
+    target *= c_diffMult;
+    return target;
+}
+
+// Jobs kept per session for late submits, StratumClient keeps 8
+const size_t c_sessionJobs = 16;
+// Accepted ntime drift past the wall clock, as bitcoind does
+const uint32_t c_maxFutureTime = 7200;
+
+bool parseHex(const std::string& hex, uint64_t& value)
+{
+    if (hex.empty() || hex.size() > 16 || !IsHex(hex)) {
+        return false;
+    }
+    value = std::stoull(hex, nullptr, 16);
+    return true;
+}
+
+} // namespace
+
+// One miner connection. Everything runs on the single io_service thread.
+class MockPool::Session : public std::enable_shared_from_this<MockPool::Session>
+{
+public:
+    Session(MockPool& pool, const std::string& extraNonce1)
+        : m_pool(pool)
+        , m_socket(pool.m_io)
+        , m_sendTimer(pool.m_io)
+        , m_dropTimer(pool.m_io)
+        , m_extraNonce1(extraNonce1)
+        , m_target(diffToTarget(pool.currentDifficulty()))
+    {}
+
+    tcp::socket& socket()
+    {
+        return m_socket;
+    }
+
+    bool authorized() const
+    {
+        return m_authorized;
+    }
+
+    void start()
+    {
+        if (m_pool.m_options.disconnectAfter) {
+            auto self = shared_from_this();
+            m_dropTimer.expires_from_now(std::chrono::seconds(m_pool.m_options.disconnectAfter));
+            m_dropTimer.async_wait([self](const boost::system::error_code& ec) {
+                if (!ec) {
+                    cnote << "Dropping session " << self->m_extraNonce1;
+                    ++self->m_pool.m_stats.disconnects;
+                    self->close();
+                }
+            });
+        }
+        read();
+    }
+
+    void close()
+    {
+        if (m_closed) {
+            return;
+        }
+        m_closed = true;
+        boost::system::error_code ec;
+        m_sendTimer.cancel(ec);
+        m_dropTimer.cancel(ec);
+        m_socket.shutdown(tcp::socket::shutdown_both, ec);
+        m_socket.close(ec);
+        m_pool.remove(shared_from_this());
+    }
+
+    void sendJob(const PoolJob& job, bool clean)
+    {
+        if (clean) {
+            m_jobs.clear();
+            m_order.clear();
+            m_submitted.clear();
+        }
+        SessionJob entry;
+        entry.work = std::make_shared<const Work>(job.params, m_extraNonce1, m_target);
+        entry.notifiedAt = std::chrono::steady_clock::now();
+        m_jobs[entry.work->getJobName()] = entry;
+        m_order.push_back(entry.work->getJobName());
+        if (m_order.size() > c_sessionJobs) {
+            m_jobs.erase(m_order.front());
+            m_order.pop_front();
+        }
+
+        Json::Value params = job.params;
+        params[Json::Value::ArrayIndex(8)] = clean;
+        Json::Value msg;
+        if (m_pool.m_options.dialect == MockDialect::NrgProxy) {
+            // nrg-proxy pushes jobs the way it answers get_work
+            msg["id"] = 0;
+            msg["result"] = params;
+        } else {
+            notification(msg, "mining.notify");
+            msg["params"] = params;
+        }
+        send(msg);
+        ++m_pool.m_stats.notifies;
+    }
+
+    void sendDifficulty(double difficulty)
+    {
+        // Like StratumClient, the new target applies from the next job on
+        m_target = diffToTarget(difficulty);
+        Json::Value msg;
+        notification(msg, "mining.set_difficulty");
+        msg["params"] = Json::Value(Json::arrayValue);
+        msg["params"].append(difficulty);
+        send(msg);
+    }
+
+private:
+    struct SessionJob
+    {
+        WorkPtr work;
+        std::chrono::steady_clock::time_point notifiedAt;
+    };
+
+    void read()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(m_socket, m_recvBuffer, "\n",
+                [self](const boost::system::error_code& ec, std::size_t) {
+            if (ec) {
+                self->close();
+                return;
+            }
+            std::istream is(&self->m_recvBuffer);
+            std::string line;
+            std::getline(is, line);
+            Json::Value request;
+            if (!line.empty() && !Json::Reader().parse(line, request)) {
+                cwarn << "Session " << self->m_extraNonce1 << " sent unparseable data, closing";
+                self->close();
+                return;
+            }
+            if (!line.empty()) {
+                self->handle(request);
+            }
+            if (!self->m_closed) {
+                self->read();
+            }
+        });
+    }
+
+    void notification(Json::Value& msg, const std::string& method) const
+    {
+        if (m_pool.m_options.dialect == MockDialect::Stratum) {
+            msg["jsonrpc"] = "2.0";
+        } else {
+            msg["id"] = Json::Value::null;
+        }
+        msg["method"] = method;
+    }
+
+    void reply(const Json::Value& request, const Json::Value& result, const std::string& error = "")
+    {
+        Json::Value msg;
+        msg["id"] = request.get("id", Json::Value::null);
+        const bool rpc2 = request.isMember("jsonrpc");
+        if (rpc2) {
+            msg["jsonrpc"] = "2.0";
+        }
+        if (error.empty()) {
+            msg["result"] = result;
+            if (!rpc2) {
+                msg["error"] = Json::Value::null;
+            }
+        } else if (rpc2) {
+            msg["error"]["code"] = -1;
+            msg["error"]["message"] = error;
+        } else {
+            msg["result"] = Json::Value::null;
+            msg["error"] = Json::Value(Json::arrayValue);
+            msg["error"].append(-1);
+            msg["error"].append(error);
+            msg["error"].append(Json::Value::null);
+        }
+        send(msg);
+    }
+
+    void handle(const Json::Value& request)
+    {
+        const std::string method = request.get("method", "").asString();
+        const bool rpc2 = request.isMember("jsonrpc");
+
+        if (method == "mining.subscribe") {
+            // Only the dialect under test answers, StratumClient's autodetection
+            // moves on to the next mode on an error
+            if (rpc2 != (m_pool.m_options.dialect == MockDialect::Stratum)) {
+                reply(request, Json::Value(), "Unsupported stratum dialect");
+                return;
+            }
+            Json::Value result(Json::arrayValue);
+            Json::Value subscriptions(Json::arrayValue);
+            for (const char* name : {"mining.set_difficulty", "mining.notify"}) {
+                Json::Value subscription(Json::arrayValue);
+                subscription.append(name);
+                subscription.append(m_extraNonce1);
+                subscriptions.append(subscription);
+            }
+            result.append(subscriptions);
+            result.append(m_extraNonce1);
+            result.append(4);
+            reply(request, result);
+            // nrg-proxy treats the subscription as the login
+            if (m_pool.m_options.dialect == MockDialect::NrgProxy) {
+                beginMining();
+            }
+        } else if (method == "mining.extranonce.subscribe") {
+            reply(request, true);
+        } else if (method == "mining.authorize") {
+            reply(request, true);
+            if (!m_authorized) {
+                if (m_pool.m_options.dialect == MockDialect::Stratum) {
+                    // Plain stratum ignores the subscribe result, hand out extranonce1 here
+                    Json::Value msg;
+                    notification(msg, "mining.set_extranonce");
+                    msg["params"] = Json::Value(Json::arrayValue);
+                    msg["params"].append(m_extraNonce1);
+                    send(msg);
+                }
+                beginMining();
+            }
+        } else if (method == "mining.submit") {
+            if (!m_authorized) {
+                reply(request, Json::Value(), "Unauthorized worker");
+                return;
+            }
+            const std::string reason = submit(request.get("params", Json::Value::null));
+            reply(request, reason.empty(), reason);
+        } else {
+            reply(request, Json::Value(), "Method not found");
+        }
+    }
+
+    void beginMining()
+    {
+        m_authorized = true;
+        sendDifficulty(m_pool.currentDifficulty());
+        if (m_pool.m_current.height) {
+            sendJob(m_pool.m_current, true);
+        }
+    }
+
+    std::string submit(const Json::Value& params)
+    {
+        auto& stats = m_pool.m_stats;
+        if (!params.isArray() || params.size() < 8) {
+            ++stats.invalid;
+            return "Malformed submit";
+        }
+        const std::string jobName = params[1].asString();
+        const std::string extraNonce2 = params[2].asString();
+        uint64_t time = 0;
+        uint64_t nonce = 0;
+        if (extraNonce2.size() != 8 || !IsHex(extraNonce2) ||
+                !parseHex(params[3].asString(), time) || time > 0xffffffff ||
+                !parseHex(params[4].asString(), nonce)) {
+            ++stats.invalid;
+            return "Malformed submit";
+        }
+
+        auto job = m_jobs.find(jobName);
+        if (job == m_jobs.end()) {
+            ++stats.stale;
+            return "Stale job";
+        }
+        const std::string key = jobName + extraNonce2 + params[3].asString() + params[4].asString();
+        if (!m_submitted.insert(key).second) {
+            ++stats.duplicate;
+            return "Duplicate share";
+        }
+
+        // Same byte layout as Job::getExtraNonce2()
+        const auto bytes = ParseHex(extraNonce2);
+        uint32_t en2 = 0;
+        std::memcpy(&en2, bytes.data(), sizeof(en2));
+
+        const std::string reason = m_pool.verify(*job->second.work, en2, uint32_t(time), nonce,
+                params[5].asString(), params[7].asString());
+        if (!reason.empty()) {
+            ++stats.invalid;
+            cwarn << "Rejected share for job " << jobName << " from " << m_extraNonce1 << ": " << reason;
+            return reason;
+        }
+        ++stats.accepted;
+        stats.latency.add(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - job->second.notifiedAt));
+        return std::string();
+    }
+
+    void send(const Json::Value& msg)
+    {
+        if (m_closed) {
+            return;
+        }
+        // Injected latency never reorders messages
+        auto due = std::chrono::steady_clock::now() + m_pool.sendDelay();
+        due = std::max(due, m_lastDue);
+        m_lastDue = due;
+        m_outbox.emplace_back(due, Json::FastWriter().write(msg));
+        if (!m_writing) {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        if (m_closed || m_outbox.empty()) {
+            m_writing = false;
+            return;
+        }
+        m_writing = true;
+        auto self = shared_from_this();
+        if (m_outbox.front().first > std::chrono::steady_clock::now()) {
+            m_sendTimer.expires_at(m_outbox.front().first);
+            m_sendTimer.async_wait([self](const boost::system::error_code& ec) {
+                if (!ec) {
+                    self->flush();
+                }
+            });
+            return;
+        }
+        boost::asio::async_write(m_socket, boost::asio::buffer(m_outbox.front().second),
+                [self](const boost::system::error_code& ec, std::size_t) {
+            if (ec) {
+                self->close();
+                return;
+            }
+            self->m_outbox.pop_front();
+            self->flush();
+        });
+    }
+
+    MockPool& m_pool;
+    tcp::socket m_socket;
+    boost::asio::steady_timer m_sendTimer;
+    boost::asio::steady_timer m_dropTimer;
+    boost::asio::streambuf m_recvBuffer;
+
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> m_outbox;
+    std::chrono::steady_clock::time_point m_lastDue;
+    bool m_writing = false;
+    bool m_closed = false;
+
+    const std::string m_extraNonce1;
+    bool m_authorized = false;
+    arith_uint256 m_target;
+    std::map<std::string, SessionJob> m_jobs;
+    std::deque<std::string> m_order;
+    std::set<std::string> m_submitted;
+};
+
+MockPool::MockPool(boost::asio::io_service& io, const Options& options)
+    : m_io(io)
+    , m_options(options)
+    , m_acceptor(io)
+    , m_notifyTimer(io)
+    , m_difficultyTimer(io)
+    , m_reportTimer(io)
+    , m_height(std::max(options.block, 1u)) // height 0 is treated as no work
+    , m_random(std::random_device{}())
+{
+}
+
+void MockPool::start()
+{
+    cnote << "Building verification cache for epoch " << m_height / nrghash::constants::EPOCH_LENGTH;
+    m_cache.reset(new nrghash::cache_t(m_height));
+
+    // Load tests only ever talk to a local miner
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), m_options.port);
+    m_acceptor.open(endpoint.protocol());
+    m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+    m_acceptor.bind(endpoint);
+    m_acceptor.listen();
+    cnote << "Listening on " << endpoint << ", dialect " << unsigned(m_options.dialect)
+          << " (stratum" << unsigned(m_options.dialect) << "://)";
+
+    nextJob();
+    accept();
+
+    m_notifyTimer.expires_from_now(std::chrono::milliseconds(m_options.notifyInterval));
+    m_notifyTimer.async_wait([this](const boost::system::error_code& ec) { onNotifyTimer(ec); });
+    if (m_options.difficultyInterval) {
+        m_difficultyTimer.expires_from_now(std::chrono::milliseconds(m_options.difficultyInterval));
+        m_difficultyTimer.async_wait([this](const boost::system::error_code& ec) { onDifficultyTimer(ec); });
+    }
+    if (m_options.reportInterval) {
+        m_reportTimer.expires_from_now(std::chrono::seconds(m_options.reportInterval));
+        m_reportTimer.async_wait([this](const boost::system::error_code& ec) { onReportTimer(ec); });
+    }
+}
+
+void MockPool::stop()
+{
+    boost::system::error_code ec;
+    m_acceptor.close(ec);
+    m_notifyTimer.cancel(ec);
+    m_difficultyTimer.cancel(ec);
+    m_reportTimer.cancel(ec);
+    // close() removes the session from the set
+    auto sessions = m_sessions;
+    for (const auto& session : sessions) {
+        session->close();
+    }
+}
+
+void MockPool::accept()
+{
+    auto session = std::make_shared<Session>(*this, nextExtraNonce1());
+    m_acceptor.async_accept(session->socket(), [this, session](const boost::system::error_code& ec) {
+        if (ec) {
+            if (ec != boost::asio::error::operation_aborted) {
+                cwarn << "Accept failed: " << ec.message();
+            }
+            return;
+        }
+        ++m_stats.sessions;
+        m_sessions.insert(session);
+        session->start();
+        accept();
+    });
+}
+
+void MockPool::remove(const SessionPtr& session)
+{
+    m_sessions.erase(session);
+}
+
+double MockPool::currentDifficulty() const
+{
+    return m_options.difficulty * double(1u << m_difficultyStep);
+}
+
+std::string MockPool::nextExtraNonce1()
+{
+    char en1[9];
+    std::snprintf(en1, sizeof(en1), "%08x", ++m_extraNonce1);
+    return en1;
+}
+
+std::chrono::milliseconds MockPool::sendDelay()
+{
+    unsigned jitter = 0;
+    if (m_options.latencyJitter) {
+        jitter = std::uniform_int_distribution<unsigned>(0, m_options.latencyJitter)(m_random);
+    }
+    return std::chrono::milliseconds(m_options.latency + jitter);
+}
+
+bool MockPool::nextJob()
+{
+    ++m_sequence;
+    const bool clean = m_prevHash.IsNull() ||
+        (m_options.cleanEvery && (m_sequence - 1) % m_options.cleanEvery == 0);
+    if (clean) {
+        if (!m_prevHash.IsNull()) {
+            ++m_height;
+        }
+        // Unique per run so a restarted pool never matches stale miner state
+        m_prevHash = ArithToUint256(arith_uint256(uint64_t(std::time(nullptr))) << 64 |
+                                    arith_uint256(m_sequence));
+    }
+    m_current.height = m_height;
+    m_current.params = Work::syntheticNotify(m_height, m_prevHash, "mock" + std::to_string(m_sequence), clean);
+    return clean;
+}
+
+void MockPool::onNotifyTimer(const boost::system::error_code& ec)
+{
+    if (ec) {
+        return;
+    }
+    for (unsigned i = 0; i < std::max(m_options.notifyBurst, 1u); ++i) {
+        const bool clean = nextJob();
+        for (const auto& session : m_sessions) {
+            if (session->authorized()) {
+                session->sendJob(m_current, clean);
+            }
+        }
+    }
+    m_notifyTimer.expires_from_now(std::chrono::milliseconds(m_options.notifyInterval));
+    m_notifyTimer.async_wait([this](const boost::system::error_code& ec) { onNotifyTimer(ec); });
+}
+
+void MockPool::onDifficultyTimer(const boost::system::error_code& ec)
+{
+    if (ec) {
+        return;
+    }
+    m_difficultyStep = (m_difficultyStep + 1) % std::max(m_options.difficultySteps, 1u);
+    for (const auto& session : m_sessions) {
+        if (session->authorized()) {
+            session->sendDifficulty(currentDifficulty());
+        }
+    }
+    m_difficultyTimer.expires_from_now(std::chrono::milliseconds(m_options.difficultyInterval));
+    m_difficultyTimer.async_wait([this](const boost::system::error_code& ec) { onDifficultyTimer(ec); });
+}
+
+void MockPool::onReportTimer(const boost::system::error_code& ec)
+{
+    if (ec) {
+        return;
+    }
+    logStats();
+    m_reportTimer.expires_from_now(std::chrono::seconds(m_options.reportInterval));
+    m_reportTimer.async_wait([this](const boost::system::error_code& ec) { onReportTimer(ec); });
+}
+
+std::string MockPool::verify(const Work& work, uint32_t extraNonce2, uint32_t time,
+                             uint64_t nonce, const std::string& mix, const std::string& merkleRoot)
+{
+    if (time < work.nTime || time > uint32_t(std::time(nullptr)) + c_maxFutureTime) {
+        return "Time out of range";
+    }
+    // Rebuild the header from the job we sent, nothing the miner computed is trusted
+    energi::Job job(std::make_shared<const Work>(work), extraNonce2, time);
+    if (uint256S(merkleRoot) != job.hashMerkleRoot) {
+        return "Bad merkle root";
+    }
+    if (!m_cache || m_cache->epoch() != work.epoch) {
+        cnote << "Building verification cache for epoch " << work.epoch;
+        m_cache.reset(new nrghash::cache_t(work.nHeight));
+    }
+    const auto result = nrghash::light::hash(*m_cache, job.getHeaderHash(), nonce);
+    if (uint256(result.mixhash) != uint256S(mix)) {
+        return "Bad mix hash";
+    }
+    if (UintToArith256(uint256(result.value)) > work.hashTarget) {
+        return "Low difficulty share";
+    }
+    return std::string();
+}
+
+void MockPool::logStats() const
+{
+    cnote << m_sessions.size() << " session(s), " << m_stats.notifies << " notifies, "
+          << m_stats.accepted << " accepted, " << m_stats.stale << " stale, "
+          << m_stats.duplicate << " duplicate, " << m_stats.invalid << " invalid";
+    if (m_stats.latency.count()) {
+        cnote << "Notify -> submit: " << m_stats.latency.ToString();
+    }
+}
+
+Json::Value MockPool::report() const
+{
+    Json::Value json(Json::objectValue);
+    json["dialect"] = unsigned(m_options.dialect);
+    json["sessions"] = m_stats.sessions;
+    json["disconnects"] = m_stats.disconnects;
+    json["notifies"] = Json::UInt64(m_stats.notifies);
+    json["accepted"] = Json::UInt64(m_stats.accepted);
+    json["stale"] = Json::UInt64(m_stats.stale);
+    json["duplicate"] = Json::UInt64(m_stats.duplicate);
+    json["invalid"] = Json::UInt64(m_stats.invalid);
+    json["notify_to_submit"] = m_stats.latency.toJson();
+    return json;
+}
+
+} /* namespace energi */
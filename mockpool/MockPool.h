@@ -0,0 +1,127 @@
+#pragma once
+
+#include "common/LatencyHistogram.h"
+#include "primitives/work.h"
+#include "nrghash/nrghash.h"
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace energi
+{
+
+// Stratum dialects as numbered by StratumClient and the stratumN:// schemes
+enum class MockDialect : unsigned
+{
+    Stratum = 0,
+    NrgProxy = 1,
+    EnergiStratum = 2
+};
+
+/**
+ * Loopback-only stratum server for end-to-end load tests of the miner. Pushes
+ * synthetic jobs and difficulty changes at configurable rates, can delay and
+ * drop connections, and verifies every mining.submit with a light nrghash.
+ */
+class MockPool
+{
+public:
+    struct Options
+    {
+        unsigned short port = 3333;
+        MockDialect dialect = MockDialect::EnergiStratum;
+        unsigned block = 1;
+
+        unsigned notifyInterval = 10000; // ms between notify ticks
+        unsigned notifyBurst = 1;        // notifies sent back to back per tick
+        unsigned cleanEvery = 4;         // every Nth notify starts a new block, 0 never
+
+        double difficulty = 0.0001;      // stratum share difficulty
+        unsigned difficultyInterval = 0; // ms between set_difficulty, 0 never
+        unsigned difficultySteps = 4;    // difficulty cycles through x1, x2 .. x2^(n-1)
+
+        unsigned latency = 0;            // ms added to every message sent
+        unsigned latencyJitter = 0;      // up to this many ms more, at random
+        unsigned disconnectAfter = 0;    // s before a session gets dropped, 0 never
+
+        unsigned reportInterval = 30;    // s between stats lines, 0 never
+    };
+
+    struct Stats
+    {
+        unsigned sessions = 0;
+        unsigned disconnects = 0;
+        uint64_t notifies = 0;
+        uint64_t accepted = 0;
+        uint64_t stale = 0;
+        uint64_t duplicate = 0;
+        uint64_t invalid = 0;
+        LatencyHistogram latency; // job notify -> valid submit received
+    };
+
+    MockPool(boost::asio::io_service& io, const Options& options);
+
+    //! Builds the verification cache and starts listening on 127.0.0.1
+    void start();
+    void stop();
+
+    const Stats& stats() const { return m_stats; }
+    Json::Value report() const;
+    void logStats() const;
+
+private:
+    class Session;
+    using SessionPtr = std::shared_ptr<Session>;
+
+    struct PoolJob
+    {
+        Json::Value params;
+        uint32_t height = 0;
+    };
+
+    void accept();
+    void onNotifyTimer(const boost::system::error_code& ec);
+    void onDifficultyTimer(const boost::system::error_code& ec);
+    void onReportTimer(const boost::system::error_code& ec);
+
+    //! Moves m_current on, true when the new job starts a block
+    bool nextJob();
+    double currentDifficulty() const;
+    void remove(const SessionPtr& session);
+
+    //! Empty when the share is good, the reject reason otherwise
+    std::string verify(const Work& work, uint32_t extraNonce2, uint32_t time,
+                       uint64_t nonce, const std::string& mix, const std::string& merkleRoot);
+    std::chrono::milliseconds sendDelay();
+    std::string nextExtraNonce1();
+
+    boost::asio::io_service& m_io;
+    const Options m_options;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    boost::asio::steady_timer m_notifyTimer;
+    boost::asio::steady_timer m_difficultyTimer;
+    boost::asio::steady_timer m_reportTimer;
+    std::set<SessionPtr> m_sessions;
+
+    uint32_t m_height;
+    uint256 m_prevHash;
+    unsigned m_sequence = 0;
+    unsigned m_difficultyStep = 0;
+    PoolJob m_current;
+
+    unsigned m_extraNonce1 = 0;
+    std::mt19937 m_random;
+    std::unique_ptr<nrghash::cache_t> m_cache;
+    Stats m_stats;
+};
+
+} /* namespace energi */
@@ -0,0 +1,91 @@
+#include "MockPool.h"
+
+#include "common/Log.h"
+
+#include <CLI/CLI.hpp>
+
+#include <boost/asio/signal_set.hpp>
+
+#include <fstream>
+#include <iostream>
+
+using namespace energi;
+
+int main(int argc, char** argv)
+{
+    MockPool::Options options;
+    unsigned dialect = unsigned(options.dialect);
+    std::string reportFile;
+
+    CLI::App app("mockpool - local stratum server for energiminer load tests");
+    app.add_option("-v,--verbosity", g_logVerbosity,
+            "Set log verbosity from 0 to 9", true)
+        ->check(CLI::Range(9));
+    app.add_option("-p,--port", options.port,
+            "Port to listen on, always bound to 127.0.0.1", true);
+    app.add_option("-d,--dialect", dialect,
+            "0 STRATUM, 1 NRGPROXY, 2 ENERGISTRATUM. Point the miner at stratum<dialect>://127.0.0.1:<port>, "
+            "plain stratum:// autodetects 0 and 2 only", true)
+        ->check(CLI::Range(2));
+    app.add_option("--block", options.block,
+            "Height of the first job, selects the nrghash epoch", true);
+    app.add_option("--notify-interval", options.notifyInterval,
+            "Milliseconds between mining.notify bursts", true)
+        ->check(CLI::Range(1, 3600000));
+    app.add_option("--notify-burst", options.notifyBurst,
+            "mining.notify messages sent back to back per burst", true)
+        ->check(CLI::Range(1, 1000));
+    app.add_option("--clean-every", options.cleanEvery,
+            "Every Nth job starts a new block with clean_jobs set, 0 only the first", true);
+    app.add_option("--difficulty", options.difficulty,
+            "Share difficulty, as sent with mining.set_difficulty", true);
+    app.add_option("--difficulty-interval", options.difficultyInterval,
+            "Milliseconds between mining.set_difficulty changes, 0 keeps it fixed", true);
+    app.add_option("--difficulty-steps", options.difficultySteps,
+            "Difficulty changes cycle through 1x, 2x ... 2^(steps-1)x", true)
+        ->check(CLI::Range(1, 16));
+    app.add_option("--latency", options.latency,
+            "Milliseconds added to every message sent to the miner", true);
+    app.add_option("--latency-jitter", options.latencyJitter,
+            "Up to this many random milliseconds on top of --latency", true);
+    app.add_option("--disconnect-after", options.disconnectAfter,
+            "Drop every connection after this many seconds, 0 never", true);
+    app.add_option("--report-interval", options.reportInterval,
+            "Seconds between stats lines, 0 disables", true);
+    app.add_option("--report", reportFile,
+            "Write the final stats and latency histogram as JSON to this file");
+
+    try {
+        app.parse(argc, argv);
+    } catch (const CLI::ParseError& e) {
+        return app.exit(e);
+    }
+    options.dialect = MockDialect(dialect);
+
+    try {
+        boost::asio::io_service io;
+        MockPool pool(io, options);
+        pool.start();
+
+        boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+        signals.async_wait([&pool](const boost::system::error_code&, int) {
+            pool.stop();
+        });
+        io.run();
+
+        pool.logStats();
+        if (!reportFile.empty()) {
+            std::ofstream out(reportFile);
+            out << Json::StyledWriter().write(pool.report());
+            if (!out) {
+                cwarn << "Could not write " << reportFile;
+                return 1;
+            }
+            cnote << "Report written to " << reportFile;
+        }
+    } catch (const std::exception& e) {
+        cwarn << e.what();
+        return 1;
+    }
+    return 0;
+}
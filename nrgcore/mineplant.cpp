@@ -51,6 +51,27 @@ MinerPtr createMiner(EnumMinerEngine minerEngine, int index, const MinePlant &pl
     return nullptr;
 }
 
+static unsigned minerInstances(EnumMinerEngine minerEngine)
+{
+#if NRGHASHCL
+    if (minerEngine == EnumMinerEngine::kCL) {
+        return CLMiner::instances();
+    }
+#endif
+#if NRGHASHCUDA
+    if (minerEngine == EnumMinerEngine::kCUDA) {
+        return CUDAMiner::instances();
+    }
+#endif
+    if (minerEngine == EnumMinerEngine::kTest) {
+        return 2;
+    }
+    if (minerEngine == EnumMinerEngine::kCPU) {
+        return std::thread::hardware_concurrency() - 1;
+    }
+    return 0;
+}
+
 MinePlant::MinePlant(boost::asio::io_service& io_service, bool hwmon, bool pwron)
     : m_io_strand(io_service)
     , m_collectTimer(io_service)
@@ -75,6 +96,13 @@ MinePlant::MinePlant(boost::asio::io_service& io_service, bool hwmon, bool pwron
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(m_io_strand.wrap(
                 boost::bind(&MinePlant::collectData, this, boost::asio::placeholders::error)));
+
+    // Solutions found for an older block are not worth a round trip to the pool
+    m_solutions.onIsStale([this](const Solution& sol) {
+        std::lock_guard<std::mutex> lock(x_minerWork);
+        return m_work && sol.getWork().hashPrevBlock != m_work->hashPrevBlock;
+    });
+    m_solutions.startWorking();
 }
 
 MinePlant::~MinePlant()
@@ -92,6 +120,7 @@ MinePlant::~MinePlant()
         wrap_nvml_destroy(nvmlh);
     }
     stop();
+    m_solutions.stopWorking();
     // Stop data collector
     m_collectTimer.cancel();
 }
@@ -106,29 +135,26 @@ bool MinePlant::start(const std::vector<EnumMinerEngine> &vMinerEngine)
     m_lastHashRate = std::chrono::steady_clock::now();
 
     //m_started = true;
+    // Engines number their devices from 0, the extranonce2 partitions are
+    // handed out across all of them so no two miners share one
+    std::vector<unsigned> counts;
+    unsigned total = 0;
     for ( auto &minerEngine : vMinerEngine) {
-        unsigned count = 0;
-#if NRGHASHCL
-        if (minerEngine == EnumMinerEngine::kCL) {
-            count = CLMiner::instances();
-        }
-#endif
-#if NRGHASHCUDA
-        if (minerEngine == EnumMinerEngine::kCUDA) {
-            count = CUDAMiner::instances();
-        }
-#endif
-        if (minerEngine == EnumMinerEngine::kTest) {
-            count = 2;
-        }
-        if (minerEngine == EnumMinerEngine::kCPU) {
-            count = std::thread::hardware_concurrency() - 1;
-        }
-        for ( unsigned i = 0; i < count; ++i ) {
-            m_miners.push_back(createMiner(minerEngine, i, *this));
+        counts.push_back(minerInstances(minerEngine));
+        total += counts.back();
+    }
+    unsigned partitions = 1;
+    while (partitions < total) {
+        partitions <<= 1;
+    }
+
+    for (size_t e = 0; e < vMinerEngine.size(); ++e) {
+        for ( unsigned i = 0; i < counts[e]; ++i ) {
+            m_miners.push_back(createMiner(vMinerEngine[e], i, *this));
             
             auto &miner = m_miners.back();
             
+            miner->setJobPartition(unsigned(m_miners.size() - 1), partitions);
             miner->RetrieveHashRateDiff();
             miner->setWork(m_work);
             miner->startWorking();
@@ -146,15 +172,55 @@ void MinePlant::stop()
             std::lock_guard<std::mutex> lock(x_minerWork);
             m_miners.clear();
             m_isMining.store(false, std::memory_order_relaxed);
+            m_isSuspended.store(false, std::memory_order_relaxed);
         }
     }
 }
 
+void MinePlant::suspend()
+{
+    std::lock_guard<std::mutex> lock(x_minerWork);
+    if (!isMining() || m_isSuspended) {
+        return;
+    }
+    cnote << "Suspending miners, keeping devices and DAG resident";
+    m_isSuspended.store(true, std::memory_order_relaxed);
+    for (auto& miner : m_miners) {
+        miner->suspend();
+    }
+}
+
+void MinePlant::resume()
+{
+    std::lock_guard<std::mutex> lock(x_minerWork);
+    if (!m_isSuspended) {
+        return;
+    }
+    m_isSuspended.store(false, std::memory_order_relaxed);
+    if (!m_work) {
+        // Nothing to mine yet, the next setWork() wakes the miners
+        return;
+    }
+    cnote << "Resuming miners";
+    for (auto& miner : m_miners) {
+        miner->RetrieveHashRateDiff();
+        miner->setWork(m_work);
+    }
+}
+
+bool MinePlant::isSuspended() const
+{
+    return m_isSuspended;
+}
+
 void MinePlant::setWork(const Work& work)
 {
+    // Template is copied once here, miners only share a reference to the snapshot
+    auto snapshot = std::make_shared<const Work>(work);
+
     std::lock_guard<std::mutex> lock(x_minerWork);
     // if new work hasnt changed, then ignore
-    if (work == m_work) {
+    if (m_work && work == *m_work) {
         for (auto& miner : m_miners) {
             miner->startWorking();
         }
@@ -166,17 +232,20 @@ void MinePlant::setWork(const Work& work)
           << work.nHeight
           << " PrevHash: "
           << work.hashPrevBlock.ToString();
-    m_work = work;
+    m_work = std::move(snapshot);
+    m_isSuspended.store(false, std::memory_order_relaxed);
+    m_lastTimeRoll = std::chrono::steady_clock::now();
 
     // Propagate to all miners
     for (auto &miner: m_miners) {
         miner->RetrieveHashRateDiff();
-        miner->setWork(work);
+        miner->setWork(m_work);
     }
 }
 
 void MinePlant::resetWork()
 {
+    std::lock_guard<std::mutex> lock(x_minerWork);
     m_work.reset();
     for (auto& miner : m_miners) {
         miner->resetWork();
@@ -185,8 +254,7 @@ void MinePlant::resetWork()
 
 void MinePlant::submitProof(const Solution& solution) const
 {
-    assert(m_onSolutionFound);
-    m_onSolutionFound(solution);
+    m_solutions.push(solution);
 }
 
 void MinePlant::collectData(const boost::system::error_code& ec)
@@ -292,6 +360,18 @@ void MinePlant::collectData(const boost::system::error_code& ec)
 
     m_progress = progress;
 
+    // Keep long lived templates fresh: miners mint a job with a newer ntime and
+    // another extranonce2 locally instead of waiting for the pool
+    if (time_now - m_lastTimeRoll >= seconds(c_timeRollInterval)) {
+        std::lock_guard<std::mutex> lock(x_minerWork);
+        m_lastTimeRoll = time_now;
+        if (m_work && m_work->canRollTime() && !isSuspended()) {
+            for (auto const& miner : m_miners) {
+                miner->refreshWork();
+            }
+        }
+    }
+
     // Resubmit timer for another loop
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(m_io_strand.wrap(
@@ -328,6 +408,11 @@ SolutionStats MinePlant::getSolutionStats()
     return m_solutionStats;
 }
 
+SolutionQueueStats MinePlant::getSolutionQueueStats() const
+{
+    return m_solutions.stats();
+}
+
 void MinePlant::failedSolution()
 {
     m_solutionStats.failed();
@@ -347,12 +432,18 @@ void MinePlant::rejectedSolution()
     m_solutionStats.rejected();
 }
 
-const Work& MinePlant::getWork() const
+WorkPtr MinePlant::getWork() const
 {
     std::lock_guard<std::mutex> lock(x_minerWork);
     return m_work;
 }
 
+Miners MinePlant::getMiners() const
+{
+    std::lock_guard<std::mutex> lock(x_minerWork);
+    return m_miners;
+}
+
 std::chrono::steady_clock::time_point MinePlant::farmLaunched()
 {
     return m_farm_launched;
@@ -10,6 +10,7 @@
 
 #include "plant.h"
 #include "miner.h"
+#include "solutionqueue.h"
 #include "primitives/solution.h"
 #include <boost/asio.hpp>
 
@@ -79,6 +80,14 @@ public:
     bool start(const std::vector<EnumMinerEngine> &vMinerEngine);
     void stop();
 
+    /**
+     * @brief Parks all miners without tearing them down. Threads, device contexts
+     * and DAGs stay resident, the next setWork() or resume() restarts hashing.
+     */
+    void suspend();
+    void resume();
+    bool isSuspended() const;
+
     uint64_t getStartNonce(const Work& work, unsigned idx) const override;
     //! Temperature
     void setTStartTStop(unsigned tstart, unsigned tstop);
@@ -105,7 +114,8 @@ public:
         return m_progress;
     }
 
-    using SolutionFound = std::function<void(Solution const&)>;
+    // Returns false when the solution could not be handed to the pool and should be retried
+    using SolutionFound = std::function<bool(Solution const&)>;
     using MinerRestart = std::function<void()>;
 
     /**
@@ -115,7 +125,7 @@ public:
      */
     void onSolutionFound(const SolutionFound& handler)
     {
-        m_onSolutionFound = handler;
+        m_solutions.onSubmit(handler);
     }
     void onMinerRestart(const MinerRestart& handler)
     {
@@ -128,10 +138,13 @@ public:
 	void restart();
 	bool isMining() const;
 	SolutionStats getSolutionStats();
+	SolutionQueueStats getSolutionQueueStats() const;
 	void failedSolution() override;
 	void acceptedSolution(bool _stale);
 	void rejectedSolution();
-    const Work& getWork() const;
+    WorkPtr getWork() const;
+    //! Snapshot of the running miners
+    Miners getMiners() const;
 	std::chrono::steady_clock::time_point farmLaunched();
     std::string farmLaunchedFormatted() const;
 
@@ -141,16 +154,21 @@ private:
 
 private:
     std::chrono::steady_clock::time_point m_lastHashRate;
+    std::chrono::steady_clock::time_point m_lastTimeRoll;
+    // Seconds between local job refreshes when the work allows ntime rolling
+    static const unsigned c_timeRollInterval = 30;
     
 	mutable std::mutex                  x_minerWork;
 	Miners                              m_miners;
-	Work                                m_work;
+	WorkPtr                             m_work;
 
 	std::atomic<bool>                   m_isMining = {false};
+	std::atomic<bool>                   m_isSuspended = {false};
 
 	mutable WorkingProgress             m_progress;
 
-	SolutionFound                       m_onSolutionFound;
+	// Solutions are submitted from their own thread so miners never wait on the pool
+	mutable SolutionQueue               m_solutions;
 	MinerRestart                        m_onMinerRestart;
 
 	//std::map<std::string, SealerDescriptor> m_sealers;
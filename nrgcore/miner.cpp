@@ -77,22 +77,24 @@ bool Miner::LoadNrgHashDAG(uint64_t blockHeight)
     return true;
 }
 
-uint256 Miner::GetPOWHash(const BlockHeader& header)
+static uint256 computePOWHash(const nrghash::h256_t& headerHash, uint32_t height, uint64_t nonce, uint256& hashMix)
 {
-    energi::CBlockHeaderTruncatedLE truncatedBlockHeader(header);
-    nrghash::h256_t headerHash(&truncatedBlockHeader, sizeof(truncatedBlockHeader));
-
     nrghash::result_t ret;
-    const auto& dag = ActiveDAG();
-    if (dag && (header.nHeight / nrghash::constants::EPOCH_LENGTH) == dag->epoch()) {
-        ret = nrghash::full::hash(*dag, headerHash, header.nNonce);
+    const auto& dag = Miner::ActiveDAG();
+    if (dag && (height / nrghash::constants::EPOCH_LENGTH) == dag->epoch()) {
+        ret = nrghash::full::hash(*dag, headerHash, nonce);
     } else {
-        ret = nrghash::light::hash(nrghash::cache_t(header.nHeight), headerHash, header.nNonce);
+        ret = nrghash::light::hash(nrghash::cache_t(height), headerHash, nonce);
     }
-    const_cast<BlockHeader&>(header).hashMix = uint256(ret.mixhash);
+    hashMix = uint256(ret.mixhash);
     return uint256(ret.value);
 }
 
+uint256 Miner::GetPOWHash(Job& job)
+{
+    return computePOWHash(job.getHeaderHash(), job.nHeight, job.nNonce, job.hashMix);
+}
+
 std::unique_ptr<nrghash::dag_t> const & Miner::ActiveDAG(std::unique_ptr<nrghash::dag_t> next_dag)
 {
     using namespace std;
@@ -209,20 +211,20 @@ void Miner::clear_mining_paused(MinigPauseReason pause_reason)
     m_mining_paused.clear_mining_paused(pause_reason);
 }
 
-void Miner::setWork(const Work& work)
+void Miner::setWork(const WorkPtr& work)
 {
     {
         std::lock_guard<std::mutex> lock(work_mutex);
         
-        if (work == m_work) {
+        if (work == m_work || (work && m_work && *work == *m_work)) {
             return;
         }
         
         m_work = work;
-        m_work.updateExtraNonce();
+        m_suspended.store(false, std::memory_order_relaxed);
         m_newWorkAssigned.store(true, std::memory_order_release);
-        if (g_logVerbosity >= 6)
-            workSwitchStart = std::chrono::steady_clock::now();
+        m_switchPending = true;
+        workSwitchStart = std::chrono::steady_clock::now();
     }
 
     work_cond.notify_one();
@@ -239,9 +241,69 @@ void Miner::resetWork()
     work_cond.notify_one();
 }
 
-void Miner::updateWorkTimestamp()
+void Miner::suspend()
+{
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        m_work.reset();
+        m_suspended.store(true, std::memory_order_relaxed);
+        m_newWorkAssigned.store(true, std::memory_order_release);
+    }
+    work_cond.notify_one();
+}
+
+void Miner::refreshWork()
+{
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        if (!m_work) {
+            return;
+        }
+        m_newWorkAssigned.store(true, std::memory_order_release);
+    }
+    work_cond.notify_one();
+    kick_miner();
+}
+
+void Miner::waitMoreWork()
+{
+    std::unique_lock<std::mutex> lock(work_mutex);
+
+    if (!is_suspended()) {
+        cnote << "No work received. Waiting...";
+    }
+    // Parked here while suspended, setWork() or stopWorking() wakes us up
+    work_cond.wait(lock, [this] {
+        return m_newWorkAssigned.load(std::memory_order_acquire) || shouldStop();
+    });
+}
+
+void Miner::onStopRequested()
 {
-    static std::recursive_mutex s_rMutex;
-    std::lock_guard<std::recursive_mutex> lock(s_rMutex);
-    m_work.updateTimestamp();
+    {
+        // Taking the lock orders this wake up after a waiter checked its predicate
+        std::lock_guard<std::mutex> lock(work_mutex);
+    }
+    work_cond.notify_all();
+}
+
+Job Miner::getWork()
+{
+    WorkPtr work;
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        m_newWorkAssigned.store(false, std::memory_order_release);
+        work = m_work;
+        if (m_switchPending) {
+            using namespace std::chrono;
+            m_switchPending = false;
+            m_switchedWork = work;
+            m_switchedAt = steady_clock::now();
+            m_switchLatencyUs.store(duration_cast<microseconds>(m_switchedAt - workSwitchStart).count(),
+                    std::memory_order_release);
+            m_switchCount.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+    // The merkle root and header hash are derived outside of the lock, on the miner thread
+    return m_jobFactory.make(work);
 }
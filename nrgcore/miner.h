@@ -10,6 +10,7 @@
 
 #include "nrgcore/plant.h"
 #include "primitives/worker.h"
+#include "primitives/jobfactory.h"
 #include "nrghash/nrghash.h"
 
 #include <string>
@@ -63,22 +64,40 @@ public:
         , m_lastHeight(0)
         , m_index(index)
         , m_plant(plant)
+        , m_jobFactory(0, 1)
     {
     }
 
     virtual ~Miner() = default;
 
 public:
-    void setWork(const Work& work);
+    void setWork(const WorkPtr& work);
     void resetWork();
 
+    //! Extranonce2 partition of this miner among all miners of the plant,
+    //! set before the miner starts working
+    void setJobPartition(unsigned slot, unsigned slots)
+    {
+        m_jobFactory = JobFactory(slot, slots);
+    }
+
+    //! Drops the current work but keeps the thread, device context and DAG
+    //! resident. The next setWork() resumes mining.
+    void suspend();
+
+    //! Lets the miner mint a new job locally from its current work (fresh
+    //! extranonce2 and rolled ntime) without waiting for the pool
+    void refreshWork();
+    bool is_suspended() const
+    {
+        return m_suspended.load(std::memory_order_relaxed);
+    }
+
 
     unsigned Index() { return m_index; };
 
 	HwMonitorInfo& hwmonInfo() { return m_hwmoninfo; }
 
-    void updateWorkTimestamp();
-
 	void update_temperature(unsigned temperature);
 	bool is_mining_paused() const;
 
@@ -96,6 +115,37 @@ public:
         return diff;
     }
 
+    //! Total hashes done since the miner was created, never reset
+    uint64_t hashCount() const
+    {
+        return m_hashRateCount.load(std::memory_order_acquire);
+    }
+
+    //! Time from setWork() until the miner thread picked the job up
+    std::chrono::microseconds lastSwitchLatency() const
+    {
+        return std::chrono::microseconds(m_switchLatencyUs.load(std::memory_order_acquire));
+    }
+
+    //! Number of setWork() calls the miner thread has picked up
+    unsigned switchCount() const
+    {
+        return m_switchCount.load(std::memory_order_acquire);
+    }
+
+    //! Work the miner thread last switched to and when, null before the first switch
+    std::pair<WorkPtr, std::chrono::steady_clock::time_point> lastSwitch() const
+    {
+        std::lock_guard<std::mutex> lock(work_mutex);
+        return std::make_pair(m_switchedWork, m_switchedAt);
+    }
+
+    //! How long the last DAG build or load took, zero until one completed
+    std::chrono::milliseconds dagLoadTime() const
+    {
+        return std::chrono::milliseconds(m_dagLoadMs.load(std::memory_order_acquire));
+    }
+
     void set_mining_paused(MinigPauseReason pause_reason);
     void clear_mining_paused(MinigPauseReason pause_reason);
 
@@ -104,33 +154,32 @@ public:
     static bool LoadNrgHashDAG(uint64_t blockHeight = 0);
     static boost::filesystem::path GetDataDir();
     static void InitDAG(uint64_t blockHeight, nrghash::progress_callback_type callback);
-    static uint256 GetPOWHash(const BlockHeader& header);
+    //! nrghash of the job at its nonce, from the header hash prepared once per job
+    static uint256 GetPOWHash(Job& job);
 
     static std::unique_ptr<nrghash::dag_t> const & ActiveDAG(std::unique_ptr<nrghash::dag_t> next_dag  = std::unique_ptr<nrghash::dag_t>());
 
 protected:
-    Work getWork()
-    {
-        std::lock_guard<std::mutex> lock(work_mutex);
-        m_newWorkAssigned.store(false, std::memory_order_release);
-        return m_work;
-    }
+    Job getWork();
 
     bool haveNewWork() {
         return m_newWorkAssigned.load(std::memory_order_relaxed);
     }
 
-    void waitMoreWork() {
-        std::unique_lock<std::mutex> lock(work_mutex);
-        
-        cnote << "No work received. Waiting...";
-        work_cond.wait_for(lock, std::chrono::seconds(1));
-    }
+    void waitMoreWork();
     
     virtual void kick_miner() = 0;
 
+    void onStopRequested() override;
+
     void updateHashRate(uint64_t _n);
 
+    void setDagLoadTime(std::chrono::steady_clock::duration elapsed)
+    {
+        m_dagLoadMs.store(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(),
+                std::memory_order_release);
+    }
+
     static unsigned s_dagLoadMode;
     static unsigned s_dagLoadIndex;
     static unsigned s_dagCreateDevice;
@@ -139,6 +188,7 @@ protected:
     static bool s_noeval;
 
     std::atomic_bool     m_newWorkAssigned{false};
+    std::atomic_bool     m_suspended{false};
     bool     m_dagLoaded = false;
     uint64_t m_lastHeight;
 
@@ -148,16 +198,25 @@ protected:
 	HwMonitorInfo m_hwmoninfo;
 
 protected:
-    Work m_current;
+    Job m_current;
 
 private:
-    Work m_work;
+    WorkPtr  m_work;
+    // Only used from the miner thread in getWork()
+    JobFactory m_jobFactory;
     MiningPause m_mining_paused;
-	std::mutex work_mutex;
+	mutable std::mutex work_mutex;
     std::condition_variable work_cond;
 
     std::atomic<std::uint64_t> m_hashRateCount{0};
     uint64_t m_hashRateLast{0};
+
+    bool m_switchPending = false;
+    WorkPtr m_switchedWork;
+    std::chrono::steady_clock::time_point m_switchedAt;
+    std::atomic<int64_t>  m_switchLatencyUs{0};
+    std::atomic<unsigned> m_switchCount{0};
+    std::atomic<int64_t>  m_dagLoadMs{0};
 };
 
 using MinerPtr = std::shared_ptr<energi::Miner>;
@@ -0,0 +1,139 @@
+#include "solutionqueue.h"
+
+#include "common/Log.h"
+
+#include <algorithm>
+
+using namespace energi;
+
+SolutionQueue::SolutionQueue(size_t capacity)
+    : Worker("submit")
+    , m_capacity(capacity)
+{
+}
+
+SolutionQueue::~SolutionQueue()
+{
+    stopWorking();
+}
+
+bool SolutionQueue::remember(const Key& key)
+{
+    if (!m_seen.insert(key).second) {
+        return false;
+    }
+    m_seenOrder.push_back(key);
+    if (m_seenOrder.size() > m_capacity * 4) {
+        m_seen.erase(m_seenOrder.front());
+        m_seenOrder.pop_front();
+    }
+    return true;
+}
+
+bool SolutionQueue::push(const Solution& solution)
+{
+    const auto& job = solution.getJob();
+    Key key(uint256(job.getHeaderHash()), job.getNonce());
+    {
+        std::lock_guard<std::mutex> lock(x_queue);
+        if (m_queue.size() >= m_capacity) {
+            ++m_stats.overflows;
+            cwarn << "Solution queue full, dropping nonce " << job.getNonce();
+            return false;
+        }
+        if (!remember(key)) {
+            ++m_stats.duplicates;
+            return false;
+        }
+        const auto now = Clock::now();
+        Entry entry;
+        entry.solution = solution;
+        entry.found = now;
+        entry.due = now;
+        entry.attempts = 0;
+        m_queue.push_back(std::move(entry));
+    }
+    m_cv.notify_one();
+    return true;
+}
+
+SolutionQueueStats SolutionQueue::stats() const
+{
+    std::lock_guard<std::mutex> lock(x_queue);
+    return m_stats;
+}
+
+void SolutionQueue::onStopRequested()
+{
+    {
+        std::lock_guard<std::mutex> lock(x_queue);
+    }
+    m_cv.notify_all();
+}
+
+void SolutionQueue::trun()
+{
+    using namespace std::chrono;
+
+    while (!shouldStop()) {
+        Entry entry;
+        Submit onSubmit;
+        IsStale isStale;
+        {
+            std::unique_lock<std::mutex> lock(x_queue);
+            if (m_queue.empty()) {
+                m_cv.wait(lock, [this] { return !m_queue.empty() || shouldStop(); });
+                continue;
+            }
+            // Fresh solutions must not wait behind one that is backing off
+            const auto now = Clock::now();
+            auto it = std::find_if(m_queue.begin(), m_queue.end(),
+                    [&now](const Entry& e) { return e.due <= now; });
+            if (it == m_queue.end()) {
+                auto next = std::min_element(m_queue.begin(), m_queue.end(),
+                        [](const Entry& a, const Entry& b) { return a.due < b.due; });
+                m_cv.wait_until(lock, next->due);
+                continue;
+            }
+            entry = std::move(*it);
+            m_queue.erase(it);
+            // Called without the lock, a handler may push or be replaced meanwhile
+            onSubmit = m_onSubmit;
+            isStale = m_isStale;
+        }
+
+        if (isStale && isStale(entry.solution)) {
+            std::lock_guard<std::mutex> lock(x_queue);
+            ++m_stats.stale;
+            cnote << "Dropping stale solution, nonce " << entry.solution.getJob().getNonce();
+            continue;
+        }
+
+        bool delivered = true;
+        try {
+            delivered = !onSubmit || onSubmit(entry.solution);
+        } catch (const std::exception& ex) {
+            cwarn << "Failed to submit solution: " << ex.what();
+            delivered = false;
+        }
+
+        std::lock_guard<std::mutex> lock(x_queue);
+        if (delivered) {
+            auto elapsed = duration_cast<microseconds>(Clock::now() - entry.found);
+            ++m_stats.submitted;
+            m_stats.lastTimeToSubmit = elapsed;
+            m_stats.maxTimeToSubmit = std::max(m_stats.maxTimeToSubmit, elapsed);
+            if (g_logVerbosity >= 6) {
+                cnote << "Solution submitted " << elapsed.count() << " us after it was found";
+            }
+        } else if (++entry.attempts >= c_maxAttempts) {
+            ++m_stats.failed;
+            cwarn << "Giving up on nonce " << entry.solution.getJob().getNonce()
+                  << " after " << entry.attempts << " attempts";
+        } else {
+            ++m_stats.retried;
+            entry.due = Clock::now() + milliseconds(c_retryDelayMs << (entry.attempts - 1));
+            m_queue.push_back(std::move(entry));
+        }
+    }
+}
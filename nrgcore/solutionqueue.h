@@ -0,0 +1,103 @@
+#pragma once
+
+#include "primitives/solution.h"
+#include "primitives/worker.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <utility>
+
+namespace energi {
+
+struct SolutionQueueStats
+{
+    unsigned submitted  = 0;
+    unsigned retried    = 0;
+    unsigned duplicates = 0;
+    unsigned stale      = 0;
+    unsigned overflows  = 0;
+    unsigned failed     = 0;
+
+    std::chrono::microseconds lastTimeToSubmit{0};
+    std::chrono::microseconds maxTimeToSubmit{0};
+};
+
+/**
+ * @brief Bounded multi producer / single consumer queue between miners and the pool client.
+ *
+ * Miners push() found solutions and go back to hashing straight away. A dedicated
+ * thread hands them to the submit handler, skipping duplicates and solutions whose
+ * job was superseded, and retries with exponential backoff when the handler reports
+ * it could not deliver.
+ */
+class SolutionQueue : public Worker
+{
+public:
+    // Returns false when the solution could not be delivered and should be retried
+    using Submit = std::function<bool(const Solution&)>;
+    // Returns true when the solution belongs to a job that was superseded
+    using IsStale = std::function<bool(const Solution&)>;
+
+    static const size_t   c_defaultCapacity = 64;
+    static const unsigned c_maxAttempts = 5;
+    static const unsigned c_retryDelayMs = 250;
+
+    explicit SolutionQueue(size_t capacity = c_defaultCapacity);
+    ~SolutionQueue();
+
+    //! Handlers may be replaced while the queue runs
+    void onSubmit(const Submit& handler)
+    {
+        std::lock_guard<std::mutex> lock(x_queue);
+        m_onSubmit = handler;
+    }
+
+    void onIsStale(const IsStale& handler)
+    {
+        std::lock_guard<std::mutex> lock(x_queue);
+        m_isStale = handler;
+    }
+
+    //! Called from miner threads, never blocks on the network
+    bool push(const Solution& solution);
+
+    SolutionQueueStats stats() const;
+
+protected:
+    void trun() override;
+    void onStopRequested() override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    // Prepared header hash + nonce, unique per job, extranonce, ntime and nonce
+    using Key = std::pair<uint256, uint64_t>;
+
+    struct Entry
+    {
+        Solution          solution;
+        Clock::time_point found;
+        Clock::time_point due;
+        unsigned          attempts = 0;
+    };
+
+    bool remember(const Key& key);
+
+    const size_t            m_capacity;
+    mutable std::mutex      x_queue;
+    std::condition_variable m_cv;
+    std::deque<Entry>       m_queue;
+
+    // Recently seen keys, bounded so it does not grow for the lifetime of the miner
+    std::set<Key>           m_seen;
+    std::deque<Key>         m_seenOrder;
+
+    SolutionQueueStats      m_stats;
+    Submit                  m_onSubmit;
+    IsStale                 m_isStale;
+};
+
+} //! namespace energi
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "nrghash.h"
+#include "common/utilstrencodings.h"
 extern "C"
 {
 #include "keccak-tiny.h"
@@ -217,15 +218,11 @@ namespace
 
 		operator ::std::string() const
 		{
-			// TODO: fast hex conversion
-			::std::stringstream ss;
-			ss << ::std::hex;
-			uint8_t const * iEnd = reinterpret_cast<uint8_t const *>(&data.back());
-			for (uint8_t const * i = reinterpret_cast<uint8_t const *>(data.data()); i != iEnd; i++)
-			{
-				ss << ::std::setw(2) << ::std::setfill('0') << static_cast<uint16_t>(*i);
-			}
-			return ss.str();
+			// the last node is left out, as it always was
+			const size_t size = (data.size() - 1) * sizeof(node);
+			::std::string hex(size * 2, '\0');
+			EncodeHex(&hex[0], reinterpret_cast<uint8_t const *>(data.data()), size);
+			return hex;
 		}
 	};
 
@@ -320,15 +317,9 @@ namespace nrghash
 
 	::std::string h256_t::to_hex() const
 	{
-		// TODO: fast hex conversion
-		::std::stringstream ss;
-		ss << ::std::hex << ::std::nouppercase;
-		uint8_t const * iEnd = reinterpret_cast<uint8_t const *>(&b[hash_size]);
-		for (uint8_t const * i = reinterpret_cast<uint8_t const *>(&b[0]); i != iEnd; i++)
-		{
-			ss << ::std::setw(2) << ::std::setfill('0') << static_cast<uint16_t>(*i);
-		}
-		return ss.str();
+		::std::string hex(sizeof(b) * 2, '\0');
+		EncodeHex(&hex[0], reinterpret_cast<uint8_t const *>(&b[0]), sizeof(b));
+		return hex;
 	}
 
 	h256_t::operator bool() const
@@ -354,15 +345,9 @@ namespace nrghash
 
 	::std::string h512_t::to_hex() const
 	{
-		// TODO: fast hex conversion
-		::std::stringstream ss;
-		ss << ::std::hex << ::std::nouppercase;
-		uint8_t const * iEnd = reinterpret_cast<uint8_t const *>(&b[hash_size]);
-		for (uint8_t const * i = reinterpret_cast<uint8_t const *>(&b[0]); i != iEnd; i++)
-		{
-			ss << ::std::setw(2) << ::std::setfill('0') << static_cast<uint16_t>(*i);
-		}
-		return ss.str();
+		::std::string hex(sizeof(b) * 2, '\0');
+		EncodeHex(&hex[0], reinterpret_cast<uint8_t const *>(&b[0]), sizeof(b));
+		return hex;
 	}
 
 	h512_t::operator bool() const
@@ -4,13 +4,14 @@
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
+#include <type_traits>
 
 #include "transaction.h"
 #include "common/utilstrencodings.h"
 #include "common/serialize.h"
 #include "uint256.h"
-#include "extranoncesingleton.h"
 
 namespace energi {
 
@@ -100,9 +101,100 @@ struct BlockHeader
     }
 };
 
+//! Characters of a string owned elsewhere, e.g. the buffer a message was received in
+struct TextRef
+{
+    const char* data = nullptr;
+    size_t      size = 0;
+
+    TextRef() = default;
+    TextRef(const char* d, size_t s)
+        : data(d)
+        , size(s)
+    {}
+
+    bool empty() const
+    {
+        return size == 0;
+    }
+
+    bool operator==(const char* text) const
+    {
+        return std::strlen(text) == size && std::memcmp(data, text, size) == 0;
+    }
+
+    std::string str() const
+    {
+        return std::string(data, size);
+    }
+};
+
+//! Fields of a stratum mining.notify, referring to the message they were read from
+struct StratumJobView
+{
+    TextRef jobName;
+    TextRef prevHash;
+    TextRef coinbase1;
+    TextRef coinbase2;
+    std::vector<TextRef> transactions; // hex of every transaction after the coinbase
+    TextRef version;
+    TextRef bits;
+    TextRef time;
+    bool clean = false;
+    uint32_t height = 0;
+
+    StratumJobView() = default;
+
+    //! Views into the strings of a parsed notify, which must outlive it
+    explicit StratumJobView(const Json::Value& params)
+    {
+        jobName = text(params[Json::Value::ArrayIndex(0)]);
+        prevHash = text(params[Json::Value::ArrayIndex(1)]);
+        coinbase1 = text(params[Json::Value::ArrayIndex(2)]);
+        coinbase2 = text(params[Json::Value::ArrayIndex(3)]);
+        for (const auto& branch : params[Json::Value::ArrayIndex(4)]) {
+            transactions.push_back(text(branch["data"]));
+        }
+        version = text(params[Json::Value::ArrayIndex(5)]);
+        bits = text(params[Json::Value::ArrayIndex(6)]);
+        time = text(params[Json::Value::ArrayIndex(7)]);
+        clean = params[Json::Value::ArrayIndex(8)].asBool();
+        height = params[Json::Value::ArrayIndex(9)].asUInt();
+    }
+
+    void clear()
+    {
+        jobName = prevHash = coinbase1 = coinbase2 = version = bits = time = TextRef();
+        transactions.clear(); // keeps the capacity for the next job
+        clean = false;
+        height = 0;
+    }
+
+private:
+    static TextRef text(const Json::Value& value)
+    {
+        if (!value.isString()) {
+            return TextRef();
+        }
+        const char* data = value.asCString();
+        return TextRef(data, std::strlen(data));
+    }
+};
+
+//! Transactions of a getblocktemplate result read apart from the rest of it, see TemplateParser
+struct TemplateTransactions
+{
+    std::vector<RawTransaction> transactions;
+    std::shared_ptr<const std::string> hex; // all of them, as the node sent them
+};
+
 struct Block : public BlockHeader
 {
-    std::vector<CTransaction> vtx;
+    CTransaction txCoinbase;            // the only transaction decoded, miners rewrite it
+    std::vector<RawTransaction> vtxRaw; // the ones after it, as the pool or node sent them
+    // vtxRaw as hex, the tail of every submitblock for this template. Set for
+    // getblocktemplate work only, shared between copies like vtxRaw.
+    std::shared_ptr<const std::string> vtxRawHex;
 
     CTxOut txoutBackbone; // Energibackbone payment
     CTxOut txoutMasternode; // masternode payment
@@ -118,40 +210,64 @@ struct Block : public BlockHeader
 
     Block(const Json::Value& jPrm,
           const std::string& extraNonce, bool)
+        : Block(StratumJobView(jPrm), extraNonce)
+    {}
+
+    Block(const StratumJobView& job, const std::string& extraNonce)
     {
-        hashPrevBlock = uint256S(jPrm.get((Json::Value::ArrayIndex)1, "").asString());
+        // The hex ends at the closing quote or terminator following the text
+        hashPrevBlock = job.prevHash.empty() ? uint256() : uint256S(job.prevHash.data);
         hashMerkleRoot.SetNull();
-        nVersion = std::stoul(jPrm.get((Json::Value::ArrayIndex)5, "").asString(), 0, 16);
-        nTime = std::stoul(jPrm.get((Json::Value::ArrayIndex)7, "").asString(), 0, 16);
-        nBits = std::stoul(jPrm.get((Json::Value::ArrayIndex)6, "").asString(), 0, 16);
+        nVersion = hexField(job.version);
+        nTime = hexField(job.time);
+        nBits = hexField(job.bits);
         hashMix.SetNull();
         nNonce = 0;
-        nHeight = jPrm.get((Json::Value::ArrayIndex)9, "").asUInt();
-
-        stratum_coinbase1 = jPrm.get((Json::Value::ArrayIndex)2, "").asString();
-        stratum_coinbase2 = jPrm.get((Json::Value::ArrayIndex)3, "").asString();
-        std::string hexData = stratum_coinbase1 + extraNonce + extraNonce + stratum_coinbase2;
-        CTransaction coinbaseTx;
-        DecodeHexTx(coinbaseTx, hexData);
-
-        vtx.push_back(coinbaseTx);
-        vtx[0].UpdateHash();
-        const auto merkleBranches = jPrm.get((Json::Value::ArrayIndex)4, "");
-        for (const auto branch : merkleBranches) {
-            CTransaction trans;
-            DecodeHexTx(trans, branch["data"].asString());
-            vtx.push_back(trans);
+        nHeight = job.height;
+
+        stratum_coinbase1 = job.coinbase1.str();
+        stratum_coinbase2 = job.coinbase2.str();
+        // extranonce1 stands in for extranonce2 until a miner picks its own
+        std::vector<unsigned char> raw;
+        raw.reserve((job.coinbase1.size + job.coinbase2.size) / 2 + extraNonce.size());
+        if (!AppendHex(raw, job.coinbase1.data, job.coinbase1.size) ||
+                !AppendHex(raw, extraNonce.data(), extraNonce.size()) ||
+                !AppendHex(raw, extraNonce.data(), extraNonce.size()) ||
+                !AppendHex(raw, job.coinbase2.data, job.coinbase2.size) ||
+                !DecodeRawTx(txCoinbase, raw)) {
+            throw WorkException("Cannot decode stratum coinbase");
+        }
+
+        vtxRaw.resize(job.transactions.size());
+        for (size_t i = 0; i < job.transactions.size(); ++i) {
+            if (!DecodeHexRawTx(vtxRaw[i], job.transactions[i].data, job.transactions[i].size)) {
+                throw WorkException("Malformed stratum job transaction");
+            }
         }
     }
 
+    //! cache, when given, supplies the transactions the previous template had
     Block(const Json::Value& gbt,
+          const std::string& coinbaseAddress, RawTransactionCache* cache = nullptr)
+        : BlockHeader(gbt)
+    {
+        if ( !( gbt.isMember("height") && gbt.isMember("version") && gbt.isMember("previousblockhash") ) ) {
+            throw WorkException("Height or Version or Previous Block Hash not found");
+        }
+        fillTransactions(gbt, coinbaseAddress, cache);
+    }
+
+    //! gbt without its transaction list, which was read into transactions
+    Block(const Json::Value& gbt, TemplateTransactions&& transactions,
           const std::string& coinbaseAddress)
         : BlockHeader(gbt)
     {
         if ( !( gbt.isMember("height") && gbt.isMember("version") && gbt.isMember("previousblockhash") ) ) {
             throw WorkException("Height or Version or Previous Block Hash not found");
         }
-        fillTransactions(gbt, coinbaseAddress);
+        fillCoinbase(gbt, coinbaseAddress);
+        vtxRaw = std::move(transactions.transactions);
+        vtxRawHex = transactions.hex ? std::move(transactions.hex) : std::make_shared<const std::string>();
     }
 
     Block(const BlockHeader& header)
@@ -160,8 +276,63 @@ struct Block : public BlockHeader
         *((BlockHeader*)this) = header;
     }
 
+    //! Big endian hex number of at most 8 digits as sent in a stratum job
+    static uint32_t hexField(const TextRef& ref)
+    {
+        if (ref.empty() || ref.size > 8) {
+            throw WorkException("Malformed stratum job field");
+        }
+        uint32_t value = 0;
+        for (size_t i = 0; i < ref.size; ++i) {
+            signed char digit = HexDigit(ref.data[i]);
+            if (digit < 0) {
+                throw WorkException("Malformed stratum job field");
+            }
+            value = (value << 4) | uint32_t(digit);
+        }
+        return value;
+    }
+
     void fillTransactions(const Json::Value& gbt,
-                          const std::string& coinbaseAddress)
+                          const std::string& coinbaseAddress, RawTransactionCache* cache = nullptr)
+    {
+        fillCoinbase(gbt, coinbaseAddress);
+
+        const auto& transactions = gbt["transactions"];
+        vtxRaw.resize(transactions.size());
+        // Encoded now, so a found block needs only its header and coinbase in hex
+        auto hex = std::make_shared<std::string>();
+        if (cache) {
+            cache->begin();
+        }
+        for (Json::Value::ArrayIndex i = 0; i < transactions.size(); ++i) {
+            const Json::Value& txn = transactions[i];
+            // "hash" is the witness hash on segwit nodes, only "txid" is taken as is
+            const Json::Value& txid = txn["txid"];
+            const uint256 knownTxid = txid.isString() ? uint256S(txid.asString()) : uint256();
+            const char* data = txn["data"].isString() ? txn["data"].asCString() : "";
+            const size_t size = std::strlen(data);
+            bool decoded;
+            if (cache) {
+                // Either hash names the transaction well enough to find it again
+                const Json::Value& id = txid.isString() ? txid : txn["hash"];
+                decoded = cache->decode(vtxRaw[i], data, size,
+                                        id.isString() ? uint256S(id.asString()) : uint256(), knownTxid);
+            } else {
+                decoded = DecodeHexRawTx(vtxRaw[i], data, size, knownTxid);
+            }
+            if (!decoded) {
+                throw WorkException("Malformed template transaction");
+            }
+            hex->append(data, size);
+        }
+        if (cache) {
+            cache->sweep();
+        }
+        vtxRawHex = std::move(hex);
+    }
+
+    void fillCoinbase(const Json::Value& gbt, const std::string& coinbaseAddress)
     {
         if (coinbaseAddress.empty()) {
             std::cerr << "Empty coinbase address" << std::endl;
@@ -224,15 +395,8 @@ struct Block : public BlockHeader
             }
             //! end Backbone transaction
 
-            vtx.push_back(coinbaseTransaction);
-            vtx[0].UpdateHash();
-
-            auto transactions = gbt["transactions"];
-            for (const auto& txn : transactions) {
-                CTransaction trans;
-                DecodeHexTx(trans, txn["data"].asString());
-                vtx.push_back(trans);
-            }
+            txCoinbase = coinbaseTransaction;
+            txCoinbase.UpdateHash();
         }
     }
 
@@ -256,14 +420,24 @@ struct Block : public BlockHeader
     template<typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
+        // Blocks are only written out for submitblock, the raw transactions
+        // keep no lengths to read them back with
+        static_assert(std::is_same<Operation, CSerActionSerialize>::value,
+                      "Block cannot be deserialized");
         READWRITE(*(BlockHeader*)this);
-        READWRITE(vtx);
+        WriteCompactSize(s, vtxRaw.size() + 1);
+        READWRITE(txCoinbase);
+        for (const auto& tx : vtxRaw) {
+            READWRITE(tx);
+        }
     }
 
     void SetNull()
     {
         BlockHeader::SetNull();
-        vtx.clear();
+        txCoinbase = CTransaction();
+        vtxRaw.clear();
+        vtxRawHex.reset();
         txoutBackbone = CTxOut();
         txoutMasternode = CTxOut();
         voutSuperblock.clear();
@@ -289,11 +463,8 @@ struct CBlockHeaderTruncatedLE
         , nBits(htole32(header.nBits))
         , nHeight(htole32(header.nHeight))
     {
-        auto prevHash = header.hashPrevBlock.ToString();
-        memcpy(hashPrevBlock, prevHash.c_str(), (std::min)(prevHash.size(), sizeof(hashPrevBlock)));
-
-        auto merkleRoot = header.hashMerkleRoot.ToString();
-        memcpy(hashMerkleRoot, merkleRoot.c_str(), (std::min)(merkleRoot.size(), sizeof(hashMerkleRoot)));
+        header.hashPrevBlock.WriteHex(hashPrevBlock);
+        header.hashMerkleRoot.WriteHex(hashMerkleRoot);
     }
 };
 
@@ -309,8 +480,7 @@ struct CBlockHeaderFullLE : public CBlockHeaderTruncatedLE
         , nNonce(h.nNonce)
         , hashMix{0}
     {
-        auto mixString = h.hashMix.ToString();
-        memcpy(hashMix, mixString.c_str(), (std::min)(mixString.size(), sizeof(hashMix)));
+        h.hashMix.WriteHex(hashMix);
     }
 };
 static_assert(sizeof(CBlockHeaderFullLE) == 219, "CBlockHeaderFullLE has incorrect size");
@@ -0,0 +1,41 @@
+#include "job.h"
+
+namespace energi {
+
+Job::Job(const WorkPtr& work, uint32_t extraNonce2)
+    : Job(work, extraNonce2, work ? work->nTime : 0)
+{
+}
+
+Job::Job(const WorkPtr& work, uint32_t extraNonce2, uint32_t time)
+    : BlockHeader()
+    , m_work(work)
+    , m_extraNonce2(extraNonce2)
+{
+    if (!isValid()) {
+        return;
+    }
+    *static_cast<BlockHeader*>(this) = *m_work;
+    nTime = time;
+    hashMerkleRoot = m_work->merkleRoot(m_extraNonce2);
+    prepare();
+}
+
+std::vector<unsigned char> Job::getCoinbase() const
+{
+    return getWork().serializeCoinbase(m_extraNonce2);
+}
+
+void Job::prepare()
+{
+    CBlockHeaderTruncatedLE truncatedBlockHeader(*this);
+    m_headerHash = nrghash::h256_t(&truncatedBlockHeader, sizeof(truncatedBlockHeader));
+}
+
+const Work& Job::getWork() const
+{
+    static const Work s_empty;
+    return m_work ? *m_work : s_empty;
+}
+
+} //! namespace energi
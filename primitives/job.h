@@ -0,0 +1,100 @@
+#pragma once
+
+#include "work.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace energi
+{
+
+// Work snapshots are immutable once published by the plant. Every miner holds a
+// reference to the same snapshot, so a job switch only swaps a pointer no matter
+// how big the block template is.
+using WorkPtr = std::shared_ptr<const Work>;
+
+// Job is the miner local view of a shared work snapshot.
+// It carries the header being hashed and this miner's extranonce2. Everything
+// else (coinbase template, transactions, payouts, target) is read from the
+// shared snapshot.
+struct Job : public BlockHeader
+{
+    Job()
+        : BlockHeader()
+    {}
+
+    Job(const WorkPtr& work, uint32_t extraNonce2);
+    //! Same as above with the header time rolled to nTime
+    Job(const WorkPtr& work, uint32_t extraNonce2, uint32_t nTime);
+
+    bool isValid() const
+    {
+        return m_work && m_work->isValid();
+    }
+
+    void reset()
+    {
+        SetNull();
+        m_work.reset();
+        m_extraNonce2 = 0;
+        m_headerHash = nrghash::h256_t();
+    }
+
+    //! Recomputes the nonce independent header hash. Call it whenever a header
+    //! field other than nNonce or hashMix changes.
+    void prepare();
+
+    //! Keccak-256 of the truncated header, the input of every nrghash round
+    inline const nrghash::h256_t& getHeaderHash() const
+    {
+        return m_headerHash;
+    }
+
+    const Work& getWork() const;
+
+    const WorkPtr& getWorkPtr() const
+    {
+        return m_work;
+    }
+
+    inline const std::string& getJobName() const
+    {
+        return getWork().getJobName();
+    }
+
+    inline const arith_uint256& getTarget() const
+    {
+        return getWork().hashTarget;
+    }
+
+    inline uint64_t getBoundary() const
+    {
+        return getWork().boundary;
+    }
+
+    inline uint32_t getEpoch() const
+    {
+        return getWork().epoch;
+    }
+
+    //! Serialized coinbase, only materialized when a solution is submitted
+    std::vector<unsigned char> getCoinbase() const;
+
+    inline uint32_t getExtraNonce2Value() const
+    {
+        return m_extraNonce2;
+    }
+
+    inline std::string getExtraNonce2() const
+    {
+        return HexStrMemory(m_extraNonce2);
+    }
+
+private:
+    WorkPtr        m_work;
+    uint32_t       m_extraNonce2 = 0;
+    nrghash::h256_t m_headerHash;
+};
+
+} /* namespace energi */
@@ -0,0 +1,39 @@
+#include "jobfactory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <random>
+
+namespace energi {
+
+JobFactory::JobFactory(unsigned index, unsigned partitions)
+{
+    if (partitions == 0 || (partitions & (partitions - 1)) != 0 || index >= partitions) {
+        throw WorkException("Invalid extranonce partition");
+    }
+    const uint64_t size = (uint64_t(1) << 32) / partitions;
+    m_size = static_cast<uint32_t>(size - 1) + 1;
+    m_begin = static_cast<uint32_t>(size * index);
+
+    std::random_device device;
+    m_counter = std::uniform_int_distribution<uint32_t>()(device);
+}
+
+uint32_t JobFactory::nextExtraNonce()
+{
+    // m_size is a power of two (0 meaning the whole 32 bit space)
+    return m_begin + (m_counter++ & (m_size - 1));
+}
+
+Job JobFactory::make(const WorkPtr& work)
+{
+    const uint32_t extraNonce2 = nextExtraNonce();
+    if (!work || !work->canRollTime()) {
+        return Job(work, extraNonce2);
+    }
+    const uint32_t now = static_cast<uint32_t>(std::time(nullptr));
+    return Job(work, extraNonce2, std::min(std::max(now, work->nTime), work->maxTime));
+}
+
+} //! namespace energi
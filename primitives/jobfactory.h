@@ -0,0 +1,53 @@
+#pragma once
+
+#include "job.h"
+
+#include <cstdint>
+
+namespace energi
+{
+
+/**
+ * @brief Mints miner local jobs from a shared work snapshot.
+ *
+ * The extranonce2 space is split into equal partitions, one per miner of the
+ * plant across all engines, so two miners can never produce the same coinbase.
+ * Inside its partition a factory counts up from a random offset, which keeps
+ * separate rigs mining to the same address apart as well. When the template allows it the header time is rolled
+ * forward to the current time. Each factory is owned by a single miner thread
+ * and needs no locking.
+ */
+class JobFactory
+{
+public:
+    /**
+     * @brief Constructor
+     * @param index      miner index within the plant, selects the extranonce2 partition
+     * @param partitions number of partitions, a power of two no smaller than the miner count
+     **/
+    JobFactory(unsigned index, unsigned partitions);
+
+    /**
+     * @brief Builds a job with a fresh extranonce2 and the newest allowed time
+     **/
+    Job make(const WorkPtr& work);
+
+    uint32_t partitionBegin() const
+    {
+        return m_begin;
+    }
+
+    uint32_t partitionSize() const
+    {
+        return m_size;
+    }
+
+private:
+    uint32_t nextExtraNonce();
+
+    uint32_t m_begin;
+    uint32_t m_size;
+    uint32_t m_counter;
+};
+
+} /* namespace energi */
@@ -2,6 +2,9 @@
 #include "hash.h"
 #include "common/utilstrencodings.h"
 
+#include <algorithm>
+#include <string.h>
+
 using namespace energi;
 
 /*     WARNING! If you're reading this because you're learning about crypto
@@ -40,114 +43,57 @@ using namespace energi;
        root.
 */
 
-/* This implements a constant-space merkle root/path calculator, limited to 2^32 leaves. */
-static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot, bool* pmutated, uint32_t branchpos, std::vector<uint256>* pbranch) {
-    if (pbranch) pbranch->clear();
-    if (leaves.size() == 0) {
-        if (pmutated) *pmutated = false;
-        if (proot) *proot = uint256();
-        return;
-    }
-    bool mutated = false;
-    // count is the number of leaves processed so far.
-    uint32_t count = 0;
-    // inner is an array of eagerly computed subtree hashes, indexed by tree
-    // level (0 being the leaves).
-    // For example, when count is 25 (11001 in binary), inner[4] is the hash of
-    // the first 16 leaves, inner[3] of the next 8 leaves, and inner[0] equal to
-    // the last leaf. The other inner entries are undefined.
-    uint256 inner[32];
-    // Which position in inner is a hash that depends on the matching leaf.
-    int matchlevel = -1;
-    // First process all leaves into 'inner' values.
-    while (count < leaves.size()) {
-        uint256 h = leaves[count];
-        bool matchh = count == branchpos;
-        count++;
-        int level;
-        // For each of the lower bits in count that are 0, do 1 step. Each
-        // corresponds to an inner value that existed before processing the
-        // current leaf, and each needs a hash to combine it.
-        for (level = 0; !(count & (((uint32_t)1) << level)); level++) {
-            if (pbranch) {
-                if (matchh) {
-                    pbranch->push_back(inner[level]);
-                } else if (matchlevel == level) {
-                    pbranch->push_back(h);
-                    matchh = true;
-                }
+uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated) {
+    bool mutation = false;
+    std::vector<uint256> hashes(leaves);
+    while (hashes.size() > 1) {
+        if (mutated) {
+            for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
+                if (hashes[pos] == hashes[pos + 1]) mutation = true;
             }
-            mutated |= (inner[level] == h);
-            CHash256().Write(inner[level].begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
         }
-        // Store the resulting hash at inner position level.
-        inner[level] = h;
-        if (matchh) {
-            matchlevel = level;
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
         }
+        // Each pair is one 64-byte block, a whole level is hashed in one go
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
     }
-    // Do a final 'sweep' over the rightmost branch of the tree to process
-    // odd levels, and reduce everything to a single top value.
-    // Level is the level (counted from the bottom) up to which we've sweeped.
-    int level = 0;
-    // As long as bit number level in count is zero, skip it. It means there
-    // is nothing left at this level.
-    while (!(count & (((uint32_t)1) << level))) {
-        level++;
-    }
-    uint256 h = inner[level];
-    bool matchh = matchlevel == level;
-    while (count != (((uint32_t)1) << level)) {
-        // If we reach this point, h is an inner value that is not the top.
-        // We combine it with itself (Bitcoin's special rule for odd levels in
-        // the tree) to produce a higher level one.
-        if (pbranch && matchh) {
-            pbranch->push_back(h);
-        }
-        CHash256().Write(h.begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
-        // Increment count to the value it would have if two entries at this
-        // level had existed.
-        count += (((uint32_t)1) << level);
-        level++;
-        // And propagate the result upwards accordingly.
-        while (!(count & (((uint32_t)1) << level))) {
-            if (pbranch) {
-                if (matchh) {
-                    pbranch->push_back(inner[level]);
-                } else if (matchlevel == level) {
-                    pbranch->push_back(h);
-                    matchh = true;
-                }
-            }
-            CHash256().Write(inner[level].begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
-            level++;
-        }
-    }
-    // Return result.
-    if (pmutated) *pmutated = mutated;
-    if (proot) *proot = h;
-}
-
-uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated) {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, NULL);
-    return hash;
+    if (mutated) *mutated = mutation;
+    if (hashes.size() == 0) return uint256();
+    return hashes[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position) {
     std::vector<uint256> ret;
-    MerkleComputation(leaves, NULL, NULL, position, &ret);
+    if (position >= leaves.size()) {
+        return ret;
+    }
+    std::vector<uint256> hashes(leaves);
+    while (hashes.size() > 1) {
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        ret.push_back(hashes[position ^ 1]);
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+        position >>= 1;
+    }
     return ret;
 }
 
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& vMerkleBranch, uint32_t nIndex) {
     uint256 hash = leaf;
+    unsigned char pair[64];
     for (std::vector<uint256>::const_iterator it = vMerkleBranch.begin(); it != vMerkleBranch.end(); ++it) {
         if (nIndex & 1) {
-            hash = Hash(BEGIN(*it), END(*it), BEGIN(hash), END(hash));
+            memcpy(pair, it->begin(), 32);
+            memcpy(pair + 32, hash.begin(), 32);
         } else {
-            hash = Hash(BEGIN(hash), END(hash), BEGIN(*it), END(*it));
+            memcpy(pair, hash.begin(), 32);
+            memcpy(pair + 32, it->begin(), 32);
         }
+        SHA256D64(hash.begin(), pair, 1);
         nIndex >>= 1;
     }
     return hash;
@@ -156,9 +102,10 @@ uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint2
 uint256 BlockMerkleRoot(const Block& block, bool* mutated)
 {
     std::vector<uint256> leaves;
-    leaves.resize(block.vtx.size());
-    for (size_t s = 0; s < block.vtx.size(); s++) {
-        leaves[s] = block.vtx[s].GetHash();
+    leaves.resize(block.vtxRaw.size() + 1);
+    leaves[0] = block.txCoinbase.GetHash();
+    for (size_t s = 0; s < block.vtxRaw.size(); s++) {
+        leaves[s + 1] = block.vtxRaw[s].GetHash();
     }
     return ComputeMerkleRoot(leaves, mutated);
 }
@@ -166,9 +113,81 @@ uint256 BlockMerkleRoot(const Block& block, bool* mutated)
 std::vector<uint256> BlockMerkleBranch(const Block& block, uint32_t position)
 {
     std::vector<uint256> leaves;
-    leaves.resize(block.vtx.size());
-    for (size_t s = 0; s < block.vtx.size(); s++) {
-        leaves[s] = block.vtx[s].GetHash();
+    leaves.resize(block.vtxRaw.size() + 1);
+    leaves[0] = block.txCoinbase.GetHash();
+    for (size_t s = 0; s < block.vtxRaw.size(); s++) {
+        leaves[s + 1] = block.vtxRaw[s].GetHash();
     }
     return ComputeMerkleBranch(leaves, position);
 }
+
+std::vector<uint256> MerkleCache::update(std::vector<uint256>&& leaves)
+{
+    nHashed = 0;
+    nReused = 0;
+    std::vector<uint256> branch;
+    std::vector<uint256> level = std::move(leaves);
+    std::vector<bool> changed;
+    size_t depth = 0;
+    while (true) {
+        static const std::vector<uint256> none;
+        const std::vector<uint256>& old = depth < levels.size() ? levels[depth] : none;
+        const std::vector<uint256>& oldParents = depth + 1 < levels.size() ? levels[depth + 1] : none;
+        const size_t count = level.size();
+        if (count <= 1) {
+            if (depth < levels.size()) {
+                levels[depth] = std::move(level);
+            } else {
+                levels.push_back(std::move(level));
+            }
+            levels.resize(depth + 1);
+            break;
+        }
+
+        changed.assign(count, true);
+        for (size_t i = 0; i < count && i < old.size(); ++i) {
+            changed[i] = level[i] != old[i];
+        }
+        branch.push_back(level[1]);
+
+        // An odd last node is paired with itself, see ComputeMerkleRoot. The
+        // copy makes every pair one 64-byte block, so that runs of changed
+        // pairs are hashed in one go.
+        const bool odd = count & 1;
+        if (odd) {
+            level.push_back(level.back());
+        }
+        std::vector<uint256> parents(level.size() / 2);
+        size_t run = 0; // first parent of the run still to be hashed
+        for (size_t j = 0; j <= parents.size(); ++j) {
+            const size_t left = 2 * j;
+            const size_t right = std::min(left + 1, count - 1);
+            const bool reuse = j < parents.size() && j < oldParents.size() && !changed[left] &&
+                    !changed[right] && right == std::min(left + 1, old.size() - 1);
+            if (j < parents.size() && !reuse) {
+                continue;
+            }
+            if (j > run) {
+                SHA256D64(parents[run].begin(), level[2 * run].begin(), j - run);
+                nHashed += j - run;
+            }
+            if (reuse) {
+                parents[j] = oldParents[j];
+                ++nReused;
+            }
+            run = j + 1;
+        }
+        if (odd) {
+            level.pop_back();
+        }
+
+        if (depth < levels.size()) {
+            levels[depth] = std::move(level);
+        } else {
+            levels.push_back(std::move(level));
+        }
+        level = std::move(parents);
+        ++depth;
+    }
+    return branch;
+}
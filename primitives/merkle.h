@@ -27,4 +27,28 @@ uint256 BlockMerkleRoot(const energi::Block& block, bool* mutated = NULL);
  */
 std::vector<uint256> BlockMerkleBranch(const energi::Block& block, uint32_t position);
 
+/*
+ * Merkle tree of the previous block template. Updating it to the leaves of
+ * the next one only rehashes the nodes above leaves that moved or changed,
+ * the rest of the tree is kept.
+ */
+class MerkleCache
+{
+public:
+    /*
+     * Replaces the leaves and returns the branch of leaf 0, which is the
+     * coinbase and may be left null.
+     */
+    std::vector<uint256> update(std::vector<uint256>&& leaves);
+
+    /* Inner nodes the last update hashed / took from the previous tree */
+    size_t hashed() const { return nHashed; }
+    size_t reused() const { return nReused; }
+
+private:
+    std::vector<std::vector<uint256>> levels; // levels[0] are the leaves
+    size_t nHashed = 0;
+    size_t nReused = 0;
+};
+
 #endif
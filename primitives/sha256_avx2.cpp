@@ -0,0 +1,169 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Double-SHA256 of eight 64-byte inputs at once, one per 32-bit lane of the
+// AVX2 registers. Used for merkle levels on CPUs without the SHA extensions.
+
+#if defined(ENABLE_AVX2)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+#include "common/common.h"
+
+namespace
+{
+
+#define ALWAYS_INLINE __attribute__((always_inline))
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+__m256i inline ALWAYS_INLINE Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline ALWAYS_INLINE Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline ALWAYS_INLINE Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+__m256i inline ALWAYS_INLINE Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline ALWAYS_INLINE Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline ALWAYS_INLINE Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline ALWAYS_INLINE And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+__m256i inline ALWAYS_INLINE ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+__m256i inline ALWAYS_INLINE ShL(__m256i x, int n) { return _mm256_slli_epi32(x, n); }
+__m256i inline ALWAYS_INLINE RotR(__m256i x, int n) { return Or(ShR(x, n), ShL(x, 32 - n)); }
+
+__m256i inline ALWAYS_INLINE Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+__m256i inline ALWAYS_INLINE Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m256i inline ALWAYS_INLINE Sigma0(__m256i x) { return Xor(RotR(x, 2), RotR(x, 13), RotR(x, 22)); }
+__m256i inline ALWAYS_INLINE Sigma1(__m256i x) { return Xor(RotR(x, 6), RotR(x, 11), RotR(x, 25)); }
+__m256i inline ALWAYS_INLINE sigma0(__m256i x) { return Xor(RotR(x, 7), RotR(x, 18), ShR(x, 3)); }
+__m256i inline ALWAYS_INLINE sigma1(__m256i x) { return Xor(RotR(x, 17), RotR(x, 19), ShR(x, 10)); }
+
+/** One round of SHA-256 on all lanes. */
+void inline ALWAYS_INLINE Round(__m256i a, __m256i b, __m256i c, __m256i& d, __m256i e, __m256i f, __m256i g, __m256i& h, int k, __m256i w)
+{
+    __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), Add(_mm256_set1_epi32(K[k]), w));
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Adds one block to the state of each lane. The message words are consumed. */
+void inline ALWAYS_INLINE Transform(__m256i (&s)[8], __m256i (&w)[16])
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int j = 0; j < 64; j += 16) {
+        if (j) {
+            for (int i = 0; i < 16; ++i) {
+                w[i] = Add(w[i], sigma1(w[(i + 14) & 15]), w[(i + 9) & 15], sigma0(w[(i + 1) & 15]));
+            }
+        }
+            Round(a, b, c, d, e, f, g, h, j + 0, w[0]);
+            Round(h, a, b, c, d, e, f, g, j + 1, w[1]);
+            Round(g, h, a, b, c, d, e, f, j + 2, w[2]);
+            Round(f, g, h, a, b, c, d, e, j + 3, w[3]);
+            Round(e, f, g, h, a, b, c, d, j + 4, w[4]);
+            Round(d, e, f, g, h, a, b, c, j + 5, w[5]);
+            Round(c, d, e, f, g, h, a, b, j + 6, w[6]);
+            Round(b, c, d, e, f, g, h, a, j + 7, w[7]);
+            Round(a, b, c, d, e, f, g, h, j + 8, w[8]);
+            Round(h, a, b, c, d, e, f, g, j + 9, w[9]);
+            Round(g, h, a, b, c, d, e, f, j + 10, w[10]);
+            Round(f, g, h, a, b, c, d, e, j + 11, w[11]);
+            Round(e, f, g, h, a, b, c, d, j + 12, w[12]);
+            Round(d, e, f, g, h, a, b, c, j + 13, w[13]);
+            Round(c, d, e, f, g, h, a, b, j + 14, w[14]);
+            Round(b, c, d, e, f, g, h, a, j + 15, w[15]);
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+void inline ALWAYS_INLINE Initialize(__m256i (&s)[8])
+{
+    s[0] = _mm256_set1_epi32(0x6a09e667ul);
+    s[1] = _mm256_set1_epi32(0xbb67ae85ul);
+    s[2] = _mm256_set1_epi32(0x3c6ef372ul);
+    s[3] = _mm256_set1_epi32(0xa54ff53aul);
+    s[4] = _mm256_set1_epi32(0x510e527ful);
+    s[5] = _mm256_set1_epi32(0x9b05688cul);
+    s[6] = _mm256_set1_epi32(0x1f83d9abul);
+    s[7] = _mm256_set1_epi32(0x5be0cd19ul);
+}
+
+/** Word offset/4 of each of the eight 64-byte inputs, lane i from input i. */
+__m256i inline ALWAYS_INLINE Read8(const unsigned char* in, int offset)
+{
+    return _mm256_setr_epi32(ReadBE32(in + offset), ReadBE32(in + 64 + offset),
+        ReadBE32(in + 128 + offset), ReadBE32(in + 192 + offset), ReadBE32(in + 256 + offset),
+        ReadBE32(in + 320 + offset), ReadBE32(in + 384 + offset), ReadBE32(in + 448 + offset));
+}
+
+/** Word offset/4 of each of the eight 32-byte outputs, from lane i to output i. */
+void inline ALWAYS_INLINE Write8(unsigned char* out, int offset, __m256i v)
+{
+    alignas(32) uint32_t words[8];
+    _mm256_store_si256((__m256i*)words, v);
+    for (int i = 0; i < 8; ++i) {
+        WriteBE32(out + 32 * i + offset, words[i]);
+    }
+}
+
+} // namespace
+
+namespace sha256d64_avx2
+{
+
+void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], w[16];
+
+    // The input blocks
+    Initialize(s);
+    for (int i = 0; i < 16; ++i) {
+        w[i] = Read8(in, 4 * i);
+    }
+    Transform(s, w);
+
+    // Their padding: a single bit and the length, 512 bits
+    w[0] = _mm256_set1_epi32(0x80000000ul);
+    for (int i = 1; i < 15; ++i) {
+        w[i] = _mm256_setzero_si256();
+    }
+    w[15] = _mm256_set1_epi32(0x200);
+    Transform(s, w);
+
+    // The first hashes with their padding
+    for (int i = 0; i < 8; ++i) {
+        w[i] = s[i];
+    }
+    w[8] = _mm256_set1_epi32(0x80000000ul);
+    for (int i = 9; i < 15; ++i) {
+        w[i] = _mm256_setzero_si256();
+    }
+    w[15] = _mm256_set1_epi32(0x100);
+    Initialize(s);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; ++i) {
+        Write8(out, 4 * i, s[i]);
+    }
+}
+
+} // namespace sha256d64_avx2
+
+#endif
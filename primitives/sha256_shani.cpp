@@ -0,0 +1,208 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 with the Intel SHA extensions, after the SHA-NI code samples by
+// Intel. Several independent blocks can go through the rounds in lockstep,
+// so that the latency of sha256rnds2 on one is hidden behind the others.
+
+#if defined(ENABLE_SHANI)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+namespace
+{
+
+#define ALWAYS_INLINE __attribute__((always_inline))
+
+alignas(__m128i) const uint8_t MASK[16] = {0x03, 0x02, 0x01, 0x00, 0x07, 0x06, 0x05, 0x04,
+                                           0x0b, 0x0a, 0x09, 0x08, 0x0f, 0x0e, 0x0d, 0x0c};
+
+const uint32_t INIT[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul,
+                          0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+/** Four rounds on each lane, m holding their message words. */
+template <size_t N>
+void inline ALWAYS_INLINE QuadRound(__m128i (&s0)[N], __m128i (&s1)[N], const __m128i (&m)[N], uint64_t k1, uint64_t k0)
+{
+    const __m128i k = _mm_set_epi64x(k1, k0);
+    for (size_t i = 0; i < N; ++i) {
+        const __m128i msg = _mm_add_epi32(m[i], k);
+        s1[i] = _mm_sha256rnds2_epu32(s1[i], s0[i], msg);
+        s0[i] = _mm_sha256rnds2_epu32(s0[i], s1[i], _mm_shuffle_epi32(msg, 0x0e));
+    }
+}
+
+/** Next four message words into m0, which holds the ones sixteen back; m1..m3 follow it. */
+template <size_t N>
+void inline ALWAYS_INLINE Schedule(__m128i (&m0)[N], const __m128i (&m1)[N], const __m128i (&m2)[N], const __m128i (&m3)[N])
+{
+    for (size_t i = 0; i < N; ++i) {
+        m0[i] = _mm_sha256msg2_epu32(
+            _mm_add_epi32(_mm_sha256msg1_epu32(m0[i], m1[i]), _mm_alignr_epi8(m3[i], m2[i], 4)), m3[i]);
+    }
+}
+
+/** Adds one block to the state of each lane. The message words are consumed. */
+template <size_t N>
+void inline ALWAYS_INLINE Rounds(__m128i (&s0)[N], __m128i (&s1)[N],
+    __m128i (&m0)[N], __m128i (&m1)[N], __m128i (&m2)[N], __m128i (&m3)[N])
+{
+    __m128i so0[N], so1[N];
+    for (size_t i = 0; i < N; ++i) {
+        so0[i] = s0[i];
+        so1[i] = s1[i];
+    }
+
+    QuadRound(s0, s1, m0, 0xe9b5dba5b5c0fbcfull, 0x71374491428a2f98ull);
+    QuadRound(s0, s1, m1, 0xab1c5ed5923f82a4ull, 0x59f111f13956c25bull);
+    QuadRound(s0, s1, m2, 0x550c7dc3243185beull, 0x12835b01d807aa98ull);
+    QuadRound(s0, s1, m3, 0xc19bf1749bdc06a7ull, 0x80deb1fe72be5d74ull);
+    Schedule(m0, m1, m2, m3);
+    QuadRound(s0, s1, m0, 0x240ca1cc0fc19dc6ull, 0xefbe4786e49b69c1ull);
+    Schedule(m1, m2, m3, m0);
+    QuadRound(s0, s1, m1, 0x76f988da5cb0a9dcull, 0x4a7484aa2de92c6full);
+    Schedule(m2, m3, m0, m1);
+    QuadRound(s0, s1, m2, 0xbf597fc7b00327c8ull, 0xa831c66d983e5152ull);
+    Schedule(m3, m0, m1, m2);
+    QuadRound(s0, s1, m3, 0x1429296706ca6351ull, 0xd5a79147c6e00bf3ull);
+    Schedule(m0, m1, m2, m3);
+    QuadRound(s0, s1, m0, 0x53380d134d2c6dfcull, 0x2e1b213827b70a85ull);
+    Schedule(m1, m2, m3, m0);
+    QuadRound(s0, s1, m1, 0x92722c8581c2c92eull, 0x766a0abb650a7354ull);
+    Schedule(m2, m3, m0, m1);
+    QuadRound(s0, s1, m2, 0xc76c51a3c24b8b70ull, 0xa81a664ba2bfe8a1ull);
+    Schedule(m3, m0, m1, m2);
+    QuadRound(s0, s1, m3, 0x106aa070f40e3585ull, 0xd6990624d192e819ull);
+    Schedule(m0, m1, m2, m3);
+    QuadRound(s0, s1, m0, 0x34b0bcb52748774cull, 0x1e376c0819a4c116ull);
+    Schedule(m1, m2, m3, m0);
+    QuadRound(s0, s1, m1, 0x682e6ff35b9cca4full, 0x4ed8aa4a391c0cb3ull);
+    Schedule(m2, m3, m0, m1);
+    QuadRound(s0, s1, m2, 0x8cc7020884c87814ull, 0x78a5636f748f82eeull);
+    Schedule(m3, m0, m1, m2);
+    QuadRound(s0, s1, m3, 0xc67178f2bef9a3f7ull, 0xa4506ceb90befffaull);
+
+    for (size_t i = 0; i < N; ++i) {
+        s0[i] = _mm_add_epi32(s0[i], so0[i]);
+        s1[i] = _mm_add_epi32(s1[i], so1[i]);
+    }
+}
+
+/** State words a..h to the ABEF/CDGH layout of the SHA instructions. */
+void inline ALWAYS_INLINE Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+void inline ALWAYS_INLINE Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+__m128i inline ALWAYS_INLINE Load(const unsigned char* in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), _mm_load_si128((const __m128i*)MASK));
+}
+
+void inline ALWAYS_INLINE Save(unsigned char* out, __m128i s)
+{
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(s, _mm_load_si128((const __m128i*)MASK)));
+}
+
+/** Double-SHA256 of N consecutive 64-byte inputs. All input is read before out is written. */
+template <size_t N>
+void inline ALWAYS_INLINE TransformD64(unsigned char* out, const unsigned char* in)
+{
+    const __m128i init0 = _mm_loadu_si128((const __m128i*)INIT);
+    const __m128i init1 = _mm_loadu_si128((const __m128i*)(INIT + 4));
+    __m128i s0[N], s1[N], m0[N], m1[N], m2[N], m3[N];
+
+    // The input block
+    for (size_t i = 0; i < N; ++i) {
+        s0[i] = init0;
+        s1[i] = init1;
+        Shuffle(s0[i], s1[i]);
+        m0[i] = Load(in + 64 * i);
+        m1[i] = Load(in + 64 * i + 16);
+        m2[i] = Load(in + 64 * i + 32);
+        m3[i] = Load(in + 64 * i + 48);
+    }
+    Rounds(s0, s1, m0, m1, m2, m3);
+
+    // Its padding: a single bit and the length, 512 bits
+    for (size_t i = 0; i < N; ++i) {
+        m0[i] = _mm_set_epi32(0, 0, 0, 0x80000000);
+        m1[i] = _mm_setzero_si128();
+        m2[i] = _mm_setzero_si128();
+        m3[i] = _mm_set_epi32(0x200, 0, 0, 0);
+    }
+    Rounds(s0, s1, m0, m1, m2, m3);
+
+    // The first hash, already in message word order, with its padding
+    for (size_t i = 0; i < N; ++i) {
+        m0[i] = s0[i];
+        m1[i] = s1[i];
+        Unshuffle(m0[i], m1[i]);
+        m2[i] = _mm_set_epi32(0, 0, 0, 0x80000000);
+        m3[i] = _mm_set_epi32(0x100, 0, 0, 0);
+        s0[i] = init0;
+        s1[i] = init1;
+        Shuffle(s0[i], s1[i]);
+    }
+    Rounds(s0, s1, m0, m1, m2, m3);
+
+    for (size_t i = 0; i < N; ++i) {
+        Unshuffle(s0[i], s1[i]);
+        Save(out + 32 * i, s0[i]);
+        Save(out + 32 * i + 16, s1[i]);
+    }
+}
+
+} // namespace
+
+namespace sha256_shani
+{
+
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i s0[1], s1[1], m0[1], m1[1], m2[1], m3[1];
+    s0[0] = _mm_loadu_si128((const __m128i*)s);
+    s1[0] = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0[0], s1[0]);
+
+    while (blocks--) {
+        m0[0] = Load(chunk);
+        m1[0] = Load(chunk + 16);
+        m2[0] = Load(chunk + 32);
+        m3[0] = Load(chunk + 48);
+        Rounds(s0, s1, m0, m1, m2, m3);
+        chunk += 64;
+    }
+
+    Unshuffle(s0[0], s1[0]);
+    _mm_storeu_si128((__m128i*)s, s0[0]);
+    _mm_storeu_si128((__m128i*)(s + 4), s1[0]);
+}
+
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    ::TransformD64<1>(out, in);
+}
+
+void TransformD64_2way(unsigned char* out, const unsigned char* in)
+{
+    ::TransformD64<2>(out, in);
+}
+
+} // namespace sha256_shani
+
+#endif
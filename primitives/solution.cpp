@@ -8,6 +8,7 @@
 #include "solution.h"
 #include "common/common.h"
 #include "common/Log.h"
+#include "common/streams.h"
 
 #include <sstream>
 
@@ -15,20 +16,34 @@ using namespace energi;
 
 std::string Solution::getBlockTransaction() const
 {
-    if (!m_work.isValid()) {
+    if (!m_job.isValid()) {
         throw WorkException("Invalid work, solution must be wrong!");
     }
-    return m_work.getBlockTransaction();
+    return HexStr(m_job.getCoinbase());
 }
 
 std::string Solution::getSubmitBlockData() const
 {
-    if (!m_work.isValid()) {
+    if (!m_job.isValid()) {
         throw WorkException("Invalid work, solution must be wrong!");
     }
-    std::stringstream ss;
-    //! TODO check and provid correct nType and nVersion for this operation
-    m_work.Serialize(ss, (1 << 0), 70208);
-    return strToHex(ss.str());
+    // The shared template still holds its placeholder coinbase, so the block is
+    // serialized as header + the job's coinbase + the remaining template transactions
+    const auto& work = m_job.getWork();
+    const auto coinbase = m_job.getCoinbase();
+    CDataStream stream(SER_NETWORK, 70208);
+    stream << static_cast<const BlockHeader&>(m_job);
+    WriteCompactSize(stream, work.vtxRaw.size() + 1);
+    stream.write(reinterpret_cast<const char*>(coinbase.data()), coinbase.size());
+    if (!work.vtxRawHex) {
+        for (const auto& tx : work.vtxRaw) {
+            stream << tx;
+        }
+        return HexStr(stream);
+    }
+    // The transactions were encoded when the template arrived
+    std::string data = HexStr(stream);
+    data.reserve(data.size() + work.vtxRawHex->size());
+    data += *work.vtxRawHex;
+    return data;
 }
-
@@ -13,7 +13,7 @@
 
 #include "nrghash/nrghash.h"
 #include "uint256.h"
-#include "work.h"
+#include "job.h"
 
 namespace energi {
 
@@ -23,8 +23,8 @@ public:
     Solution()
     {}
 
-    Solution(const Work &work) :
-        m_work(work)
+    Solution(const Job &job) :
+        m_job(job)
     {}
 
     std::string getSubmitBlockData() const;
@@ -32,30 +32,35 @@ public:
 
     inline const std::string& getJobName() const
     {
-        return m_work.getJobName();
+        return m_job.getJobName();
     }
 
     inline std::string getTime() const
     {
         std::stringstream stream;
-        stream << std::setfill ('0') << std::setw(sizeof(m_work.nTime)*2)
-               << std::hex << m_work.nTime;
+        stream << std::setfill ('0') << std::setw(sizeof(m_job.nTime)*2)
+               << std::hex << m_job.nTime;
         return stream.str();
     }
 
     inline std::string getExtraNonce2() const
     {
-        return m_work.getExtraNonce2();
+        return m_job.getExtraNonce2();
+    }
+
+    const Job& getJob() const
+    {
+        return m_job;
     }
 
     const Work& getWork() const
     {
-        return m_work;
+        return m_job.getWork();
     }
 
     inline std::string getNonce() const
     {
-        uint64_t nonce = m_work.getNonce();
+        uint64_t nonce = m_job.getNonce();
         std::stringstream stream;
         stream << std::setfill ('0') << std::setw(sizeof(nonce)*2)
                << std::hex << nonce;
@@ -64,21 +69,21 @@ public:
 
     const uint256& getHashMix() const
     {
-        return m_work.getHashMix();
+        return m_job.getHashMix();
     }
 
     const uint256& getMerkleRoot() const
     {
-        return m_work.getMerkleRoot();
+        return m_job.getMerkleRoot();
     }
 
     void reset()
     {
-        m_work.reset();
+        m_job.reset();
     }
 
 private:
-    Work m_work;
+    Job m_job;
 };
 
 using SolutionFoundCallback = std::function<void(const Solution&)>;
@@ -72,6 +72,61 @@ std::string CTxOut::ToString() const
     return strprintf("CTxOut(nValue=%d.%08d, scriptPubKey=%s)", nValue / COIN, nValue % COIN, HexStr(scriptPubKey).substr(0, 30));
 }
 
+RawTransaction::RawTransaction(std::vector<unsigned char>&& dataIn)
+    : data(std::make_shared<const std::vector<unsigned char>>(std::move(dataIn)))
+    , hash(Hash(data->begin(), data->end()))
+{
+}
+
+RawTransaction::RawTransaction(std::vector<unsigned char>&& dataIn, const uint256& hashIn)
+    : data(std::make_shared<const std::vector<unsigned char>>(std::move(dataIn)))
+    , hash(hashIn)
+{
+}
+
+void RawTransactionCache::begin()
+{
+    ++generation;
+    nHits = 0;
+    nMisses = 0;
+}
+
+bool RawTransactionCache::decode(RawTransaction& tx, const char* hex, size_t size,
+                                 const uint256& id, const uint256& txid)
+{
+    if (size == 0) {
+        return false;
+    }
+    if (id.IsNull()) {
+        ++nMisses;
+        return DecodeHexRawTx(tx, hex, size, txid);
+    }
+    auto it = entries.find(id);
+    if (it != entries.end()) {
+        it->second.generation = generation;
+        tx = it->second.tx;
+        ++nHits;
+        return true;
+    }
+    ++nMisses;
+    if (!DecodeHexRawTx(tx, hex, size, txid)) {
+        return false;
+    }
+    entries.emplace(id, Entry{tx, generation});
+    return true;
+}
+
+void RawTransactionCache::sweep()
+{
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.generation != generation) {
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 CMutableTransaction::CMutableTransaction() : nVersion(CTransaction::CURRENT_VERSION), nLockTime(0) {}
 CMutableTransaction::CMutableTransaction(const CTransaction& tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime) {}
 
@@ -6,6 +6,9 @@
 #ifndef BITCOIN_PRIMITIVES_TRANSACTION_H
 #define BITCOIN_PRIMITIVES_TRANSACTION_H
 
+#include <memory>
+#include <unordered_map>
+
 #include "script.h"
 #include "uint256.h"
 #include "amount.h"
@@ -376,13 +379,49 @@ struct CompareOutputBIP69
     }
 };
 
-inline bool DecodeHexTx(CTransaction& tx, const std::string& strHexTx)
+/** A transaction kept the way it was received.
+ *
+ * The transactions of a template after the coinbase are only hashed into the
+ * merkle tree and passed on when the block is submitted, so they are never
+ * decoded. The bytes are shared between copies of the template.
+ */
+class RawTransaction
 {
-    if (!IsHex(strHexTx)) {
-        return false;
+private:
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    uint256 hash;
+
+public:
+    RawTransaction() {}
+
+    /** Takes the serialized transaction, the hash is computed from it */
+    explicit RawTransaction(std::vector<unsigned char>&& dataIn);
+
+    /** Takes the serialized transaction and the txid it is known to have */
+    RawTransaction(std::vector<unsigned char>&& dataIn, const uint256& hashIn);
+
+    const uint256& GetHash() const {
+        return hash;
     }
 
-    std::vector<unsigned char> txData(ParseHex(strHexTx));
+    const unsigned char* begin() const {
+        return data ? data->data() : nullptr;
+    }
+
+    size_t size() const {
+        return data ? data->size() : 0;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int, int) const {
+        if (size()) {
+            s.write(reinterpret_cast<const char*>(begin()), size());
+        }
+    }
+};
+
+inline bool DecodeRawTx(CTransaction& tx, const std::vector<unsigned char>& txData)
+{
     CDataStream ssData(txData, SER_NETWORK, 70208);
     try {
         ssData >> tx;
@@ -393,4 +432,85 @@ inline bool DecodeHexTx(CTransaction& tx, const std::string& strHexTx)
     return true;
 }
 
+inline bool DecodeHexTx(CTransaction& tx, const char* hex, size_t size)
+{
+    std::vector<unsigned char> txData;
+    txData.reserve(size / 2);
+    if (size == 0 || !AppendHex(txData, hex, size)) {
+        return false;
+    }
+    return DecodeRawTx(tx, txData);
+}
+
+inline bool DecodeHexTx(CTransaction& tx, const std::string& strHexTx)
+{
+    return DecodeHexTx(tx, strHexTx.data(), strHexTx.size());
+}
+
+/** Reads a transaction from hex without decoding it. A null txid means it is
+ * computed from the bytes. */
+inline bool DecodeHexRawTx(RawTransaction& tx, const char* hex, size_t size,
+                           const uint256& txid = uint256())
+{
+    std::vector<unsigned char> txData;
+    txData.reserve(size / 2);
+    if (size == 0 || !AppendHex(txData, hex, size)) {
+        return false;
+    }
+    tx = txid.IsNull() ? RawTransaction(std::move(txData)) : RawTransaction(std::move(txData), txid);
+    return true;
+}
+
+/** Transactions of the last block template by id.
+ *
+ * Consecutive templates of a tip share almost all their transactions, so
+ * only the ones not seen in the previous template are decoded and hashed.
+ * Transactions that dropped out are forgotten by sweep().
+ */
+class RawTransactionCache
+{
+public:
+    /** Starts filling a new template */
+    void begin();
+
+    /** Like DecodeHexRawTx, but takes the transaction known under id when
+     * there is one. A null id bypasses the cache. */
+    bool decode(RawTransaction& tx, const char* hex, size_t size,
+                const uint256& id, const uint256& txid = uint256());
+
+    /** Forgets the transactions the template filled since begin() did not have */
+    void sweep();
+
+    /** Transactions of the last template taken from the cache / decoded */
+    size_t hits() const {
+        return nHits;
+    }
+
+    size_t misses() const {
+        return nMisses;
+    }
+
+private:
+    struct Entry
+    {
+        RawTransaction tx;
+        unsigned generation;
+    };
+
+    struct IdHasher
+    {
+        size_t operator()(const uint256& id) const {
+            // Ids are hashes already
+            uint64_t value;
+            std::memcpy(&value, id.begin(), sizeof(value));
+            return size_t(value);
+        }
+    };
+
+    std::unordered_map<uint256, Entry, IdHasher> entries;
+    unsigned generation = 0;
+    size_t nHits = 0;
+    size_t nMisses = 0;
+};
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
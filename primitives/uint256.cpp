@@ -59,11 +59,15 @@ base_blob<BITS>::base_blob(const std::vector<unsigned char>& vch)
 template <unsigned int BITS>
 std::string base_blob<BITS>::GetHex() const
 {
-    char psz[sizeof(data) * 2 + 1];
-    for (unsigned int i = 0; i < sizeof(data); ++i) {
-        sprintf(psz + i * 2, "%02x", data[sizeof(data) - i - 1]);
-    }
-    return std::string(psz, psz + sizeof(data) * 2);
+    std::string hex(sizeof(data) * 2, '\0');
+    WriteHex(&hex[0]);
+    return hex;
+}
+
+template <unsigned int BITS>
+void base_blob<BITS>::WriteHex(char* psz) const
+{
+    EncodeHexReversed(psz, data, sizeof(data));
 }
 
 template <unsigned int BITS>
@@ -84,6 +88,16 @@ void base_blob<BITS>::SetHex(const char* psz)
     while (::HexDigit(*psz) != -1){
         psz++;
     }
+    // whole bytes that fit, the usual case, are the digits read last to first
+    const size_t digits = psz - pbegin;
+    if (digits % 2 == 0 && digits <= sizeof(data) * 2) {
+        unsigned char bytes[sizeof(data)];
+        ::DecodeHex(bytes, pbegin, digits);
+        for (size_t i = 0; i < digits / 2; ++i) {
+            data[i] = bytes[digits / 2 - 1 - i];
+        }
+        return;
+    }
     psz--;
     unsigned char* p1 = (unsigned char*)data;
     unsigned char* pend = p1 + WIDTH;
@@ -133,6 +147,7 @@ uint64_t uint256::GetHash(const uint256& salt) const
 // Explicit instantiations for base_blob<160>
 template base_blob<160>::base_blob(const std::vector<unsigned char>&);
 template std::string base_blob<160>::GetHex() const;
+template void base_blob<160>::WriteHex(char*) const;
 template std::string base_blob<160>::ToString() const;
 template void base_blob<160>::SetHex(const char*);
 template void base_blob<160>::SetHex(const std::string&);
@@ -140,6 +155,7 @@ template void base_blob<160>::SetHex(const std::string&);
 // Explicit instantiations for base_blob<256>
 template base_blob<256>::base_blob(const std::vector<unsigned char>&);
 template std::string base_blob<256>::GetHex() const;
+template void base_blob<256>::WriteHex(char*) const;
 template std::string base_blob<256>::ToString() const;
 template void base_blob<256>::SetHex(const char*);
 template void base_blob<256>::SetHex(const std::string&);
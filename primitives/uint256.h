@@ -64,6 +64,8 @@ public:
 public:
     /// @brief returns hexadecimal value
     std::string GetHex() const;
+    /// @brief writes the characters of GetHex() to psz, without a terminator
+    void WriteHex(char* psz) const;
     /// @brief set value
     void SetHex(const char* psz);
     /// @brief set value
@@ -9,63 +9,188 @@
 #include <memory>
 #include "base58.h"
 #include "work.h"
-#include "extranoncesingleton.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
 
 namespace energi {
 
 Work::Work(const Json::Value& stratum,
            const std::string& extraNonce1, const arith_uint256& hashTarget)
-    : Block(stratum, extraNonce1, true)
+    : Work(StratumJobView(stratum), extraNonce1, hashTarget)
+{
+}
+
+Work::Work(const StratumJobView& job,
+           const std::string& extraNonce1, const arith_uint256& hashTarget)
+    : Block(job, extraNonce1)
     , m_extraNonce1(extraNonce1)
+    , m_jobName(job.jobName.str())
     , hashTarget(hashTarget)
 {
-    m_jobName = stratum.get(Json::Value::ArrayIndex(0), "").asString();
+    precompute();
 }
 
 Work::Work(const Json::Value &gbt,
-           const std::string &coinbase_addr)
-    : Block(gbt, coinbase_addr)
+           const std::string &coinbase_addr, TemplateCache* cache)
+    : Block(gbt, coinbase_addr, cache ? &cache->transactions : nullptr)
+{
+    fromTemplate(gbt, cache);
+}
+
+Work::Work(const Json::Value &gbt, TemplateTransactions&& transactions,
+           const std::string &coinbase_addr, TemplateCache* cache)
+    : Block(gbt, std::move(transactions), coinbase_addr)
+{
+    fromTemplate(gbt, cache);
+}
+
+void Work::fromTemplate(const Json::Value& gbt, TemplateCache* cache)
 {
     hashTarget = arith_uint256().SetCompact(this->nBits);
+
+    // Stratum pools don't advertise an ntime range, so only templates whose
+    // "mutable" list allows it get their time rolled
+    bool timeMutable = false;
+    for (const auto& field : gbt["mutable"]) {
+        const std::string name = field.asString();
+        if (name == "time" || name == "time/increment") {
+            timeMutable = true;
+        }
+    }
+    if (timeMutable) {
+        // The node's own bound wins, without one stay within c_maxTimeRoll
+        maxTime = gbt.isMember("maxtime") ? gbt["maxtime"].asUInt() : nTime + c_maxTimeRoll;
+    }
+    precompute(cache ? &cache->merkle : nullptr);
+}
+
+Json::Value Work::syntheticNotify(uint32_t height, const uint256& prevHash,
+                                  const std::string& jobName, bool clean)
+{
+    // Coinbase with an 8 byte marker where stratum puts extranonce1 + extranonce2
+    CMutableTransaction coinbase;
+    coinbase.vin.push_back(CTxIn());
+    coinbase.vin[0].scriptSig = CScript() << std::vector<unsigned char>(8, 0xab);
+    coinbase.vout.push_back(CTxOut(0, CScript() << OP_TRUE));
+    CDataStream ss(SER_NETWORK, 70208);
+    ss << CTransaction(coinbase);
+    const std::string hex = HexStr(ss.begin(), ss.end());
+    const auto slot = hex.find("abababababababab");
+
+    Json::Value params(Json::arrayValue);
+    params.append(jobName);
+    params.append(prevHash.GetHex());
+    params.append(hex.substr(0, slot));
+    params.append(hex.substr(slot + 16));
+    params.append(Json::Value(Json::arrayValue));
+    params.append("20000000");
+    params.append("1e0fffff");
+    char time[9];
+    std::snprintf(time, sizeof(time), "%08x", unsigned(std::time(nullptr)));
+    params.append(time);
+    params.append(clean);
+    params.append(height);
+    return params;
 }
 
-void Work::updateExtraNonce()
+Work Work::synthetic(uint32_t height, const uint256& prevHash,
+                     const arith_uint256& target, const std::string& jobName)
 {
-    auto &noncegen = ExtraNonceSingleton::getInstance();
-    noncegen.generateExtraNonce();
-    m_extraNonce2 = noncegen.getExtraNonce();
-    mutateCoinbase(m_extraNonce1, getExtraNonce2());
+    return Work(syntheticNotify(height, prevHash, jobName, true), "00000000", target);
 }
 
-void Work::updateTimestamp()
+void Work::precompute(MerkleCache* merkle)
 {
-    nTime = std::chrono::seconds(std::time(NULL)).count();
+    boundary = *reinterpret_cast<uint64_t const *>((hashTarget >> 192).data());
+    epoch = nHeight / nrghash::constants::EPOCH_LENGTH;
+
+    coinbasePrefix.clear();
+    coinbaseSuffix.clear();
+    merkleBranch.clear();
+    if (txCoinbase.IsNull()) {
+        return;
+    }
+
+    // Locate the extranonce2 slot by serializing the coinbase with two
+    // placeholders that differ in every byte
+    CDataStream low(SER_NETWORK, 70208);
+    low << buildCoinbase(HexStrMemory(uint32_t(0)));
+    CDataStream high(SER_NETWORK, 70208);
+    high << buildCoinbase(HexStrMemory(uint32_t(0xffffffff)));
+
+    const size_t slotSize = sizeof(uint32_t);
+    if (low.size() != high.size()) {
+        throw WorkException("Cannot locate extranonce slot in coinbase");
+    }
+    const size_t slot = std::mismatch(low.begin(), low.end(), high.begin()).first - low.begin();
+    if (slot + slotSize > low.size() ||
+            !std::equal(low.begin() + slot + slotSize, low.end(), high.begin() + slot + slotSize)) {
+        throw WorkException("Cannot locate extranonce slot in coinbase");
+    }
+    coinbasePrefix.assign(low.begin(), low.begin() + slot);
+    coinbaseSuffix.assign(low.begin() + slot + slotSize, low.end());
+
+    // Branch of leaf 0 does not depend on the coinbase itself
+    std::vector<uint256> leaves;
+    leaves.resize(vtxRaw.size() + 1);
+    for (size_t s = 0; s < vtxRaw.size(); s++) {
+        leaves[s + 1] = vtxRaw[s].GetHash();
+    }
+    merkleBranch = merkle ? merkle->update(std::move(leaves)) : ComputeMerkleBranch(leaves, 0);
 }
 
-std::string Work::getBlockTransaction() const
+void Work::updateTimestamp()
 {
-    CDataStream stream(SER_NETWORK, 70208);
-    stream << vtx[0];
-    return HexStr(stream);
+    nTime = std::chrono::seconds(std::time(NULL)).count();
 }
 
-void Work::mutateCoinbase(const std::string &extraNonce1, const std::string &extraNonce2) {
+CTransaction Work::buildCoinbase(const std::string &extraNonce2) const
+{
+    if (txCoinbase.IsNull()) {
+        throw WorkException("Work has no coinbase transaction");
+    }
     if (stratum_coinbase1.empty()) {
-        CMutableTransaction coinbaseTx(this->vtx[0]);
+        CMutableTransaction coinbaseTx(txCoinbase);
         coinbaseTx.vin[0].scriptSig = CScript()
             << this->nHeight
-            << ParseHex(extraNonce1 + extraNonce2);
-        vtx[0] = coinbaseTx;
-    } else {
-        std::string hexData = stratum_coinbase1 + extraNonce1 + extraNonce2 + stratum_coinbase2;
-        CTransaction coinbaseTx;
-        DecodeHexTx(coinbaseTx, hexData);
-
-        vtx[0] = coinbaseTx;
-        vtx[0].UpdateHash();
+            << ParseHex(m_extraNonce1 + extraNonce2);
+        return CTransaction(coinbaseTx);
     }
+    std::string hexData = stratum_coinbase1 + m_extraNonce1 + extraNonce2 + stratum_coinbase2;
+    CTransaction coinbaseTx;
+    DecodeHexTx(coinbaseTx, hexData);
+    coinbaseTx.UpdateHash();
+    return coinbaseTx;
+}
+
+std::vector<unsigned char> Work::serializeCoinbase(uint32_t extraNonce2) const
+{
+    std::vector<unsigned char> coinbase;
+    coinbase.reserve(coinbasePrefix.size() + sizeof(extraNonce2) + coinbaseSuffix.size());
+    coinbase.insert(coinbase.end(), coinbasePrefix.begin(), coinbasePrefix.end());
+    auto slot = reinterpret_cast<const unsigned char*>(&extraNonce2);
+    coinbase.insert(coinbase.end(), slot, slot + sizeof(extraNonce2));
+    coinbase.insert(coinbase.end(), coinbaseSuffix.begin(), coinbaseSuffix.end());
+    return coinbase;
+}
 
-    hashMerkleRoot = BlockMerkleRoot(*this);
+uint256 Work::coinbaseHash(uint32_t extraNonce2) const
+{
+    // Same byte layout as HexStrMemory(extraNonce2) used for the stratum submit
+    uint256 hash;
+    CHash256().Write(coinbasePrefix.data(), coinbasePrefix.size())
+              .Write(reinterpret_cast<const unsigned char*>(&extraNonce2), sizeof(extraNonce2))
+              .Write(coinbaseSuffix.data(), coinbaseSuffix.size())
+              .Finalize(hash.begin());
+    return hash;
+}
+
+uint256 Work::merkleRoot(uint32_t extraNonce2) const
+{
+    return ComputeMerkleRootFromBranch(coinbaseHash(extraNonce2), merkleBranch, 0);
 }
 
 } //! namespace energi
@@ -24,12 +24,33 @@
 
 namespace energi
 {
+//! What is kept from one block template to the next, see Work(gbt, address, cache)
+struct TemplateCache
+{
+    RawTransactionCache transactions;
+    MerkleCache         merkle;
+
+    //! How much of the last template was reused
+    std::string ToString() const
+    {
+        std::stringstream ss;
+        ss << transactions.hits() << "/" << (transactions.hits() + transactions.misses())
+           << " transactions reused, " << merkle.hashed() << "/" << (merkle.hashed() + merkle.reused())
+           << " merkle nodes rehashed";
+        return ss.str();
+    }
+};
+
 // Work receives getblocktemplate input string, json
 // After parsing it builds the block to be mined and passes to miners
 // after finding POW, creates solution
 // Block -> block header + raw transaction data ( txncount + raw transactions )
 struct Work : public Block
 {
+    //! How far past the template time a rolled nTime may go, in seconds,
+    //! when the template allows rolling but gives no maxtime
+    static const uint32_t c_maxTimeRoll = 3600;
+
     Work()
         : Block()
     {}
@@ -39,13 +60,29 @@ struct Work : public Block
     Work(const Work &) = default; // -> Blank work for comparisons
     Work(const Json::Value& gbt,
          const std::string& extraNonce, const arith_uint256& hashTarget);
+    //! Stratum job read straight from the receive buffer, see StratumParser
+    Work(const StratumJobView& job,
+         const std::string& extraNonce, const arith_uint256& hashTarget);
 
     Work(const Json::Value& gbt,
-         const std::string& coinbase_addr); // -> coinbase to transfer miners reward
+         const std::string& coinbase_addr, // -> coinbase to transfer miners reward
+         TemplateCache* cache = nullptr);
+    //! Template whose transactions were read apart, see TemplateParser. Only
+    //! the merkle part of cache is used, the parser had the transactions.
+    Work(const Json::Value& gbt, TemplateTransactions&& transactions,
+         const std::string& coinbase_addr, TemplateCache* cache = nullptr);
 
     Work& operator=(const Work &) = default;
 
-    bool operator==(const Work& other) const
+    //! Stratum shaped work with an empty block, for offline benchmarks and simulations
+    static Work synthetic(uint32_t height, const uint256& prevHash,
+                          const arith_uint256& target, const std::string& jobName);
+    //! mining.notify params of the work above, extranonce1 + extranonce2 take 8 bytes
+    static Json::Value syntheticNotify(uint32_t height, const uint256& prevHash,
+                                       const std::string& jobName, bool clean);
+
+    //! Same block to build on, the job itself may still differ
+    bool sameTip(const Work& other) const
     {
         return (hashPrevBlock == other.hashPrevBlock) &&
                (nHeight == other.nHeight) &&
@@ -55,6 +92,14 @@ struct Work : public Block
                (hashTarget == other.hashTarget);
     }
 
+    bool operator==(const Work& other) const
+    {
+        // A new stratum job or template on the same tip has to reach the miners too
+        return sameTip(other) &&
+               (m_jobName == other.m_jobName) &&
+               (merkleBranch == other.merkleBranch);
+    }
+
     bool operator!=(const Work& other) const
     {
         return !operator==(other);
@@ -65,6 +110,12 @@ struct Work : public Block
         SetNull();
         m_jobName = std::string();
         m_extraNonce1 = std::string();
+        boundary = 0;
+        epoch = 0;
+        maxTime = 0;
+        coinbasePrefix.clear();
+        coinbaseSuffix.clear();
+        merkleBranch.clear();
     }
 
     bool isValid() const
@@ -82,10 +133,21 @@ struct Work : public Block
         m_jobName = name;
     }
 
-    std::string getBlockTransaction() const;
+    //! Coinbase transaction carrying the given extranonce2 (hex)
+    CTransaction buildCoinbase(const std::string &extraNonce2) const;
+
+    //! Serialized coinbase with the extranonce2 slot filled in
+    std::vector<unsigned char> serializeCoinbase(uint32_t extraNonce2) const;
+    //! Coinbase txid, a single double SHA256 over prefix + slot + suffix
+    uint256 coinbaseHash(uint32_t extraNonce2) const;
+    //! Merkle root for the given extranonce2, folds the coinbase hash up the cached branch
+    uint256 merkleRoot(uint32_t extraNonce2) const;
 
-    void updateExtraNonce();
-    void mutateCoinbase(const std::string &extraNonce1, const std::string &extraNonce2);
+    //! Derives the boundary, epoch, coinbase template and merkle branch
+    void precompute(MerkleCache* merkle = nullptr);
+
+    //! Target, time range and precompute() of getblocktemplate work
+    void fromTemplate(const Json::Value& gbt, TemplateCache* cache);
 
     void updateTimestamp();
 
@@ -97,18 +159,26 @@ struct Work : public Block
         READWRITE(*(Block*)this);
     }
 
-    inline std::string getExtraNonce2() const
+    //! True when miners may move nTime forward up to maxTime
+    bool canRollTime() const
     {
-        return HexStrMemory(m_extraNonce2);
+        return maxTime > nTime;
     }
 
-
     //!TODO keep only this part
     uint64_t       startNonce = 0;
     std::string    m_extraNonce1;
-    uint32_t       m_extraNonce2 = 0;
     std::string    m_jobName;
     arith_uint256  hashTarget;
+    uint64_t       boundary = 0; // upper 64 bits of hashTarget
+    uint32_t       epoch = 0;
+    uint32_t       maxTime = 0; // latest nTime the pool accepts, not rolled when <= nTime
+
+    // Serialized coinbase split around the 4 byte extranonce2 slot and the
+    // merkle branch of leaf 0, so rolling the extranonce is O(log n)
+    std::vector<unsigned char> coinbasePrefix;
+    std::vector<unsigned char> coinbaseSuffix;
+    std::vector<uint256>       merkleBranch;
 
     std::string ToString() const
     {
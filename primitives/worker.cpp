@@ -13,56 +13,93 @@
 
 using namespace energi;
 
+void Worker::setState(State state)
+{
+    {
+        std::lock_guard<std::mutex> lock(x_state);
+        m_state = state;
+    }
+    m_stateChanged.notify_all();
+}
+
 void Worker::startWorking()
 {
+    using namespace std::chrono;
+    const auto start = steady_clock::now();
+
     std::lock_guard<std::mutex> lock(x_work);
     if (m_work) {
+        std::lock_guard<std::mutex> stateLock(x_state);
         State ex = State::Stopped;
-        m_state.compare_exchange_strong(ex, State::Starting);
+        if (m_state.compare_exchange_strong(ex, State::Starting)) {
+            m_stateChanged.notify_all();
+        }
     } else {
         m_state = State::Starting;
         m_work.reset(new std::thread([&]() {
-                while (m_state != State::Killing) {
-                    State ex = State::Starting;
-                    m_state.compare_exchange_strong(ex, State::Started);
+                while (true) {
+                    {
+                        // Parked here while Stopped, no polling
+                        std::unique_lock<std::mutex> stateLock(x_state);
+                        m_stateChanged.wait(stateLock, [this] { return m_state != State::Stopped; });
+                        if (m_state == State::Killing) {
+                            break;
+                        }
+                        if (m_state == State::Starting) {
+                            m_state = State::Started;
+                            m_stateChanged.notify_all();
+                        }
+                    }
                     try {
                         trun();
                     } catch (std::exception const& _e) {
                         clog(WarnChannel) << "Exception thrown in Worker thread: " << _e.what();
                     }
-                    ex = m_state.exchange(State::Stopped);
-                    if (ex == State::Killing || ex == State::Starting) {
-                        m_state.exchange(ex);
-                    }
-                    while (m_state == State::Stopped) {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    {
+                        std::lock_guard<std::mutex> stateLock(x_state);
+                        if (m_state != State::Killing && m_state != State::Starting) {
+                            m_state = State::Stopped;
+                        }
                     }
+                    m_stateChanged.notify_all();
                }
         }));
     }
-    while (m_state == State::Starting) {
-        std::this_thread::sleep_for(std::chrono::microseconds(20));
-    }
+
+    std::unique_lock<std::mutex> stateLock(x_state);
+    m_stateChanged.wait(stateLock, [this] { return m_state != State::Starting; });
+    m_startLatency.store(duration_cast<microseconds>(steady_clock::now() - start).count(),
+                         std::memory_order_relaxed);
 }
 
 void Worker::stopWorking()
 {
+    using namespace std::chrono;
+    const auto start = steady_clock::now();
+
     DEV_GUARDED(x_work)
     if (m_work) {
-        State ex = State::Started;
-        m_state.compare_exchange_strong(ex, State::Stopping);
-
-        while (m_state != State::Stopped) {
-            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        {
+            std::lock_guard<std::mutex> stateLock(x_state);
+            if (m_state == State::Started || m_state == State::Starting) {
+                m_state = State::Stopping;
+            }
         }
+        m_stateChanged.notify_all();
+        onStopRequested();
+
+        std::unique_lock<std::mutex> stateLock(x_state);
+        m_stateChanged.wait(stateLock, [this] { return m_state == State::Stopped || m_state == State::Killing; });
     }
+    m_stopLatency.store(duration_cast<microseconds>(steady_clock::now() - start).count(),
+                        std::memory_order_relaxed);
 }
 
 Worker::~Worker()
 {
     DEV_GUARDED(x_work)
     if (m_work) {
-        m_state.exchange(State::Killing);
+        setState(State::Killing);
         m_work->join();
         m_work.reset();
     }
@@ -9,6 +9,8 @@
 #define ENERGIMINER_WORKER_H_
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <string>
 #include <mutex>
 #include <thread>
@@ -46,26 +48,55 @@ public:
 
     bool shouldStop() const
     {
-        return m_state == State::Stopping || m_state == State::Stopped;
+        return m_state != State::Starting && m_state != State::Started;
     }
 
     std::string name() const
     {
         return m_name;
     }
+
+    // How long the last startWorking()/stopWorking() call waited for the thread
+    std::chrono::microseconds lastStartLatency() const
+    {
+        return std::chrono::microseconds(m_startLatency.load(std::memory_order_relaxed));
+    }
+    std::chrono::microseconds lastStopLatency() const
+    {
+        return std::chrono::microseconds(m_stopLatency.load(std::memory_order_relaxed));
+    }
 protected:
     // run in a thread
     // This function is meant to run some logic in a loop.
     // Should quit once done or when new work is assigned
     virtual void trun() = 0;
 
+    // Called whenever the thread is asked to stop. Implementations blocked on their
+    // own condition variables wake up here so that stopping never waits on a timeout.
+    virtual void onStopRequested() {}
+
+    // Sleeps for the given time unless the worker is asked to stop.
+    // Returns false if it was interrupted.
+    template <class Rep, class Period>
+    bool sleepFor(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        std::unique_lock<std::mutex> lock(x_state);
+        return !m_stateChanged.wait_for(lock, timeout, [this] { return shouldStop(); });
+    }
+
 private:
+    void setState(State state);
 
     std::string                   m_name;
     mutable std::mutex            x_work;
     std::unique_ptr<std::thread>  m_work;
 
+    std::mutex                    x_state;
+    std::condition_variable       m_stateChanged;
     std::atomic<State>            m_state { State::Starting };
+
+    std::atomic<int64_t>          m_startLatency { 0 };
+    std::atomic<int64_t>          m_stopLatency { 0 };
 };
 
 } //! namespace energi
@@ -4,10 +4,12 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <queue>
 #include <chrono>
+#include <memory>
 
 #include <nrgcore/mineplant.h>
 #include <nrgcore/miner.h>
 #include "PoolURI.h"
+#include "SessionCapture.h"
 
 class PoolClient
 {
@@ -24,7 +26,8 @@ public:
     virtual void disconnect() = 0;
 
     virtual void submitHashrate(const std::string& rate) = 0;
-    virtual void submitSolution(const energi::Solution& solution) = 0;
+    // Returns false if the solution could not be sent and should be retried
+    virtual bool submitSolution(const energi::Solution& solution) = 0;
     virtual bool isConnected() = 0;
     virtual bool isPendingState() = 0;
     virtual std::string ActiveEndPoint() = 0;
@@ -66,6 +69,12 @@ public:
         m_onResetWork = handler;
     }
 
+    //! Every line exchanged with the pool is recorded while a capture is set
+    void setCapture(const std::shared_ptr<SessionCapture>& capture)
+    {
+        m_capture = capture;
+    }
+
 protected:
     std::atomic<bool> m_subscribed = { false };
     std::atomic<bool> m_authorized = { false };
@@ -82,4 +91,6 @@ protected:
     Connected m_onConnected;
     ResetWork m_onResetWork;
     WorkReceived m_onWorkReceived;
+
+    std::shared_ptr<SessionCapture> m_capture;
 };
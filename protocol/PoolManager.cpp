@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <boost/bind.hpp>
 
@@ -5,12 +6,16 @@
 
 using namespace energi;
 
+// Seconds between standby connection attempts
+static const unsigned c_standbyRetry = 10;
+
 PoolManager::PoolManager(boost::asio::io_service& io_service,
                          PoolClient* client,
                          energi::MinePlant &farm,
                          const MinerExecutionMode& minerType,
                          unsigned maxTries,
-                         unsigned failoverTimeout)
+                         unsigned failoverTimeout,
+                         PoolClient* standby)
     : Worker("main")
     , m_io_strand(io_service)
     , m_failovertimer(io_service)
@@ -18,86 +23,135 @@ PoolManager::PoolManager(boost::asio::io_service& io_service,
     , m_minerType(minerType)
 {
 	p_client = client;
+    p_standby = standby;
     m_maxConnectionAttempts = maxTries;
     m_failoverTimeout = failoverTimeout;
 
-	p_client->onConnected([&]()
+    attach(p_client);
+    if (p_standby) {
+        attach(p_standby);
+    }
+
+	m_farm.onSolutionFound([&](const Solution& sol) -> bool
 	{
-        m_connectionAttempt = 0;
-        m_activeConnectionHost = m_connections[m_activeConnectionIdx].Host();
-        cnote << "Connected to " << p_client->ActiveEndPoint();
-        // Rough implementation to return to primary pool
-        // after specified amount of time
-        if (m_activeConnectionIdx != 0 && m_failoverTimeout > 0) {
-            m_failovertimer.expires_from_now(boost::posix_time::minutes(m_failoverTimeout));
-            m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(&PoolManager::check_failover_timeout, this, boost::asio::placeholders::error)));
-        } else {
-            m_failovertimer.cancel();
+        PoolClient* client;
+        {
+            std::lock_guard<std::mutex> lock(x_clients);
+            client = p_client;
         }
+        // Solution should passthrough only if client is
+        // properly connected. Otherwise we'll have the bad behavior
+        // to log nonce submission but receive no response
+        if (client->isConnected()) {
+            return client->submitSolution(sol);
+        }
+        cnote << std::string(EthRed "Nonce ") + std::to_string(sol.getJob().getNonce()) << " held back. Waiting for connection ...";
+        return false;
+	});
+	m_farm.onMinerRestart([&]() {
+        setThreadName("main");
+		cnote << "Restart miners...";
+		if (m_farm.isMining()) {
+			// Warm restart, devices keep their context and DAG
+			m_farm.suspend();
+			m_farm.resume();
+			return;
+		}
+        auto vEngineModes = getEngineModes(m_minerType);
+        m_farm.start(vEngineModes);
+	});
+}
 
-        if (!m_farm.isMining()) {
-            cnote << "Spinning up miners...";
-            auto vEngineModes = getEngineModes(m_minerType);
-            m_farm.start(vEngineModes);
-    }
+void PoolManager::attach(PoolClient* client)
+{
+    // Both clients report here, only the active one drives the miners
+	client->onConnected([this, client]()
+	{
+        {
+            std::lock_guard<std::mutex> lock(x_clients);
+            if (client != p_client) {
+                cnote << "Standby connected to " << m_standbyConn->Host() << client->ActiveEndPoint();
+                return;
+            }
+        }
+        activated();
 	});
-	p_client->onResetWork([&]()
+	client->onResetWork([this, client]()
 	{
+        std::lock_guard<std::mutex> lock(x_clients);
+        if (client != p_client) {
+            m_standbyWork.reset();
+            return;
+        }
         m_farm.resetWork();
 	});
-	p_client->onDisconnected([&]()
+	client->onDisconnected([this, client]()
 	{
         setThreadName("main");
-        cnote << "Disconnected from " << p_client->ActiveEndPoint();
+        {
+            std::lock_guard<std::mutex> lock(x_clients);
+            if (client != p_client) {
+                m_standbyWork.reset();
+                cnote << "Standby disconnected from " << client->ActiveEndPoint();
+                return;
+            }
+        }
+        cnote << "Disconnected from " << client->ActiveEndPoint();
         // Do not stop mining here
         // Workloop will determine if we're trying a fast reconnect to same pool
         // or if we're switching to failover(s)
+        if (p_standby) {
+            wake();
+        }
 	});
-    p_client->onWorkReceived([&](const Work& wp)
+    client->onWorkReceived([this, client](const Work& wp)
     {
+        std::lock_guard<std::mutex> lock(x_clients);
+        if (client != p_client) {
+            m_standbyWork.reset(new Work(wp));
+            return;
+        }
         m_farm.setWork(wp);
     });
-	p_client->onSolutionAccepted([&](const bool& stale, const std::chrono::milliseconds& elapsedMs)
+	client->onSolutionAccepted([this, client](const bool& stale, const std::chrono::milliseconds& elapsedMs)
 	{
 		using namespace std::chrono;
 		std::stringstream ss;
 		ss << std::setw(4) << std::setfill(' ') << elapsedMs.count();
-		ss << " ms." << "   " << m_connections[m_activeConnectionIdx].Host() + p_client->ActiveEndPoint();
+		ss << " ms." << "   " << m_activeConnectionHost + client->ActiveEndPoint();
 		cnote << EthLime "**Accepted  " EthReset << (stale ? "(stale)" : "") << ss.str();
 		m_farm.acceptedSolution(stale);
 	});
-	p_client->onSolutionRejected([&](const bool& stale, std::chrono::milliseconds const& elapsedMs)
+	client->onSolutionRejected([this, client](const bool& stale, std::chrono::milliseconds const& elapsedMs)
 	{
 		using namespace std::chrono;
 		std::stringstream ss;
 		ss << std::setw(4) << std::setfill(' ') << elapsedMs.count();
-		ss << " ms." << "   " << m_connections[m_activeConnectionIdx].Host() + p_client->ActiveEndPoint();
+		ss << " ms." << "   " << m_activeConnectionHost + client->ActiveEndPoint();
 		cwarn << EthRed "**Rejected  " EthReset << (stale ? "(stale)" : "") << ss.str();
 		m_farm.rejectedSolution();
 	});
+}
 
-	m_farm.onSolutionFound([&](const Solution& sol)
-	{
-        // Solution should passthrough only if client is
-        // properly connected. Otherwise we'll have the bad behavior
-        // to log nonce submission but receive no response
-        if (p_client->isConnected()) {
-            p_client->submitSolution(sol);
-        } else {
-            cnote << std::string(EthRed "Nonce ") + std::to_string(sol.getWork().getNonce()) << " wasted. Waiting for connection ...";
-        }
-    return false;
-	});
-	m_farm.onMinerRestart([&]() {
-        setThreadName("main");
-		cnote << "Restart miners...";
-		if (m_farm.isMining()) {
-			cnote << "Shutting down miners...";
-			m_farm.stop();
-		}
+void PoolManager::activated()
+{
+    m_connectionAttempt = 0;
+    m_activeConnectionHost = m_connections[m_activeConnectionIdx]->Host();
+    cnote << "Connected to " << p_client->ActiveEndPoint();
+    // Rough implementation to return to primary pool
+    // after specified amount of time
+    if (m_activeConnectionIdx != 0 && m_failoverTimeout > 0) {
+        m_failovertimer.expires_from_now(boost::posix_time::minutes(m_failoverTimeout));
+        m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(&PoolManager::check_failover_timeout, this, boost::asio::placeholders::error)));
+    } else {
+        m_failovertimer.cancel();
+    }
+
+    if (!m_farm.isMining()) {
+        cnote << "Spinning up miners...";
         auto vEngineModes = getEngineModes(m_minerType);
         m_farm.start(vEngineModes);
-	});
+    }
 }
 
 void PoolManager::stop()
@@ -106,10 +160,14 @@ void PoolManager::stop()
         cnote << "Shutting down...";
         m_running.store(false, std::memory_order_relaxed);
         m_failovertimer.cancel();
+        stopWorking();
 
         if (p_client->isConnected()) {
             p_client->disconnect();
         }
+        if (p_standby && p_standby->isConnected()) {
+            p_standby->disconnect();
+        }
         if (m_farm.isMining()) {
             cnote << "Shutting down miners...";
             m_farm.stop();
@@ -124,9 +182,13 @@ void PoolManager::trun()
         // Take action only if not pending state (connecting/disconnecting)
         // Otherwise do nothing and wait until connection state is NOT pending
         if (!p_client->isPendingState()) {
+            // A standby that is logged in and has a job takes over at once
+            if (!p_client->isConnected()) {
+                promoteStandby();
+            }
             if (!p_client->isConnected()) {
                 // If this connection is marked Unrecoverable then discard it
-                if (m_connections[m_activeConnectionIdx].IsUnrecoverable()) {
+                if (m_connections[m_activeConnectionIdx]->IsUnrecoverable()) {
                     m_connections.erase(m_connections.begin() + m_activeConnectionIdx);
                     if (m_activeConnectionIdx >= m_connections.size()) {
                         m_activeConnectionIdx = 0;
@@ -144,17 +206,19 @@ void PoolManager::trun()
                     // Suspend mining if applicable as we're switching
                     if (m_farm.isMining()) {
                         cnote << "Suspend mining due connection change...";
-                        m_farm.resetWork();//
+                        m_farm.suspend();
                     }
                 }
-                if (m_connections[m_activeConnectionIdx].Host() != "exit"  && m_connections.size() > 0) {
+                if (m_connections[m_activeConnectionIdx]->Host() != "exit"  && m_connections.size() > 0) {
                     // Count connectionAttempts
                     m_connectionAttempt++;
+                    m_returnToPrimary.store(false, std::memory_order_relaxed);
 
                     // Invoke connections
-                    p_client->setConnection(m_connections[m_activeConnectionIdx]);
-                    m_farm.set_pool_addresses(m_connections[m_activeConnectionIdx].Host(), m_connections[m_activeConnectionIdx].Port());
-                    cnote << "Selected pool " << (m_connections[m_activeConnectionIdx].Host() + ":" + toString(m_connections[m_activeConnectionIdx].Port()));
+                    m_activeConn = m_connections[m_activeConnectionIdx];
+                    p_client->setConnection(*m_activeConn);
+                    m_farm.set_pool_addresses(m_activeConn->Host(), m_activeConn->Port());
+                    cnote << "Selected pool " << (m_activeConn->Host() + ":" + toString(m_activeConn->Port()));
                     p_client->connect();
 
                 } else {
@@ -171,6 +235,7 @@ void PoolManager::trun()
             }
 
         }
+        keepStandby();
 
         // Hashrate reporting
         m_hashrateReportingTimePassed++;
@@ -188,13 +253,29 @@ void PoolManager::trun()
             //!TODO p_client->submitHashrate();
             m_hashrateReportingTimePassed = 0;
         }
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::unique_lock<std::mutex> lock(x_wake);
+        m_wakeCondition.wait_for(lock, std::chrono::seconds(1), [this] { return m_wakeup || shouldStop(); });
+        m_wakeup = false;
     }
 }
 
+void PoolManager::onStopRequested()
+{
+    wake();
+}
+
+void PoolManager::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(x_wake);
+        m_wakeup = true;
+    }
+    m_wakeCondition.notify_one();
+}
+
 void PoolManager::addConnection(URI &conn)
 {
-	m_connections.push_back(conn);
+	m_connections.push_back(std::make_shared<URI>(conn));
 }
 
 void PoolManager::clearConnections()
@@ -204,13 +285,16 @@ void PoolManager::clearConnections()
     if (p_client && p_client->isConnected()) {
         p_client->disconnect();
     }
+    if (p_standby && p_standby->isConnected()) {
+        p_standby->disconnect();
+    }
 }
 
 bool PoolManager::start()
 {
     if (m_connections.size() > 0) {
         m_running.store (true, std::memory_order_relaxed);
-        m_workThread = std::thread{ boost::bind(&PoolManager::trun, this) };
+        startWorking();
         // Try to connect to pool
         return true;
     } else {
@@ -226,6 +310,8 @@ void PoolManager::check_failover_timeout(const boost::system::error_code& ec)
     if (!ec) {
         if (m_running.load(std::memory_order_relaxed)) {
             if (m_activeConnectionIdx != 0) {
+                // A standby already on the primary pool is swapped in
+                m_returnToPrimary.store(true, std::memory_order_relaxed);
                 p_client->disconnect();
                 m_activeConnectionIdx = 0;
                 m_connectionAttempt = 0;
@@ -234,3 +320,74 @@ void PoolManager::check_failover_timeout(const boost::system::error_code& ec)
     }
 }
 
+void PoolManager::keepStandby()
+{
+    if (!p_standby || p_standby->isPendingState()) {
+        return;
+    }
+    // The standby waits on the pool a failover would go to
+    std::shared_ptr<URI> next;
+    if (m_connections.size() > 1) {
+        next = m_connections[(m_activeConnectionIdx + 1) % m_connections.size()];
+        if (next->Host() == "exit" || next->IsUnrecoverable()) {
+            next.reset();
+        }
+    }
+    if (next != m_standbyConn && p_standby->isConnected()) {
+        // Failover order moved on, e.g. after a switch
+        p_standby->disconnect();
+        return;
+    }
+    if (!next || p_standby->isConnected()) {
+        return;
+    }
+    if (next == m_standbyConn && m_standbyWait > 0) {
+        // Back off after a failed or dropped standby connection
+        m_standbyWait--;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(x_clients);
+        m_standbyConn = next;
+        m_standbyWork.reset();
+    }
+    m_standbyWait = c_standbyRetry;
+    cnote << "Standby pool " << (next->Host() + ":" + toString(next->Port()));
+    p_standby->setConnection(*next);
+    p_standby->connect();
+}
+
+bool PoolManager::promoteStandby()
+{
+    if (!p_standby || !p_standby->isConnected()) {
+        return false;
+    }
+    auto found = std::find(m_connections.begin(), m_connections.end(), m_standbyConn);
+    if (found == m_connections.end()) {
+        return false;
+    }
+    const unsigned idx = unsigned(found - m_connections.begin());
+    if (m_returnToPrimary.load(std::memory_order_relaxed) && idx != 0) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(x_clients);
+        if (!m_standbyWork) {
+            return false;
+        }
+        std::swap(p_client, p_standby);
+        std::swap(m_activeConn, m_standbyConn);
+        m_activeConnectionIdx = idx;
+        m_returnToPrimary.store(false, std::memory_order_relaxed);
+        cnote << "Switched to standby pool " << (m_activeConn->Host() + ":" + toString(m_activeConn->Port()));
+        m_farm.set_pool_addresses(m_activeConn->Host(), m_activeConn->Port());
+        // The miners go on with the job the standby pool sent last
+        m_farm.setWork(*m_standbyWork);
+        m_standbyWork.reset();
+    }
+    // The old client connects to the next pool as the new standby
+    m_standbyWait = 0;
+    activated();
+    return true;
+}
+
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <primitives/worker.h>
 #include <nrgcore/mineplant.h>
 #include <nrgcore/miner.h>
@@ -15,13 +18,18 @@ public:
                 energi::MinePlant& farm,
                 const MinerExecutionMode& minerType,
                 unsigned maxTries,
-                unsigned failovertimeout);
+                unsigned failovertimeout,
+                PoolClient* standby = nullptr);
     void addConnection(URI &conn);
     void clearConnections();
     bool start();
     void stop();
 
-    bool isConnected() { return p_client->isConnected(); };
+    bool isConnected()
+    {
+        std::lock_guard<std::mutex> lock(x_clients);
+        return p_client->isConnected();
+    };
     bool isRunning() { return m_running; };
 
 private:
@@ -30,20 +38,44 @@ private:
     // After this amount of time in minutes of mining on a failover pool return to "primary"
     unsigned m_failoverTimeout = 0;
     void check_failover_timeout(const boost::system::error_code& ec);
+    std::atomic<bool> m_returnToPrimary = { false };
+
+    void attach(PoolClient* client);
+    void activated();
+    // Keeps the standby client on the pool after the active one
+    void keepStandby();
+    // Swaps in the standby client when it is connected and has a job
+    bool promoteStandby();
 
     std::atomic<bool> m_running = { false };
     void trun() override;
+    void onStopRequested() override;
+    // Runs the loop now instead of after its one second pause
+    void wake();
+    std::mutex x_wake;
+    std::condition_variable m_wakeCondition;
+    bool m_wakeup = false;
     unsigned m_connectionAttempt = 0;
     unsigned m_maxConnectionAttempts = 0;
     unsigned m_activeConnectionIdx = 0;
     std::string m_activeConnectionHost = "";
 
-    std::vector <URI> m_connections;
-    std::thread m_workThread;
+    // Clients hold references to their URI, entries are shared so that
+    // dropping one from the list does not move the others
+    std::vector<std::shared_ptr<URI>> m_connections;
 
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_failovertimer;
+    // Roles are swapped on failover, guarded by x_clients
+    mutable std::mutex x_clients;
     PoolClient *p_client;
+    PoolClient *p_standby = nullptr;
+    std::shared_ptr<URI> m_activeConn;
+    std::shared_ptr<URI> m_standbyConn;
+    // Latest job of the standby pool, handed to the miners on a switch
+    std::unique_ptr<energi::Work> m_standbyWork;
+    // Seconds until the standby tries to connect again
+    unsigned m_standbyWait = 0;
     energi::MinePlant &m_farm;
     MinerExecutionMode m_minerType;
 };
@@ -25,7 +25,14 @@ static std::map<std::string, SchemeAttributes> s_schemes = {
        */
     {"stratum", {ProtocolFamily::STRATUM, SecureLevel::NONE, 999}},
     {"stratums", {ProtocolFamily::STRATUM, SecureLevel::TLS, 999}},
-    {"stratumss", {ProtocolFamily::STRATUM, SecureLevel::TLS12, 999}}
+    {"stratumss", {ProtocolFamily::STRATUM, SecureLevel::TLS12, 999}},
+    /*
+       Pinned modes, NRGPROXY answers subscribe exactly like ENERGISTRATUM
+       and can't be told apart by autodetection
+       */
+    {"stratum0", {ProtocolFamily::STRATUM, SecureLevel::NONE, 0}},
+    {"stratum1", {ProtocolFamily::STRATUM, SecureLevel::NONE, 1}},
+    {"stratum2", {ProtocolFamily::STRATUM, SecureLevel::NONE, 2}}
 };
 
 
@@ -0,0 +1,63 @@
+#include "SessionCapture.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+static const char* s_header = "# energiminer capture v1 ";
+
+SessionCapture::SessionCapture(const std::string& path, const std::string& protocol)
+    : m_out(path, std::ios::out | std::ios::trunc)
+    , m_start(std::chrono::steady_clock::now())
+{
+    if (!m_out) {
+        throw std::runtime_error("Could not create capture file " + path);
+    }
+    m_out << s_header << protocol << '\n';
+    m_out.flush();
+}
+
+void SessionCapture::record(Kind kind, const std::string& payload)
+{
+    using namespace std::chrono;
+    const auto us = duration_cast<microseconds>(steady_clock::now() - m_start).count();
+    std::string line = payload;
+    line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
+    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_out << us << ' ' << char(kind) << ' ' << line << '\n';
+    // Flushed per event so a capture survives the crash it is meant to explain
+    m_out.flush();
+}
+
+std::string SessionCapture::load(const std::string& path, std::vector<Event>& events)
+{
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Could not open capture file " + path);
+    }
+    std::string line;
+    const std::string header(s_header);
+    if (!std::getline(in, line) || line.compare(0, header.size(), header) != 0) {
+        throw std::runtime_error(path + " is not a session capture");
+    }
+    const std::string protocol = line.substr(header.size());
+
+    events.clear();
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        Event event;
+        std::istringstream is(line);
+        is >> event.us >> event.kind;
+        if (!is) {
+            throw std::runtime_error("Malformed capture line: " + line);
+        }
+        is.get(); // separator
+        std::getline(is, event.payload);
+        events.push_back(std::move(event));
+    }
+    return protocol;
+}
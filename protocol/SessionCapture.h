@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Records a pool session as one line per event:
+ *
+ *     <microseconds since start> <kind> <payload>
+ *
+ * kind is '<' for a line received from the pool, '>' for a line sent to it,
+ * '+' / '-' when a connection is established / dropped and '=' for the
+ * protocol mode in use. The first line names the protocol family. Timestamps
+ * come from the monotonic clock, so captures replay with their real pacing.
+ */
+class SessionCapture
+{
+public:
+    enum Kind : char
+    {
+        Received = '<',
+        Sent = '>',
+        Connected = '+',
+        Disconnected = '-',
+        Mode = '='
+    };
+
+    struct Event
+    {
+        int64_t     us;
+        char        kind;
+        std::string payload;
+    };
+
+    //! Throws std::runtime_error when the file can't be created
+    SessionCapture(const std::string& path, const std::string& protocol);
+
+    //! Thread safe, newlines in the payload are dropped
+    void record(Kind kind, const std::string& payload = std::string());
+
+    //! Reads a capture back, returns the protocol it was recorded with
+    static std::string load(const std::string& path, std::vector<Event>& events);
+
+private:
+    std::mutex m_mutex;
+    std::ofstream m_out;
+    const std::chrono::steady_clock::time_point m_start;
+};
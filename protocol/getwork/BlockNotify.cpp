@@ -0,0 +1,61 @@
+#include <stdexcept>
+
+#include "BlockNotify.h"
+#include <common/Log.h>
+
+using boost::asio::ip::udp;
+
+BlockNotify::BlockNotify(boost::asio::io_service& io, unsigned short port, const Notified& notified)
+    : m_socket(io)
+    , m_notified(notified)
+{
+    boost::system::error_code ec;
+    m_socket.open(udp::v4(), ec);
+    if (!ec) {
+        m_socket.bind(udp::endpoint(boost::asio::ip::address_v4::loopback(), port), ec);
+    }
+    if (ec) {
+        throw std::runtime_error("Can't listen for block notifications on port " + std::to_string(port) +
+                                 ": " + ec.message());
+    }
+    cnote << "Listening for block notifications on 127.0.0.1:" << port;
+    receive();
+}
+
+BlockNotify::~BlockNotify()
+{
+    boost::system::error_code ec;
+    m_socket.close(ec);
+}
+
+void BlockNotify::receive()
+{
+    m_socket.async_receive_from(boost::asio::buffer(m_buffer), m_sender,
+            [this](const boost::system::error_code& ec, std::size_t size) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            const auto received = std::chrono::steady_clock::now();
+            std::string hash(m_buffer.data(), size);
+            while (!hash.empty() && (hash.back() == '\n' || hash.back() == '\r' || hash.back() == ' ')) {
+                hash.pop_back();
+            }
+            m_notified(hash, received);
+        }
+        receive();
+    });
+}
+
+bool BlockNotify::send(unsigned short port, const std::string& hash)
+{
+    boost::asio::io_service io;
+    udp::socket socket(io);
+    boost::system::error_code ec;
+    socket.open(udp::v4(), ec);
+    if (!ec) {
+        socket.send_to(boost::asio::buffer(hash),
+                       udp::endpoint(boost::asio::ip::address_v4::loopback(), port), 0, ec);
+    }
+    return !ec;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include <boost/asio.hpp>
+
+/**
+ * Listens on 127.0.0.1 for new block announcements from a local node.
+ *
+ * Every UDP datagram received is one announcement, its text, if any, the
+ * block hash. energid can send them itself with
+ *
+ *     blocknotify=energiminer --send-block-notify <port> %s
+ *
+ * or any tool that writes a datagram to the port. Announcements arriving
+ * in a burst, as during a reorg, are all passed on; the receiver coalesces.
+ */
+class BlockNotify
+{
+public:
+    using Notified = std::function<void(const std::string& hash,
+                                        std::chrono::steady_clock::time_point received)>;
+
+    //! Throws std::runtime_error when the port can't be bound
+    BlockNotify(boost::asio::io_service& io, unsigned short port, const Notified& notified);
+    ~BlockNotify();
+
+    //! Sends one announcement, for the --send-block-notify side. False on failure.
+    static bool send(unsigned short port, const std::string& hash);
+
+private:
+    void receive();
+
+    boost::asio::ip::udp::socket m_socket;
+    boost::asio::ip::udp::endpoint m_sender;
+    std::array<char, 256> m_buffer;
+    Notified m_notified;
+};
@@ -1,7 +1,7 @@
 #include <chrono>
+#include <thread>
 #include <boost/algorithm/string.hpp>
 #include <boost/exception/diagnostic_information.hpp>
-#include <jsonrpccpp/client/connectors/httpclient.h>
 #include <jsonrpccpp/client.h>
 
 #include "GetworkClient.h"
@@ -9,6 +9,16 @@
 
 using namespace energi;
 
+namespace
+{
+
+// As libjson-rpc-cpp's HttpClient had it
+const std::chrono::milliseconds c_requestTimeout{10000};
+// Nodes hold a long-poll until the template changes, this only notices a dead connection
+const std::chrono::milliseconds c_longPollTimeout{120000};
+
+} // namespace
+
 GetworkClient::GetworkClient(unsigned const & farmRecheckPeriod, const std::string& coinbase)
     : PoolClient()
     , Worker("getwork")
@@ -20,7 +30,29 @@ GetworkClient::GetworkClient(unsigned const & farmRecheckPeriod, const std::stri
 }
 
 GetworkClient::~GetworkClient()
-{}
+{
+    stopWorking();
+}
+
+void GetworkClient::onStopRequested()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_poll) {
+            m_poll->cancel();
+        }
+    }
+    m_cvwait.notify_all();
+}
+
+std::shared_ptr<HttpSession> GetworkClient::session(std::shared_ptr<HttpSession>& current, std::string& url)
+{
+    if (!current || url != m_url || current->cancelled()) {
+        current = std::make_shared<HttpSession>(*m_conn);
+        url = m_url;
+    }
+    return current;
+}
 
 void GetworkClient::connect()
 {
@@ -32,8 +64,15 @@ void GetworkClient::connect()
 
     m_url = uri;
     m_display_url = boost::replace_first_copy(uri, m_conn->Pass(), "<password>");
+    if (m_poll && m_pollUrl != m_url) {
+        // Don't sit in a long-poll on the node we switched away from
+        m_poll->cancel();
+    }
 
     m_connected.store(true, std::memory_order_release);
+    if (m_capture) {
+        m_capture->record(SessionCapture::Connected, m_display_url);
+    }
 
     // No need to worry about starting again.
     // Worker class prevents that
@@ -44,6 +83,9 @@ void GetworkClient::disconnect()
 {
     std::lock_guard<std::mutex> lock(m_mutex);
     m_connected.store(false, std::memory_order_release);
+    if (m_capture) {
+        m_capture->record(SessionCapture::Disconnected);
+    }
 
 	// Since we do not have a real connected state with getwork, we just fake it.
 	if (m_onDisconnected) {
@@ -55,85 +97,197 @@ void GetworkClient::submitHashrate(const std::string& rate)
 {
 }
 
-void GetworkClient::submitSolution(const Solution& solution)
+void GetworkClient::capture(const std::string& method, const Json::Value& params)
 {
-    do {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_capture) {
+        Json::Value request;
+        request["method"] = method;
+        request["params"] = params;
+        m_capture->record(SessionCapture::Sent, Json::FastWriter().write(request));
+    }
+}
 
-        //---
-        if (!m_have_work) {
-            break;
-        }
-        
-        if (m_onResetWork) {
-            m_onResetWork();
+void GetworkClient::addSubmitNode(const URI& node)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_submitNodes.push_back(SubmitNode{node.Host() + ":" + std::to_string(node.Port()),
+                                       std::make_shared<HttpSession>(node),
+                                       std::make_shared<std::mutex>()});
+}
+
+GetworkClient::SubmitResult GetworkClient::submitTo(SubmitNode& node, const Json::Value& params)
+{
+    SubmitResult submitted;
+    const auto start = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(*node.busy);
+    try {
+        submitted.reply = node.http->call("submitblock", params, c_requestTimeout);
+        submitted.answered = true;
+        if (!submitted.reply.isNull()) {
+            submitted.reason = submitted.reply.isString() ? submitted.reply.asString()
+                                                          : Json::FastWriter().write(submitted.reply);
+            boost::trim_right(submitted.reason);
         }
-        
-        m_have_work = false;
+    } catch (const jsonrpc::JsonRpcException& ex) {
+        // RPC errors are the node's verdict, only a lost connection leaves the block unsent
+        submitted.answered = !node.http->lastError();
+        submitted.reason = ex.GetMessage();
+    }
+    submitted.delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    return submitted;
+}
+
+bool GetworkClient::submitSolution(const Solution& solution)
+{
+    std::vector<SubmitNode> nodes;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
 
         //---
-        if (!m_connected.load(std::memory_order_relaxed)) {
-            break;
-        }
+        if (m_have_work) {
+            if (m_onResetWork) {
+                m_onResetWork();
+            }
+            m_have_work = false;
 
-        try {
-            jsonrpc::HttpClient http_client(m_url);
-            jsonrpc::Client client(http_client, jsonrpc::JSONRPC_CLIENT_V1);
-            
-            Json::Value params(Json::arrayValue);
-            auto block = solution.getSubmitBlockData();
-            params.append(block);
+            if (m_connected.load(std::memory_order_relaxed)) {
+                nodes.push_back(SubmitNode{m_conn->Host() + ":" + std::to_string(m_conn->Port()),
+                                           session(m_submit, m_submitUrl), m_submitBusy});
+                nodes.insert(nodes.end(), m_submitNodes.begin(), m_submitNodes.end());
+            }
+        }
+    }
+    if (nodes.empty()) {
+        m_cvwait.notify_one();
+        return true;
+    }
 
+    auto params = std::make_shared<Json::Value>(Json::arrayValue);
+    params->append(solution.getSubmitBlockData());
+    capture("submitblock", *params);
+
+    // Every node gets the block at once, the first one to take it decides.
+    // The senders only share fanOut with us, so a slow node can finish after
+    // we returned.
+    auto fanOut = std::make_shared<FanOut>();
+    fanOut->results.resize(nodes.size());
+    fanOut->pending = nodes.size();
+    const bool several = nodes.size() > 1;
+    auto sessionCapture = m_capture;
+    auto send = [fanOut, params, sessionCapture, several](SubmitNode node, size_t index) {
+        SubmitResult submitted = submitTo(node, *params);
+        if (several) {
+            cnote << "Block sent to " << node.name << ": "
+                  << (submitted.accepted() ? "accepted" : submitted.answered ? "rejected " : "failed ")
+                  << submitted.reason << " in " << submitted.delay.count() << " ms";
+        }
+        if (index == 0 && submitted.answered && sessionCapture) {
+            // The template node's reply, as capture() records requests
+            Json::Value response;
+            response["result"] = submitted.reply;
+            sessionCapture->record(SessionCapture::Received, Json::FastWriter().write(response));
+        }
+        std::lock_guard<std::mutex> lock(fanOut->x_results);
+        if (submitted.accepted() && fanOut->first < 0) {
+            fanOut->first = int(index);
+        }
+        fanOut->results[index] = std::move(submitted);
+        --fanOut->pending;
+        fanOut->changed.notify_all();
+    };
 
-            //---
-            std::chrono::steady_clock::time_point submit_start = std::chrono::steady_clock::now();
+    if (!several) {
+        send(nodes[0], 0);
+    } else {
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            std::thread(send, nodes[i], i).detach();
+        }
+    }
 
-            Json::Value result = client.CallMethod("submitblock", params);
+    SubmitResult result;
+    bool delivered = false;
+    std::vector<SubmitResult> results;
+    {
+        std::unique_lock<std::mutex> lock(fanOut->x_results);
+        fanOut->changed.wait(lock, [&]() { return fanOut->first >= 0 || fanOut->pending == 0; });
+        int decided = fanOut->first;
+        if (decided < 0) {
+            // Nobody took it, the template node has the say when it answered
+            for (size_t i = 0; i < fanOut->results.size() && decided < 0; ++i) {
+                if (fanOut->results[i].answered) {
+                    decided = int(i);
+                }
+            }
+        }
+        if (decided >= 0) {
+            result = fanOut->results[decided];
+            delivered = true;
+        } else {
+            results = fanOut->results;
+        }
+    }
 
-            std::chrono::milliseconds response_delay_ms =
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                        std::chrono::steady_clock::now() - submit_start);
-            
-            //---
-            auto resultStr = result.toStyledString();
-            resultStr.pop_back(); // includes a newline
-            
-            if (resultStr == "null") {
-                cnote << "Block Accepted";
-            } else if (resultStr == "inconclusive") {
+    //---
+    if (delivered) {
+        // Stragglers only log, the result is final
+        if (result.accepted()) {
+            cnote << "Block Accepted";
+            if (m_onSolutionAccepted) {
+                m_onSolutionAccepted(false, result.delay);
+            }
+        } else {
+            if (result.reason == "inconclusive") {
                 cnote << "Block too old";
             } else {
-                cnote << "Block Rejected:" << resultStr;
+                cnote << "Block Rejected:" << result.reason;
             }
-
-            //---
-            bool accepted = (resultStr == "null");
-
-            if (accepted) {
-                if (m_onSolutionAccepted) {
-                    m_onSolutionAccepted(false, response_delay_ms);
-                }
-            } else {
-                if (m_onSolutionRejected) {
-                    m_onSolutionRejected(false, response_delay_ms);
-                }
+            if (m_onSolutionRejected) {
+                m_onSolutionRejected(false, result.delay);
             }
-        } catch (const jsonrpc::JsonRpcException& ex) {
-            cwarn << "Failed to submit solution.";
-            cwarn << boost::diagnostic_information(ex);
         }
-    } while (false);
+    }
 
+    if (!delivered) {
+        cwarn << "Failed to submit solution.";
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            cwarn << nodes[i].name << ": " << results[i].reason;
+        }
+        // Keep the block around so the submit queue can retry it
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_have_work = true;
+    }
     m_cvwait.notify_one();
+    return delivered;
+}
+
+
+void GetworkClient::blockNotified(const std::string& hash, std::chrono::steady_clock::time_point received)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_notified) {
+            // A burst is answered by one fetch, timed from its first announcement
+            m_notified = true;
+            m_notifiedAt = received;
+        }
+        m_notifiedHash = hash;
+    }
+    m_cvwait.notify_all();
 }
 
+void GetworkClient::notifyLatency(const std::string& hash, std::chrono::steady_clock::time_point notifiedAt)
+{
+    const auto latency = std::chrono::steady_clock::now() - notifiedAt;
+    m_notifyLatency.add(std::chrono::duration_cast<std::chrono::milliseconds>(latency));
+    m_notifyLatencyHash = hash;
+    cnote << "Block " << hash << " notified, new job after "
+          << std::chrono::duration_cast<std::chrono::microseconds>(latency).count() << " us";
+}
 
 // Handles all getwork communication.
 void GetworkClient::trun()
 {
-    jsonrpc::HttpClient http_client(m_url);
-    jsonrpc::Client client(http_client, jsonrpc::JSONRPC_CLIENT_V1);
-    
     // Since we do not have a real connected state with getwork, we just fake it
     if (m_onConnected) {
         m_onConnected();
@@ -144,12 +298,30 @@ void GetworkClient::trun()
     const std::chrono::milliseconds nowork_delay{
         m_farmRecheckPeriod > NOWORK_DIV ? m_farmRecheckPeriod / NOWORK_DIV : m_farmRecheckPeriod
     };
+    const auto wake = [this]() { return shouldStop() || m_notified; };
     energi::Work current_work;
+    std::shared_ptr<HttpSession> http;
+    std::string longpollid;
 
     while (!shouldStop()) {
-        if (!m_connected.load(std::memory_order_relaxed)) {
+        bool notified = false;
+        std::chrono::steady_clock::time_point notifiedAt;
+        std::string notifiedHash;
+        {
             std::unique_lock<std::mutex> lock(m_mutex);
-            m_cvwait.wait_for(lock, farm_recheck);
+            if (!m_connected.load(std::memory_order_relaxed)) {
+                m_cvwait.wait_for(lock, farm_recheck, wake);
+            }
+            auto current = session(m_poll, m_pollUrl);
+            if (current != http) {
+                // A long-poll id only means something to the node that gave it out
+                http = current;
+                longpollid.clear();
+            }
+            // The template fetched next answers every announcement so far
+            std::swap(notified, m_notified);
+            notifiedAt = m_notifiedAt;
+            notifiedHash = m_notifiedHash;
         }
 
         try {
@@ -161,9 +333,42 @@ void GetworkClient::trun()
             object["capabilities"].append("coinbasevalue");
             object["capabilities"].append("longpoll");
             object["capabilities"].append("workid");
+            const bool longPoll = !longpollid.empty() && !notified;
+            if (longPoll) {
+                // The node answers once the template changed
+                object["longpollid"] = longpollid;
+            }
             params.append(object);
 
-            Json::Value workGBT = client.CallMethod("getblocktemplate", params);
+            capture("getblocktemplate", params);
+            // The template is read while it arrives, its transactions never
+            // go through a Json::Value
+            std::string body;
+            m_parser.reset(&m_templates.transactions);
+            unsigned status = 0;
+            try {
+                status = http->call("getblocktemplate", params,
+                                    longPoll ? c_longPollTimeout : c_requestTimeout,
+                                    [this, &body](const char* data, size_t size) {
+                    if (m_capture) {
+                        body.append(data, size);
+                    }
+                    return m_parser.feed(data, size);
+                });
+            } catch (const jsonrpc::JsonRpcException&) {
+                if (!m_parser.error().empty()) {
+                    throw WorkException(m_parser.error());
+                }
+                throw;
+            }
+            if (m_capture) {
+                m_capture->record(SessionCapture::Received, body);
+            }
+            if (!m_parser.complete()) {
+                throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE,
+                                                "HTTP " + std::to_string(status) + " incomplete reply");
+            }
+            const Json::Value& workGBT = HttpSession::result(m_parser.reply(), status);
 
             if (!workGBT.isObject() ) {
                 throw jsonrpc::JsonRpcException(
@@ -171,33 +376,82 @@ void GetworkClient::trun()
                         workGBT.toStyledString());
             }
 
+            // Nodes without long-poll support leave the id out and keep being
+            // polled. One that hands back the id it was asked with gave up
+            // waiting, so it is not asked again right away either.
+            const std::string nextLongpollid = workGBT.get("longpollid", "").asString();
+            const bool waited = nextLongpollid.empty() || (longPoll && nextLongpollid == longpollid);
+            longpollid = nextLongpollid;
+
             //---
-            auto new_work = energi::Work(workGBT, m_coinbase);
+            auto new_work = energi::Work(workGBT, m_parser.takeTransactions(), m_coinbase, &m_templates);
             
             std::unique_lock<std::mutex> lock(m_mutex);
 
-            if (current_work != new_work) {
+            const bool newTip = !current_work.sameTip(new_work);
+            // Same tip, but the node found transactions paying more fees
+            const bool richer = !newTip && current_work.isValid() &&
+                new_work.merkleBranch != current_work.merkleBranch &&
+                new_work.txCoinbase.GetValueOut() > current_work.txCoinbase.GetValueOut();
+            if (newTip || richer) {
                 if (m_onWorkReceived) {
                     current_work = new_work;
                     m_have_work = true;
 
-                    cnote << "Difficulty set to: " << new_work.hashTarget.GetHex();
+                    if (newTip) {
+                        cnote << "Difficulty set to: " << new_work.hashTarget.GetHex();
+                    }
+                    cnote << "Block template: " << m_templates.ToString();
                     m_onWorkReceived(new_work);
+                    if (notified) {
+                        notifyLatency(notifiedHash, notifiedAt);
+                    }
                 }
-            } else if (m_have_work) {
-                m_cvwait.wait_for(lock, farm_recheck);
-            } else {
-                m_cvwait.wait_for(lock, nowork_delay);
+            } else if (notified && current_work.hashPrevBlock.GetHex() == notifiedHash &&
+                       notifiedHash != m_notifyLatencyHash) {
+                // A long-poll brought the block's job in before the announcement
+                notifyLatency(notifiedHash, notifiedAt);
+            }
+            if (!newTip && waited) {
+                // Unless the long-poll already did
+                m_cvwait.wait_for(lock, m_have_work ? farm_recheck : nowork_delay, wake);
+            }
+        } catch (const jsonrpc::JsonRpcException& ex) {
+            if (shouldStop() || http->cancelled()) {
+                // Stopping, or connect() moved us to another node
+                continue;
+            }
+            if (!longpollid.empty() && http->lastError() == boost::asio::error::timed_out) {
+                // Nothing changed for a long time, ask again
+                continue;
             }
-        } catch (jsonrpc::JsonRpcException ex) {
             cwarn << "Failed getting work! ";
             cwarn << boost::diagnostic_information(ex);
+            longpollid.clear();
 
             if (m_onResetWork) {
                 m_onResetWork();
             }
+
+            // Don't hammer a node that is down
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cvwait.wait_for(lock, farm_recheck, wake);
+        } catch (const WorkException& ex) {
+            cwarn << "Unusable block template: " << ex.what();
+            longpollid.clear();
+
+            if (m_onResetWork) {
+                m_onResetWork();
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cvwait.wait_for(lock, farm_recheck, wake);
         }
     }
 
+    if (m_notifyLatency.count()) {
+        cnote << "Block notify to new job: " << m_notifyLatency.ToString() << " over "
+              << m_notifyLatency.count() << " blocks";
+    }
     disconnect();
 }
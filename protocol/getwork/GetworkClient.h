@@ -3,9 +3,13 @@
 #include <iostream>
 #include <memory>
 #include <condition_variable>
+#include <vector>
 
+#include <common/LatencyHistogram.h>
 #include <primitives/worker.h>
 #include "../PoolClient.h"
+#include "HttpSession.h"
+#include "TemplateParser.h"
 
 class GetworkClient : public PoolClient, energi::Worker
 {
@@ -22,10 +26,54 @@ public:
     std::string ActiveEndPoint() override { return m_display_url; };
 
 	void submitHashrate(const std::string& rate) override;
-	void submitSolution(const energi::Solution& solution) override;
+	bool submitSolution(const energi::Solution& solution) override;
+
+	// A new block was announced by the node (see BlockNotify), fetch its template now
+	void blockNotified(const std::string& hash, std::chrono::steady_clock::time_point received);
+
+	// Found blocks also go to this node, at the same time as to the one
+	// templates come from. Call before connect().
+	void addSubmitNode(const URI& node);
 
 private:
+	struct SubmitNode
+	{
+	    std::string name; // host:port, for the log
+	    std::shared_ptr<HttpSession> http;
+	    // A send still running from the last block keeps the session until done
+	    std::shared_ptr<std::mutex> busy;
+	};
+
+	struct SubmitResult
+	{
+	    bool answered = false; // false when the block never reached the node
+	    Json::Value reply;
+	    std::string reason;    // why it was refused or not sent, empty when taken
+	    std::chrono::milliseconds delay{0};
+
+	    // A node that already has the block got it from a faster one
+	    bool accepted() const { return answered && (reason.empty() || reason == "duplicate"); }
+	};
+
+	// Outcome of one block sent to several nodes, outlives the submit when a node is slow
+	struct FanOut
+	{
+	    std::mutex x_results;
+	    std::condition_variable changed;
+	    std::vector<SubmitResult> results;
+	    size_t pending = 0;
+	    int first = -1; // node that took the block first
+	};
+
+	static SubmitResult submitTo(SubmitNode& node, const Json::Value& params);
+
 	void trun() override;
+	void onStopRequested() override;
+	// Records a request when a capture is set
+	void capture(const std::string& method, const Json::Value& params);
+	// Session for the node in m_url, made anew when that changed. Call with m_mutex held.
+	std::shared_ptr<HttpSession> session(std::shared_ptr<HttpSession>& current, std::string& url);
+	void notifyLatency(const std::string& hash, std::chrono::steady_clock::time_point notifiedAt);
 	unsigned m_farmRecheckPeriod = 500;
 
     std::string m_coinbase;
@@ -35,4 +83,25 @@ private:
     std::mutex m_mutex;
     std::condition_variable m_cvwait;
     bool m_have_work = false;
+
+    // Templates and submits go over separate kept alive connections, so a
+    // block never waits behind a long-poll
+    std::shared_ptr<HttpSession> m_poll;
+    std::shared_ptr<HttpSession> m_submit;
+    std::shared_ptr<std::mutex> m_submitBusy = std::make_shared<std::mutex>();
+    std::string m_pollUrl;
+    std::string m_submitUrl;
+    // Further nodes found blocks are sent to
+    std::vector<SubmitNode> m_submitNodes;
+
+    // Announcements not yet answered by a template fetch
+    bool m_notified = false;
+    std::chrono::steady_clock::time_point m_notifiedAt;
+    std::string m_notifiedHash;
+    energi::LatencyHistogram m_notifyLatency;
+    std::string m_notifyLatencyHash; // block last counted, bursts repeat it
+
+    // Transactions and merkle tree of the last template, used by trun() only
+    energi::TemplateCache m_templates;
+    TemplateParser m_parser;
 };
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include <jsonrpccpp/client.h>
+
+#include "HttpSession.h"
+#include "../PoolURI.h"
+#include <common/utilstrencodings.h>
+
+using boost::asio::ip::tcp;
+
+namespace
+{
+
+// Bytes of a body read at a time
+const size_t c_bodyChunk = 64 * 1024;
+
+} // namespace
+
+HttpSession::HttpSession(const URI& uri)
+    : m_host(uri.Host())
+    , m_port(std::to_string(uri.Port()))
+    , m_path(uri.Path().empty() ? "/" : uri.Path())
+    , m_resolver(m_io)
+    , m_socket(m_io)
+    , m_deadline(m_io)
+{
+    if (!uri.User().empty()) {
+        m_authorization = "Authorization: Basic " + EncodeBase64(uri.User() + ":" + uri.Pass()) + "\r\n";
+    }
+}
+
+HttpSession::~HttpSession()
+{
+    close();
+}
+
+void HttpSession::cancel()
+{
+    m_cancelled.store(true, std::memory_order_release);
+    // Runs on the calling thread of call(), or at its next call
+    m_io.post([this]() {
+        m_resolver.cancel();
+        close();
+    });
+}
+
+void HttpSession::close()
+{
+    boost::system::error_code ec;
+    m_socket.shutdown(tcp::socket::shutdown_both, ec);
+    m_socket.close(ec);
+    m_recvBuffer.consume(m_recvBuffer.size());
+    m_keepAlive = false;
+}
+
+Json::Value HttpSession::call(const std::string& method, const Json::Value& params,
+                              std::chrono::milliseconds timeout)
+{
+    std::string body;
+    const unsigned status = call(method, params, timeout, [&body](const char* data, size_t size) {
+        body.append(data, size);
+        return true;
+    });
+
+    Json::Value reply;
+    if (!Json::Reader().parse(body, reply) || !reply.isObject()) {
+        throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE,
+                                        "HTTP " + std::to_string(status) + " " + body.substr(0, 256));
+    }
+    return result(reply, status);
+}
+
+const Json::Value& HttpSession::result(const Json::Value& reply, unsigned status)
+{
+    // bitcoind style nodes answer RPC errors with a 500 and the error in the body
+    const Json::Value& error = reply["error"];
+    if (!error.isNull()) {
+        throw jsonrpc::JsonRpcException(error.get("code", jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE).asInt(),
+                                        error.get("message", "").asString());
+    }
+    if (status != 200) {
+        throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE,
+                                        "HTTP " + std::to_string(status));
+    }
+    return reply["result"];
+}
+
+unsigned HttpSession::call(const std::string& method, const Json::Value& params,
+                           std::chrono::milliseconds timeout, const BodySink& sink)
+{
+    if (cancelled()) {
+        throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_CONNECTOR, "Request cancelled");
+    }
+
+    Json::Value request;
+    request["id"] = m_nextId++;
+    request["method"] = method;
+    request["params"] = params;
+    const std::string content = Json::FastWriter().write(request);
+
+    const std::string message = "POST " + m_path + " HTTP/1.1\r\n"
+        "Host: " + m_host + ":" + m_port + "\r\n" +
+        m_authorization +
+        "Content-Type: application/json\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Length: " + std::to_string(content.size()) + "\r\n\r\n" + content;
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    unsigned status = 0;
+    const bool reused = m_socket.is_open();
+    m_sink = &sink;
+    m_delivered = false;
+    auto ec = exchange(message, status, deadline);
+    if (ec && reused && !m_delivered && !cancelled() && ec != boost::asio::error::timed_out) {
+        // The node closed the idle connection since the last call
+        close();
+        ec = exchange(message, status, deadline);
+    }
+    m_sink = nullptr;
+    m_lastError = ec;
+    if (ec == boost::system::errc::bad_message) {
+        throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE,
+                                        m_host + ":" + m_port + " reply refused");
+    }
+    if (ec) {
+        throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_CONNECTOR,
+                                        m_host + ":" + m_port + " " + ec.message());
+    }
+    return status;
+}
+
+boost::system::error_code HttpSession::exchange(const std::string& request, unsigned& status,
+                                                std::chrono::steady_clock::time_point deadline)
+{
+    boost::system::error_code result = boost::asio::error::would_block;
+
+    m_io.reset();
+    m_deadline.expires_at(deadline);
+    m_deadline.async_wait([this, &result](const boost::system::error_code& ec) {
+        if (!ec && result == boost::asio::error::would_block) {
+            result = boost::asio::error::timed_out;
+            m_resolver.cancel();
+            close();
+        }
+    });
+
+    if (m_socket.is_open()) {
+        send(request, status, result);
+    } else {
+        connect(request, status, result);
+    }
+    m_io.run();
+    return result;
+}
+
+void HttpSession::connect(const std::string& request, unsigned& status,
+                          boost::system::error_code& result)
+{
+    m_resolver.async_resolve(tcp::resolver::query(m_host, m_port),
+            [this, &request, &status, &result](const boost::system::error_code& ec,
+                                               tcp::resolver::iterator it) {
+        if (ec || cancelled()) {
+            finish(result, ec);
+            return;
+        }
+        boost::asio::async_connect(m_socket, it,
+                [this, &request, &status, &result](const boost::system::error_code& ec,
+                                                   tcp::resolver::iterator) {
+            if (ec || cancelled()) {
+                finish(result, ec);
+                return;
+            }
+            boost::system::error_code ignored;
+            m_socket.set_option(tcp::no_delay(true), ignored);
+            ++m_connections;
+            send(request, status, result);
+        });
+    });
+}
+
+void HttpSession::send(const std::string& request, unsigned& status,
+                       boost::system::error_code& result)
+{
+    boost::asio::async_write(m_socket, boost::asio::buffer(request),
+            [this, &status, &result](const boost::system::error_code& ec, std::size_t) {
+        if (ec || cancelled()) {
+            finish(result, ec);
+            return;
+        }
+        boost::asio::async_read_until(m_socket, m_recvBuffer, "\r\n\r\n",
+                [this, &status, &result](const boost::system::error_code& ec, std::size_t headerSize) {
+            if (ec || cancelled()) {
+                finish(result, ec);
+                return;
+            }
+            std::string headers(boost::asio::buffers_begin(m_recvBuffer.data()),
+                                boost::asio::buffers_begin(m_recvBuffer.data()) + headerSize);
+            m_recvBuffer.consume(headerSize);
+            std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+            m_keepAlive = true;
+
+            // "http/1.1 200 ok"
+            status = headers.compare(0, 5, "http/") == 0 && headers.size() > 12
+                ? unsigned(std::strtoul(headers.c_str() + 9, nullptr, 10)) : 0;
+            if (!status || headers.find("transfer-encoding: chunked") != std::string::npos) {
+                finish(result, boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+                return;
+            }
+            if (headers.find("connection: close") != std::string::npos ||
+                (headers.compare(0, 8, "http/1.0") == 0 &&
+                 headers.find("connection: keep-alive") == std::string::npos)) {
+                m_keepAlive = false;
+            }
+
+            size_t length = 0;
+            const auto pos = headers.find("content-length:");
+            if (pos != std::string::npos) {
+                length = std::strtoul(headers.c_str() + pos + 15, nullptr, 10);
+            } else {
+                m_keepAlive = false;
+            }
+            readBody(length, pos == std::string::npos, result);
+        });
+    });
+}
+
+void HttpSession::readBody(size_t remaining, bool untilClose, boost::system::error_code& result)
+{
+    // Handed over as it arrives, starting with what came along with the headers
+    const size_t buffered = untilClose ? m_recvBuffer.size() : std::min(remaining, m_recvBuffer.size());
+    if (buffered) {
+        m_delivered = true;
+        const bool taken = (*m_sink)(boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), buffered);
+        m_recvBuffer.consume(buffered);
+        if (!taken) {
+            finish(result, boost::system::errc::make_error_code(boost::system::errc::bad_message));
+            return;
+        }
+        if (!untilClose) {
+            remaining -= buffered;
+        }
+    }
+    if (!untilClose && remaining == 0) {
+        finish(result, boost::system::error_code());
+        return;
+    }
+
+    m_socket.async_read_some(m_recvBuffer.prepare(untilClose ? c_bodyChunk : std::min(remaining, c_bodyChunk)),
+            [this, remaining, untilClose, &result](const boost::system::error_code& ec, std::size_t size) {
+        if (untilClose && ec == boost::asio::error::eof) {
+            finish(result, boost::system::error_code());
+            return;
+        }
+        if (ec) {
+            finish(result, ec);
+            return;
+        }
+        m_recvBuffer.commit(size);
+        readBody(remaining, untilClose, result);
+    });
+}
+
+void HttpSession::finish(boost::system::error_code& result, const boost::system::error_code& ec)
+{
+    if (result == boost::asio::error::would_block) {
+        result = ec ? ec : (cancelled() ? boost::asio::error::operation_aborted : ec);
+    }
+    boost::system::error_code ignored;
+    m_deadline.cancel(ignored);
+    if (result || !m_keepAlive) {
+        close();
+    }
+}
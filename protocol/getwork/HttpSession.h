@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <json/json.h>
+
+class URI;
+
+/**
+ * JSON-RPC over one kept alive HTTP/1.1 connection to a node.
+ *
+ * Calls block the calling thread, one at a time, until the reply arrived or
+ * the timeout passed. The connection is opened on the first call and reused
+ * by the following ones; when the node closed it in between, the call is
+ * retried once on a new connection. cancel() may be called from any thread
+ * and makes the call in progress, and all later ones, fail right away, which
+ * is what lets a long-poll be interrupted.
+ *
+ * Errors are thrown as jsonrpc::JsonRpcException, like libjson-rpc-cpp does.
+ * A reply can also be handed over piece by piece while it arrives, for
+ * bodies too large to be worth keeping whole (see TemplateParser).
+ */
+class HttpSession
+{
+public:
+    //! Takes the next piece of a body, false drops the reply and the connection
+    using BodySink = std::function<bool(const char* data, size_t size)>;
+
+    explicit HttpSession(const URI& uri);
+    ~HttpSession();
+
+    HttpSession(const HttpSession&) = delete;
+    HttpSession& operator=(const HttpSession&) = delete;
+
+    Json::Value call(const std::string& method, const Json::Value& params,
+                     std::chrono::milliseconds timeout);
+
+    //! Streams the body of the reply to sink instead and returns the HTTP
+    //! status. Reading the reply is left to the sink, RPC errors included.
+    unsigned call(const std::string& method, const Json::Value& params,
+                  std::chrono::milliseconds timeout, const BodySink& sink);
+
+    //! result member of a JSON-RPC reply, throws the error it carries or for a bad status
+    static const Json::Value& result(const Json::Value& reply, unsigned status);
+
+    void cancel();
+
+    bool cancelled() const
+    {
+        return m_cancelled.load(std::memory_order_acquire);
+    }
+
+    //! Transport error of the last failed call, timed_out when it ran out of time
+    boost::system::error_code lastError() const
+    {
+        return m_lastError;
+    }
+
+    //! Connections opened so far, 1 as long as keep-alive holds
+    unsigned connections() const
+    {
+        return m_connections;
+    }
+
+private:
+    boost::system::error_code exchange(const std::string& request, unsigned& status,
+                                       std::chrono::steady_clock::time_point deadline);
+    void connect(const std::string& request, unsigned& status,
+                 boost::system::error_code& result);
+    void send(const std::string& request, unsigned& status,
+              boost::system::error_code& result);
+    void readBody(size_t remaining, bool untilClose, boost::system::error_code& result);
+    void finish(boost::system::error_code& result, const boost::system::error_code& ec);
+    void close();
+
+    const std::string m_host;
+    const std::string m_port;
+    const std::string m_path;
+    std::string m_authorization;
+
+    boost::asio::io_service m_io;
+    boost::asio::ip::tcp::resolver m_resolver;
+    boost::asio::ip::tcp::socket m_socket;
+    boost::asio::steady_timer m_deadline;
+    boost::asio::streambuf m_recvBuffer;
+
+    bool m_keepAlive = false;
+    unsigned m_connections = 0;
+    unsigned m_nextId = 1;
+    boost::system::error_code m_lastError;
+    const BodySink* m_sink = nullptr; // of the call in progress
+    bool m_delivered = false;         // some of its body went to the sink
+    std::atomic<bool> m_cancelled = { false };
+};
@@ -0,0 +1,426 @@
+#include "TemplateParser.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+// Deepest nesting accepted, templates never come close
+const size_t c_maxDepth = 32;
+// Longest string outside the transaction list
+const size_t c_maxText = 1 << 20;
+// Longest number or literal
+const size_t c_maxLiteral = 64;
+
+bool space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool literalChar(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' ||
+           c == 'E';
+}
+
+void appendUtf8(std::string& out, unsigned code)
+{
+    if (code < 0x80) {
+        out += char(code);
+    } else if (code < 0x800) {
+        out += char(0xc0 | (code >> 6));
+        out += char(0x80 | (code & 0x3f));
+    } else {
+        out += char(0xe0 | (code >> 12));
+        out += char(0x80 | ((code >> 6) & 0x3f));
+        out += char(0x80 | (code & 0x3f));
+    }
+}
+
+} // namespace
+
+void TemplateParser::reset(RawTransactionCache* cache)
+{
+    m_state = Value;
+    m_error.clear();
+    m_reply = Json::Value();
+    m_frames.clear();
+    m_role = Dom;
+    m_target = nullptr;
+    m_key = false;
+    m_text.clear();
+    m_name.clear();
+    m_cache = cache;
+    m_transactions.clear();
+    m_hex = std::make_shared<std::string>();
+    m_txBegin = 0;
+    m_txData = false;
+    m_txid.clear();
+    m_txHash.clear();
+}
+
+energi::TemplateTransactions TemplateParser::takeTransactions()
+{
+    energi::TemplateTransactions taken;
+    taken.transactions = std::move(m_transactions);
+    taken.hex = std::move(m_hex);
+    m_transactions.clear();
+    return taken;
+}
+
+bool TemplateParser::fail(const char* why)
+{
+    m_state = Failed;
+    m_error = why;
+    return false;
+}
+
+bool TemplateParser::feed(const char* data, size_t size)
+{
+    const char* p = data;
+    const char* const end = data + size;
+    while (p != end) {
+        switch (m_state) {
+        case Failed:
+            return false;
+
+        case String: {
+            // Plain characters are taken a run at a time
+            const char* run = p;
+            while (p != end && *p != '"' && *p != '\\') {
+                ++p;
+            }
+            if (!appendText(run, p - run)) {
+                return false;
+            }
+            if (p != end) {
+                if (*p++ == '"') {
+                    if (!endString()) {
+                        return false;
+                    }
+                } else {
+                    m_state = Escape;
+                }
+            }
+            break;
+        }
+
+        case Escape: {
+            if (!m_key && m_role == TxData) {
+                return fail("Malformed template transaction");
+            }
+            char plain;
+            switch (*p++) {
+            case '"':  plain = '"';  break;
+            case '\\': plain = '\\'; break;
+            case '/':  plain = '/';  break;
+            case 'b':  plain = '\b'; break;
+            case 'f':  plain = '\f'; break;
+            case 'n':  plain = '\n'; break;
+            case 'r':  plain = '\r'; break;
+            case 't':  plain = '\t'; break;
+            case 'u':
+                m_unicode = 0;
+                m_unicodeDigits = 0;
+                m_state = Unicode;
+                continue;
+            default:
+                return fail("Bad escape in string");
+            }
+            if (!appendText(&plain, 1)) {
+                return false;
+            }
+            m_state = String;
+            break;
+        }
+
+        case Unicode: {
+            const signed char digit = HexDigit(*p++);
+            if (digit < 0) {
+                return fail("Bad escape in string");
+            }
+            m_unicode = (m_unicode << 4) | unsigned(digit);
+            if (++m_unicodeDigits == 4) {
+                // Surrogate pairs come out as two characters, good enough for error messages
+                std::string utf8;
+                appendUtf8(utf8, m_unicode);
+                if (!appendText(utf8.data(), utf8.size())) {
+                    return false;
+                }
+                m_state = String;
+            }
+            break;
+        }
+
+        case Literal: {
+            const char* run = p;
+            while (p != end && literalChar(*p)) {
+                ++p;
+            }
+            if (m_text.size() + (p - run) > c_maxLiteral) {
+                return fail("Malformed number");
+            }
+            m_text.append(run, p - run);
+            // The character after it is read in the next state
+            if (p != end && !endLiteral()) {
+                return false;
+            }
+            break;
+        }
+
+        default: {
+            const char c = *p++;
+            if (space(c)) {
+                break;
+            }
+            switch (m_state) {
+            case Value:
+                if (!beginValue(c)) {
+                    return false;
+                }
+                break;
+            case ValueOrClose:
+                if (c == ']' ? !close(c) : !beginValue(c)) {
+                    return false;
+                }
+                break;
+            case KeyOrClose:
+            case Key:
+                if (c == '"') {
+                    m_key = true;
+                    m_text.clear();
+                    m_state = String;
+                } else if (c != '}' || m_state != KeyOrClose || !close(c)) {
+                    return m_state == Failed ? false : fail("Expected a key");
+                }
+                break;
+            case Colon:
+                if (c != ':') {
+                    return fail("Expected ':'");
+                }
+                m_state = Value;
+                break;
+            case Comma:
+                if (c == ',') {
+                    m_state = m_frames.back().object ? Key : Value;
+                } else if (!close(c)) {
+                    return false;
+                }
+                break;
+            default:
+                return fail("Data after the reply");
+            }
+            break;
+        }
+        }
+    }
+    return m_state != Failed;
+}
+
+bool TemplateParser::beginValue(char c)
+{
+    // Where the value goes, from the container it is in and its key
+    Role role = Dom;
+    Json::Value* target = nullptr;
+    bool result = false;
+    if (m_frames.empty()) {
+        target = &m_reply;
+    } else {
+        const Frame& parent = m_frames.back();
+        switch (parent.role) {
+        case Dom:
+            if (parent.result && m_name == "transactions") {
+                role = Transactions;
+            } else {
+                target = parent.object ? &(*parent.value)[m_name] : &parent.value->append(Json::Value());
+                result = m_frames.size() == 1 && parent.object && m_name == "result";
+            }
+            break;
+        case Transactions:
+            role = Transaction;
+            break;
+        case Transaction:
+            role = m_name == "data" ? TxData : m_name == "txid" ? TxId : m_name == "hash" ? TxHash : Skip;
+            break;
+        default:
+            role = Skip;
+            break;
+        }
+    }
+
+    if (c == '{' || c == '[') {
+        const bool object = c == '{';
+        if ((role == Transactions && object) || (role == Transaction && !object)) {
+            return fail("Malformed template transaction");
+        }
+        if (role == TxData || role == TxId || role == TxHash) {
+            role = Skip;
+        }
+        if (m_frames.size() >= c_maxDepth) {
+            return fail("Reply nested too deep");
+        }
+        if (target) {
+            *target = Json::Value(object ? Json::objectValue : Json::arrayValue);
+        }
+        m_frames.push_back(Frame{object, role, target, result});
+        if (role == Transactions && m_cache) {
+            m_cache->begin();
+        } else if (role == Transaction) {
+            m_txBegin = m_hex->size();
+            m_txData = false;
+            m_txid.clear();
+            m_txHash.clear();
+        }
+        m_state = object ? KeyOrClose : ValueOrClose;
+        return true;
+    }
+    if (role == Transactions || role == Transaction) {
+        return fail("Malformed template transaction");
+    }
+
+    m_role = role;
+    m_target = target;
+    m_key = false;
+    m_text.clear();
+    if (c == '"') {
+        if (role == TxData) {
+            if (m_txData) {
+                return fail("Malformed template transaction");
+            }
+            m_txData = true;
+        }
+        m_state = String;
+        return true;
+    }
+    if (role == TxData || role == TxId || role == TxHash) {
+        // Not a string, as if it was missing
+        m_role = Skip;
+    }
+    if (!literalChar(c)) {
+        return fail("Unexpected character");
+    }
+    m_text.assign(1, c);
+    m_state = Literal;
+    return true;
+}
+
+bool TemplateParser::appendText(const char* data, size_t size)
+{
+    if (!m_key) {
+        if (m_role == TxData) {
+            m_hex->append(data, size);
+            return true;
+        }
+        if (m_role == Skip) {
+            return true;
+        }
+    }
+    if (m_text.size() + size > c_maxText) {
+        return fail("String too long");
+    }
+    m_text.append(data, size);
+    return true;
+}
+
+bool TemplateParser::endString()
+{
+    if (m_key) {
+        m_name.swap(m_text);
+        m_key = false;
+        m_state = Colon;
+        return true;
+    }
+    switch (m_role) {
+    case Dom:
+        *m_target = Json::Value(m_text);
+        break;
+    case TxId:
+        m_txid = m_text;
+        break;
+    case TxHash:
+        m_txHash = m_text;
+        break;
+    default:
+        break;
+    }
+    valueDone();
+    return true;
+}
+
+bool TemplateParser::endLiteral()
+{
+    Json::Value value;
+    const std::string& text = m_text;
+    if (text == "true") {
+        value = true;
+    } else if (text == "false") {
+        value = false;
+    } else if (text != "null") {
+        if (text[0] != '-' && (text[0] < '0' || text[0] > '9')) {
+            return fail("Unexpected character");
+        }
+        char* stop = nullptr;
+        errno = 0;
+        if (text.find_first_of(".eE") != std::string::npos) {
+            value = std::strtod(text.c_str(), &stop);
+        } else if (text[0] == '-') {
+            value = Json::Int64(std::strtoll(text.c_str(), &stop, 10));
+        } else {
+            const unsigned long long number = std::strtoull(text.c_str(), &stop, 10);
+            value = number <= uint64_t(INT64_MAX) ? Json::Value(Json::Int64(number))
+                                                  : Json::Value(Json::UInt64(number));
+        }
+        if (stop != text.c_str() + text.size() || errno == ERANGE) {
+            return fail("Malformed number");
+        }
+    }
+    if (m_role == Dom) {
+        *m_target = value;
+    }
+    valueDone();
+    return true;
+}
+
+bool TemplateParser::close(char c)
+{
+    if (m_frames.empty() || c != (m_frames.back().object ? '}' : ']')) {
+        return fail("Unexpected character");
+    }
+    const Role role = m_frames.back().role;
+    if (role == Transaction && !finishTransaction()) {
+        return false;
+    }
+    if (role == Transactions && m_cache) {
+        m_cache->sweep();
+    }
+    m_frames.pop_back();
+    valueDone();
+    return true;
+}
+
+void TemplateParser::valueDone()
+{
+    m_state = m_frames.empty() ? Done : Comma;
+}
+
+bool TemplateParser::finishTransaction()
+{
+    // Same rules as Block::fillTransactions: "hash" is the witness hash on
+    // segwit nodes, only "txid" is taken as is
+    const uint256 txid = m_txid.empty() ? uint256() : uint256S(m_txid);
+    const std::string& id = m_txid.empty() ? m_txHash : m_txid;
+    const char* data = m_hex->data() + m_txBegin;
+    const size_t size = m_hex->size() - m_txBegin;
+
+    RawTransaction tx;
+    const bool decoded = m_cache
+        ? m_cache->decode(tx, data, size, id.empty() ? uint256() : uint256S(id), txid)
+        : DecodeHexRawTx(tx, data, size, txid);
+    if (!m_txData || !decoded) {
+        return fail("Malformed template transaction");
+    }
+    m_transactions.push_back(std::move(tx));
+    return true;
+}
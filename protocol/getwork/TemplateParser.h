@@ -0,0 +1,121 @@
+#pragma once
+
+#include <primitives/block.h>
+
+#include <json/json.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Reads a getblocktemplate reply chunk by chunk, as it comes off the socket,
+ * so the body is never held as a whole.
+ *
+ * The hex of the transactions is written straight into the buffer the
+ * template keeps for submitblock (Block::vtxRawHex), and each transaction is
+ * decoded from there, or taken from the cache, once its object is complete.
+ * The rest of the reply is small and is kept as a Json::Value without
+ * result.transactions, so payouts and header fields are read by the same
+ * code as for templates parsed whole.
+ */
+class TemplateParser
+{
+public:
+    //! Starts a new reply, cache as for energi::Block
+    void reset(RawTransactionCache* cache = nullptr);
+
+    //! Returns false, for this and later chunks, once the reply is unusable
+    bool feed(const char* data, size_t size);
+
+    //! The whole reply was read
+    bool complete() const
+    {
+        return m_state == Done;
+    }
+
+    //! Why feed() returned false
+    const std::string& error() const
+    {
+        return m_error;
+    }
+
+    //! The reply without result.transactions, valid once complete
+    const Json::Value& reply() const
+    {
+        return m_reply;
+    }
+
+    //! Moves the transactions of the result out
+    energi::TemplateTransactions takeTransactions();
+
+private:
+    enum State
+    {
+        Value,        // a value is next
+        ValueOrClose, // first value of a list, or its end
+        KeyOrClose,   // first key of an object, or its end
+        Key,
+        Colon,
+        Comma,        // after a value, a separator or the end of the container
+        String,
+        Escape,
+        Unicode,
+        Literal,      // number, true, false or null
+        Done,
+        Failed
+    };
+
+    // What a value is read into
+    enum Role
+    {
+        Dom,          // the Json::Value at target
+        Transactions, // result.transactions
+        Transaction,  // one of its entries
+        TxData,
+        TxId,
+        TxHash,
+        Skip
+    };
+
+    struct Frame
+    {
+        bool         object;
+        Role         role;
+        Json::Value* value;  // Dom frames only
+        bool         result; // the result object of the reply
+    };
+
+    bool fail(const char* why);
+    bool beginValue(char c);
+    bool endString();
+    bool endLiteral();
+    bool close(char c);
+    void valueDone();
+    bool appendText(const char* data, size_t size);
+    bool finishTransaction();
+
+    State m_state = Value;
+    std::string m_error;
+    Json::Value m_reply;
+    std::vector<Frame> m_frames;
+
+    // Value being read
+    Role m_role = Dom;
+    Json::Value* m_target = nullptr;
+    bool m_key = false; // the string is a key
+    std::string m_text; // keys, strings and literals apart from transaction hex
+    std::string m_name; // last key read
+    unsigned m_unicode = 0;
+    unsigned m_unicodeDigits = 0;
+
+    RawTransactionCache* m_cache = nullptr;
+    std::vector<RawTransaction> m_transactions;
+    std::shared_ptr<std::string> m_hex;
+    // Transaction being read
+    size_t m_txBegin = 0;
+    bool m_txData = false;
+    std::string m_txid;
+    std::string m_txHash;
+};
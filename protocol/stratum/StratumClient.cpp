@@ -19,6 +19,96 @@ static void diffToTarget(arith_uint256 &target, double diff)
     target *= DIFF_MULT;
 }
 
+// Idle connections are probed after a minute instead of the system default of
+// two hours, a standby pool connection mostly sits idle between jobs
+template <typename Socket>
+static void setKeepAlive(Socket& socket)
+{
+    socket.set_option(boost::asio::socket_base::keep_alive(true));
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    boost::system::error_code ec;
+    socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPIDLE>(60), ec);
+    socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPINTVL>(10), ec);
+    socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPCNT>(6), ec);
+#endif
+}
+
+namespace
+{
+
+// TLS sessions by pool. Shared by all clients, a standby connection and
+// reconnects to the same pool resume instead of doing a full handshake.
+class TlsSessionCache
+{
+public:
+    ~TlsSessionCache()
+    {
+        for (auto& session : m_sessions) {
+            SSL_SESSION_free(session.second);
+        }
+    }
+
+    // Takes over the reference held by session
+    void store(const std::string& pool, SSL_SESSION* session)
+    {
+        std::lock_guard<std::mutex> lock(x_sessions);
+        SSL_SESSION*& slot = m_sessions[pool];
+        if (slot) {
+            SSL_SESSION_free(slot);
+        }
+        slot = session;
+    }
+
+    void resume(const std::string& pool, SSL* ssl)
+    {
+        std::lock_guard<std::mutex> lock(x_sessions);
+        auto it = m_sessions.find(pool);
+        if (it != m_sessions.end()) {
+            SSL_set_session(ssl, it->second);
+        }
+    }
+
+    void forget(const std::string& pool)
+    {
+        std::lock_guard<std::mutex> lock(x_sessions);
+        auto it = m_sessions.find(pool);
+        if (it != m_sessions.end()) {
+            SSL_SESSION_free(it->second);
+            m_sessions.erase(it);
+        }
+    }
+
+private:
+    std::mutex x_sessions;
+    std::map<std::string, SSL_SESSION*> m_sessions;
+};
+
+TlsSessionCache& tlsSessions()
+{
+    static TlsSessionCache cache;
+    return cache;
+}
+
+// Slot of the pool key on an SSL object. Its app data is taken by asio.
+int tlsSessionKeyIndex()
+{
+    static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+// New session callback, TLS 1.3 sends its tickets after the handshake
+int onNewTlsSession(SSL* ssl, SSL_SESSION* session)
+{
+    auto pool = static_cast<const std::string*>(SSL_get_ex_data(ssl, tlsSessionKeyIndex()));
+    if (!pool) {
+        return 0;
+    }
+    tlsSessions().store(*pool, session);
+    return 1;
+}
+
+} // namespace
+
 using boost::asio::ip::tcp;
 
 StratumClient::StratumClient(boost::asio::io_service & io_service,
@@ -32,9 +122,9 @@ StratumClient::StratumClient(boost::asio::io_service & io_service,
     , m_io_strand(io_service)
     , m_socket(nullptr)
     , m_workloop_timer(io_service)
-    , m_response_plea_times(64)
     , m_resolver(io_service)
     , m_endpoints()
+    , m_raceTimer(io_service)
     , m_nextWorkTarget(DIFF1_TARGET)
     , m_submit_hashrate(submitHashrate)
 {
@@ -61,6 +151,10 @@ void StratumClient::init_socket()
         }
 
         boost::asio::ssl::context ctx(method);
+        // Sessions are cached by us per pool, see TlsSessionCache
+        SSL_CTX_set_session_cache_mode(ctx.native_handle(),
+                SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx.native_handle(), onNewTlsSession);
         m_securesocket = std::make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(
             m_io_service, ctx);
         m_socket = &m_securesocket->next_layer();
@@ -148,6 +242,7 @@ void StratumClient::connect()
      */
     m_nextWorkTarget = DIFF1_TARGET;
     m_extraNonce1 = "f000000f";
+    clearJobs();
 
     // Initializes socket and eventually secure stream
     if (!m_socket)
@@ -188,7 +283,7 @@ void StratumClient::disconnect()
                 // As there may be a connection issue we also endorse a timeout
                 m_securesocket->async_shutdown(m_io_strand.wrap(boost::bind(&StratumClient::onSSLShutdownCompleted, this, boost::asio::placeholders::error)));
 
-                enqueue_response_plea();
+                enqueue_response_plea(0, CONNECTION);
                 // Rest of disconnection is performed asynchronously
                 return;
             } else {
@@ -221,6 +316,18 @@ void StratumClient::disconnect_finalize()
 
     // Release locking flag and set connection status
     cnote << "Socket disconnected from: " << ActiveEndPoint();
+    if (m_capture) {
+        m_capture->record(SessionCapture::Disconnected);
+    }
+    {
+        std::lock_guard<std::mutex> lock(x_response_pleas);
+        if (m_response_times.count()) {
+            cnote << "Pool response times: " << m_response_times.ToString() << " over "
+                  << m_response_times.count() << " requests";
+        }
+        m_response_times = LatencyHistogram();
+    }
+    clearSocketData();
     m_connected.store(false, std::memory_order_relaxed);
     m_subscribed.store(false, std::memory_order_relaxed);
     m_authorized.store(false, std::memory_order_relaxed);
@@ -247,7 +354,6 @@ void StratumClient::disconnect_finalize()
         }
     }
     // Clear plea queue and stop timing
-    std::chrono::steady_clock::time_point m_response_plea_time;
     clear_response_pleas();
     // Put the actor back to sleep
     m_workloop_timer.expires_at(boost::posix_time::pos_infin);
@@ -291,31 +397,33 @@ void StratumClient::start_connect()
     m_connecting.store(true, std::memory_order::memory_order_relaxed);
 
     if (!m_endpoints.empty()) {
-        // Pick the first endpoint in list.
-        // Eventually endpoints get discarded on connection errors
-        m_endpoint = m_endpoints.front();
+        // Race all addresses in resolver order. Those that fail are
+        // discarded, start_connect reports when none is left.
+        auto endpoints = m_endpoints;
+        m_raceEndpoints.clear();
+        while (!endpoints.empty()) {
+            m_raceEndpoints.push_back(endpoints.front());
+            endpoints.pop();
+        }
+        m_endpoint = m_raceEndpoints.front();
 
         // Re-init socket if we need to
         if (m_socket == nullptr)
             init_socket();
 
         setThreadName("stratum");
-        if (g_logVerbosity >= 6)
-            cnote << ("Trying " + toString(m_endpoint) + " ...");
 
         clear_response_pleas();
 
         m_connecting.store(true, std::memory_order::memory_order_relaxed);
-        enqueue_response_plea();
+        enqueue_response_plea(0, CONNECTION);
 
         // Start connecting async
-        if (m_conn->SecLevel() != SecureLevel::NONE) {
-            m_securesocket->lowest_layer().async_connect(m_endpoint,
-                    m_io_strand.wrap(boost::bind(&StratumClient::connect_handler, this, _1)));
-        } else {
-            m_socket->async_connect(m_endpoint,
-                    m_io_strand.wrap(boost::bind(&StratumClient::connect_handler, this, _1)));
-        }
+        ++m_raceGeneration;
+        m_racers.clear();
+        m_raceNext = 0;
+        m_raceOutstanding = 0;
+        launch_racer();
     } else {
         setThreadName("stratum");
         m_connecting.store(false, std::memory_order_relaxed);
@@ -327,6 +435,106 @@ void StratumClient::start_connect()
     }
 }
 
+void StratumClient::launch_racer()
+{
+    if (m_raceNext >= m_raceEndpoints.size()) {
+        return;
+    }
+    const tcp::endpoint endpoint = m_raceEndpoints[m_raceNext++];
+    if (g_logVerbosity >= 6)
+        cnote << ("Trying " + toString(endpoint) + " ...");
+
+    auto racer = std::make_shared<tcp::socket>(m_io_service);
+    m_racers.push_back(racer);
+    m_raceOutstanding++;
+    racer->async_connect(endpoint, m_io_strand.wrap(boost::bind(&StratumClient::racer_handler, this,
+                    boost::asio::placeholders::error, racer, endpoint, m_raceGeneration)));
+
+    // Give this address a head start before the next one joins
+    if (m_raceNext < m_raceEndpoints.size()) {
+        m_raceTimer.expires_from_now(boost::posix_time::milliseconds(CONNECT_STAGGER_MS));
+        m_raceTimer.async_wait(m_io_strand.wrap(boost::bind(&StratumClient::race_timer_elapsed, this,
+                        boost::asio::placeholders::error, m_raceGeneration)));
+    }
+}
+
+void StratumClient::race_timer_elapsed(const boost::system::error_code& ec, unsigned generation)
+{
+    if (ec == boost::asio::error::operation_aborted || generation != m_raceGeneration) {
+        return;
+    }
+    launch_racer();
+}
+
+void StratumClient::racer_handler(const boost::system::error_code& ec, std::shared_ptr<tcp::socket> racer,
+                                  tcp::endpoint endpoint, unsigned generation)
+{
+    boost::system::error_code cec;
+    if (generation != m_raceGeneration) {
+        // Lost to an address that connected first
+        racer->close(cec);
+        return;
+    }
+    m_raceOutstanding--;
+
+    if (!ec && racer->is_open()) {
+        // First connected address wins, the others are dropped
+        ++m_raceGeneration;
+        m_raceTimer.cancel();
+        for (auto& other : m_racers) {
+            if (other != racer) {
+                other->close(cec);
+            }
+        }
+        m_racers.clear();
+        *m_socket = std::move(*racer);
+        m_endpoint = endpoint;
+
+        // Keep the winner first, a timeout on it later moves on to the others
+        std::queue<tcp::endpoint> endpoints;
+        endpoints.push(endpoint);
+        for (const auto& other : m_raceEndpoints) {
+            if (other != endpoint) {
+                endpoints.push(other);
+            }
+        }
+        m_endpoints = endpoints;
+        connect_handler(ec);
+        return;
+    }
+
+    racer->close(cec);
+    if (m_raceNext < m_raceEndpoints.size()) {
+        // No need to wait out the stagger once an address failed
+        cwarn << ("Error  " + toString(endpoint) + " [ " + ec.message() + " ]");
+        m_raceTimer.cancel();
+        launch_racer();
+    } else if (m_raceOutstanding == 0) {
+        // The last address decides, aborted on timeout
+        ++m_raceGeneration;
+        m_racers.clear();
+        m_endpoint = endpoint;
+        connect_handler(ec == boost::asio::error::operation_aborted ? boost::system::error_code() : ec);
+    } else {
+        cwarn << ("Error  " + toString(endpoint) + " [ " + ec.message() + " ]");
+    }
+}
+
+void StratumClient::abort_race()
+{
+    // Stops launching addresses, the pending ones complete with an error
+    m_raceNext = m_raceEndpoints.size();
+    m_raceTimer.cancel();
+    boost::system::error_code ec;
+    for (auto& racer : m_racers) {
+        racer->close(ec);
+    }
+    // Past the race a TLS handshake may be pending on the winner
+    if (m_racers.empty() && m_socket) {
+        m_socket->close(ec);
+    }
+}
+
 void StratumClient::workloop_timer_elapsed(const boost::system::error_code& ec)
 {
     using namespace std::chrono;
@@ -336,19 +544,19 @@ void StratumClient::workloop_timer_elapsed(const boost::system::error_code& ec)
     // Check whether the deadline has passed. We compare the deadline against
     // the current time since a new asynchronous operation may have moved the
     // deadline before this actor had a chance to run.
-    if (m_response_pleas_count.load(std::memory_order_relaxed)) {
+    steady_clock::time_point m_response_plea_time;
+    if (oldest_response_plea(m_response_plea_time)) {
         milliseconds response_delay_ms(0);
-        steady_clock::time_point m_response_plea_time(m_response_plea_older.load(std::memory_order_relaxed));
 
         // Check responses while in connection/disconnection phase
         if (isPendingState()) {
             response_delay_ms =
                 duration_cast<milliseconds>(steady_clock::now() - m_response_plea_time);
-            if ((m_responsetimeout * 1000) >= response_delay_ms.count()) {
+            if (response_delay_ms.count() >= (m_responsetimeout * 1000)) {
                 if (m_connecting.load(std::memory_order_relaxed)) {
-                    // The socket is closed so that any outstanding
+                    // The sockets are closed so that any outstanding
                     // asynchronous connection operations are cancelled.
-                    m_socket->close();
+                    abort_race();
                     return;
                 }
                 // This is set for SSL disconnection
@@ -413,11 +621,11 @@ void StratumClient::workloop_timer_elapsed(const boost::system::error_code& ec)
 void StratumClient::connect_handler(const boost::system::error_code& ec)
 {
     setThreadName("stratum");
-    // Set status completion
-    m_connecting.store(false, std::memory_order_relaxed);
 
     // Timeout has run before or we got error
     if (ec || !m_socket->is_open()) {
+        // Set status completion
+        m_connecting.store(false, std::memory_order_relaxed);
         cwarn << ("Error  " + toString(m_endpoint) + " [ " + (ec ? ec.message() : "Timeout") +
                   " ]");
 
@@ -429,10 +637,10 @@ void StratumClient::connect_handler(const boost::system::error_code& ec)
             m_socket->close();
         }
 
-        // Discard this endpoint and try the next available.
+        // All addresses were raced and failed.
         // Eventually is start_connect which will check for an
         // empty list.
-        m_endpoints.pop();
+        m_endpoints = std::queue<tcp::endpoint>();
         m_canconnect.store(false, std::memory_order_relaxed);
         m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::start_connect, this)));
 
@@ -443,49 +651,92 @@ void StratumClient::connect_handler(const boost::system::error_code& ec)
     m_canconnect.store(true, std::memory_order_relaxed);
     cnote << "Socket connected to: " << ActiveEndPoint();
     if (m_conn->SecLevel() != SecureLevel::NONE) {
-        boost::system::error_code hec;
-        m_securesocket->lowest_layer().set_option(boost::asio::socket_base::keep_alive(true));
+        setKeepAlive(m_securesocket->lowest_layer());
         m_securesocket->lowest_layer().set_option(tcp::no_delay(true));
 
-        m_securesocket->handshake(boost::asio::ssl::stream_base::client, hec);
-
-        if (hec) {
-            cwarn << "SSL/TLS Handshake failed: " << hec.message();
-            if (hec.value() == 337047686) {  // certificate verification failed
-                cwarn << "This can have multiple reasons:";
-                cwarn << "* Root certs are either not installed or not found";
-                cwarn << "* Pool uses a self-signed certificate";
-                cwarn << "Possible fixes:";
-                cwarn << "* Make sure the file '/etc/ssl/certs/ca-certificates.crt' exists and "
-                         "is accessible";
-                cwarn << "* Export the correct path via 'export "
-                         "SSL_CERT_FILE=/etc/ssl/certs/ca-certificates.crt' to the correct "
-                         "file";
-                cwarn << "  On most systems you can install the 'ca-certificates' package";
-                cwarn << "  You can also get the latest file here: "
-                         "https://curl.haxx.se/docs/caextract.html";
-                cwarn << "* Disable certificate verification all-together via command-line "
-                         "option.";
-            }
+        // Offer the last session with this pool, a resumed handshake saves a
+        // round trip and the key exchange
+        SSL* ssl = m_securesocket->native_handle();
+        m_tlsSessionKey = m_conn->Host() + ":" + toString(m_conn->Port());
+        SSL_set_ex_data(ssl, tlsSessionKeyIndex(), &m_tlsSessionKey);
+        SSL_set_tlsext_host_name(ssl, m_conn->Host().c_str());
+        tlsSessions().resume(m_tlsSessionKey, ssl);
+
+        // Still connecting until the handshake is done, the connection timeout covers it
+        m_securesocket->async_handshake(boost::asio::ssl::stream_base::client,
+                m_io_strand.wrap(boost::bind(&StratumClient::handshake_handler, this, boost::asio::placeholders::error)));
+        return;
+    }
+    setKeepAlive(*m_nonsecuresocket);
+    m_nonsecuresocket->set_option(tcp::no_delay(true));
 
-            // This is a fatal error
-            // No need to try other IPs as the certificate is based on host-name
-            // not ip address. Trying other IPs would end up with the very same error.
-            m_canconnect.store(false, std::memory_order_relaxed);
-            m_conn->MarkUnrecoverable();
-            m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
-            return;
+    // Set status completion
+    m_connecting.store(false, std::memory_order_relaxed);
+    begin_session();
+}
+
+void StratumClient::handshake_handler(const boost::system::error_code& hec)
+{
+    setThreadName("stratum");
+    // Set status completion
+    m_connecting.store(false, std::memory_order_relaxed);
+
+    if (hec && hec.category() != boost::asio::error::get_ssl_category()) {
+        // Dropped or timed out before the handshake completed, not a TLS
+        // problem. The stream can't be reused, try the next address with a new one.
+        cwarn << "SSL/TLS Handshake failed: " << hec.message();
+        boost::system::error_code ec;
+        m_securesocket->lowest_layer().close(ec);
+        m_securesocket = nullptr;
+        m_socket = nullptr;
+        m_endpoints.pop();
+        m_canconnect.store(false, std::memory_order_relaxed);
+        m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::start_connect, this)));
+        return;
+    }
+    if (hec) {
+        cwarn << "SSL/TLS Handshake failed: " << hec.message();
+        if (hec.value() == 337047686) {  // certificate verification failed
+            cwarn << "This can have multiple reasons:";
+            cwarn << "* Root certs are either not installed or not found";
+            cwarn << "* Pool uses a self-signed certificate";
+            cwarn << "Possible fixes:";
+            cwarn << "* Make sure the file '/etc/ssl/certs/ca-certificates.crt' exists and "
+                     "is accessible";
+            cwarn << "* Export the correct path via 'export "
+                     "SSL_CERT_FILE=/etc/ssl/certs/ca-certificates.crt' to the correct "
+                     "file";
+            cwarn << "  On most systems you can install the 'ca-certificates' package";
+            cwarn << "  You can also get the latest file here: "
+                     "https://curl.haxx.se/docs/caextract.html";
+            cwarn << "* Disable certificate verification all-together via command-line "
+                     "option.";
         }
-    } else {
-        m_nonsecuresocket->set_option(boost::asio::socket_base::keep_alive(true));
-        m_nonsecuresocket->set_option(tcp::no_delay(true));
+        tlsSessions().forget(m_tlsSessionKey);
+
+        // This is a fatal error
+        // No need to try other IPs as the certificate is based on host-name
+        // not ip address. Trying other IPs would end up with the very same error.
+        m_canconnect.store(false, std::memory_order_relaxed);
+        m_conn->MarkUnrecoverable();
+        m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
+        return;
     }
+    if (g_logVerbosity >= 6 && SSL_session_reused(m_securesocket->native_handle()))
+        cnote << "TLS session resumed";
+    begin_session();
+}
 
+void StratumClient::begin_session()
+{
     // Here is where we're properly connected
     m_connected.store(true, std::memory_order_relaxed);
+    if (m_capture) {
+        m_capture->record(SessionCapture::Connected, toString(m_endpoint));
+    }
 
     // Clean buffer from any previous stale data
-    m_sendBuffer.consume(4096);
+    clearSocketData();
     clear_response_pleas();
 
     // Trigger event handlers and begin counting for the next job
@@ -559,6 +810,7 @@ void StratumClient::connect_handler(const boost::system::error_code& ec)
        +        if no response within that time consider the tentative login failed
        +        and switch to next stratum mode test
        +        */
+    enqueue_response_plea(1, SUBSCRIBE);
     sendSocketData(jReq);
 }
 
@@ -593,9 +845,53 @@ std::string StratumClient::processError(Json::Value& responseObject)
 void StratumClient::processExtranonce(std::string& enonce)
 {
     cnote << "Extranonce set to: " + enonce;
+    // Shares for jobs built on the previous extranonce1 can't be valid anymore
+    if (m_extraNonce1 != enonce) {
+        clearJobs();
+    }
     m_extraNonce1 = enonce;
 }
 
+bool StratumClient::rememberJob(const energi::Work& work, bool clean)
+{
+    std::lock_guard<std::mutex> lock(x_recentJobs);
+    // Jobs only die when the pool says so or the chain moved on
+    bool invalidated = clean ||
+        (!m_recentJobs.empty() && m_recentJobs.back().prevHash != work.hashPrevBlock);
+    if (invalidated) {
+        m_recentJobs.clear();
+    }
+    RecentJob job;
+    job.id = work.getJobName();
+    job.target = work.hashTarget;
+    job.prevHash = work.hashPrevBlock;
+    m_recentJobs.push_back(std::move(job));
+    if (m_recentJobs.size() > RECENT_JOBS_LIMIT) {
+        m_recentJobs.pop_front();
+    }
+    return invalidated;
+}
+
+bool StratumClient::isJobLive(const energi::Work& work) const
+{
+    std::lock_guard<std::mutex> lock(x_recentJobs);
+    // Pools may reuse ids, the newest one wins
+    for (auto it = m_recentJobs.rbegin(); it != m_recentJobs.rend(); ++it) {
+        if (it->id == work.getJobName()) {
+            // The share is credited at the job's own target, one mined
+            // against an easier target would only be rejected
+            return it->prevHash == work.hashPrevBlock && work.hashTarget <= it->target;
+        }
+    }
+    return false;
+}
+
+void StratumClient::clearJobs()
+{
+    std::lock_guard<std::mutex> lock(x_recentJobs);
+    m_recentJobs.clear();
+}
+
 void StratumClient::processResponse(Json::Value& responseObject)
 {
     setThreadName("stratum");
@@ -618,6 +914,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
     if (_isNotification && _method == "" && m_conn->StratumMode() == StratumClient::NRGPROXY &&
             responseObject["result"].isArray()) {
         _method = "mining.notify";
+        responseObject["params"] = responseObject["result"];
     }
 
     // Very minimal sanity checks
@@ -644,9 +941,16 @@ void StratumClient::processResponse(Json::Value& responseObject)
         Json::Value jResult = responseObject.get("result", Json::Value::null);
         std::chrono::milliseconds response_delay_ms(0);
 
-        switch (_id) {
-        case 1:
-            response_delay_ms = dequeue_response_plea();
+        // Responses are matched to requests by id, whatever order they come in.
+        // An id nothing waits for keeps its value, e.g. the fake login timeout.
+        RequestKind _kind;
+        unsigned _request = _id;
+        if (dequeue_response_plea(_id, _kind, response_delay_ms)) {
+            _request = _kind;
+        }
+
+        switch (_request) {
+        case SUBSCRIBE:
             /*
                This is the response to very first message after connection.
                I wish I could manage to have different Ids but apparently ethermine.org always replies
@@ -672,6 +976,9 @@ void StratumClient::processResponse(Json::Value& responseObject)
                         break;
                 }
             }
+            if (m_capture) {
+                m_capture->record(SessionCapture::Mode, toString(m_conn->StratumMode()));
+            }
             // Response to "mining.subscribe" (https://en.bitcoin.it/wiki/Stratum_mining_protocol#mining.subscribe)
             // Result should be an array with multiple dimensions, we only care about the data if StratumClient::ENERGISTRATUM
             switch (m_conn->StratumMode()) {
@@ -693,7 +1000,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
                     jReq["params"] = Json::Value(Json::arrayValue);
                     jReq["params"].append(m_conn->User() + m_conn->Path());
                     jReq["params"].append(m_conn->Pass());
-                    enqueue_response_plea();
+                    enqueue_response_plea(3, AUTHORIZE);
                 }
                 break;
             case StratumClient::NRGPROXY:
@@ -725,7 +1032,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
                     jReq["params"] = Json::Value(Json::arrayValue);
                     jReq["params"].append(m_conn->User() + m_conn->Path());
                     jReq["params"].append(m_conn->Pass());
-                    enqueue_response_plea();
+                    enqueue_response_plea(3, AUTHORIZE);
                 }
                 break;
             case StratumClient::ENERGISTRATUM:
@@ -747,13 +1054,13 @@ void StratumClient::processResponse(Json::Value& responseObject)
                     jReq["method"] = "mining.authorize";
                     jReq["params"].append(m_conn->User() + m_conn->Path());
                     jReq["params"].append(m_conn->Pass());
-                    enqueue_response_plea();
+                    enqueue_response_plea(3, AUTHORIZE);
                 }
                 break;
             }
             sendSocketData(jReq);
             break;
-        case 2:
+        case EXTRANONCE_SUBSCRIBE:
             // This is the response to mining.extranonce.subscribe
             // according to this
             // https://github.com/nicehash/Specifications/blob/master/NiceHash_extranonce_subscribe_extension.txt
@@ -762,8 +1069,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
             // changes correctly
             // Nothing to do here.
             break;
-        case 3:
-            response_delay_ms = dequeue_response_plea();
+        case AUTHORIZE:
             // Response to "mining.authorize" (https://en.bitcoin.it/wiki/Stratum_mining_protocol#mining.authorize)
             // Result should be boolean, some pools also throw an error, so _isSuccess can be false
             // Due to this reevaluate _isSuccess
@@ -789,29 +1095,14 @@ void StratumClient::processResponse(Json::Value& responseObject)
 
             }
             break;
-        case 4:
-            response_delay_ms = dequeue_response_plea();
+        case SUBMIT:
             // Response to solution submission mining.submit  (https://en.bitcoin.it/wiki/Stratum_mining_protocol#mining.submit)
             // Result should be boolean, some pools also throw an error, so _isSuccess can be false
             // Due to this reevaluate _isSucess
             if (_isSuccess && jResult.isBool()) {
                 _isSuccess = jResult.asBool();
             }
-            {
-                dequeue_response_plea();
-                if (_isSuccess) {
-                    if (m_onSolutionAccepted) {
-                        m_onSolutionAccepted(false, response_delay_ms);
-                    }
-                } else {
-                    if (m_onSolutionRejected) {
-                        if (!_errReason.empty()) {
-                            cwarn << "Reject reason: " << (_errReason.empty() ? "Unspecified" : _errReason);
-                        }
-                        m_onSolutionRejected(true, response_delay_ms);
-                    }
-                }
-            }
+            processSubmitResponse(_isSuccess, _errReason, response_delay_ms);
             break;
         case 5:
 
@@ -821,9 +1112,10 @@ void StratumClient::processResponse(Json::Value& responseObject)
             if (m_conn->StratumMode() == StratumClient::NRGPROXY && responseObject["result"].isArray()) {
                 _method = "mining.notify";
                 _isNotification = true;
+                responseObject["params"] = responseObject["result"];
             }
             break;
-        case 9:
+        case HASHRATE:
 
             // Response to hashrate submit
             // Shall we do anything ?
@@ -837,7 +1129,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
             // However it has been tested that ethermine.org responds with this id when error replying to
             // either mining.subscribe (1) or mining.authorize requests (3)
             // To properly handle this situation we need to rely on Subscribed/Authorized states
-            response_delay_ms = dequeue_response_plea();
+            dequeue_oldest_response_plea(_kind, response_delay_ms);
             if (!_isSuccess) {
                 if (!m_subscribed) {
                     // Subscription pending
@@ -866,31 +1158,12 @@ void StratumClient::processResponse(Json::Value& responseObject)
         jPrm = responseObject.get("params", Json::Value::null);
         if (_method == "mining.notify") {
             if (jPrm.isArray()) {
-                if (!jPrm.get((Json::Value::ArrayIndex)2, "").asString().empty() &&
-                    !jPrm.get((Json::Value::ArrayIndex)3, "").asString().empty()) {
-
-                    bool resetJob = jPrm.get((Json::Value::ArrayIndex)8, "").asBool();
-
-                    auto work = energi::Work(jPrm, m_extraNonce1, m_nextWorkTarget);
-                    if (resetJob || m_current != work) {
-                        if (m_onResetWork) {
-                            m_onResetWork();
-                        }
-                        m_current = work;
-                        m_current_timestamp = std::chrono::steady_clock::now();
-                        if (m_onWorkReceived) {
-                            m_onWorkReceived(m_current);
-                        }
-                    }
-                }
+                processNotify(energi::StratumJobView(jPrm));
             }
         } else if (_method == "mining.set_difficulty") {
             jPrm = responseObject.get("params", Json::Value::null);
             if (jPrm.isArray()) {
-                double nextWorkDifficulty = std::max(jPrm.get((Json::Value::ArrayIndex)0, 1).asDouble(), 0.0001);
-                diffToTarget(m_nextWorkTarget, nextWorkDifficulty);
-                cnote << "Difficulty set to: "  << nextWorkDifficulty << " = " << m_nextWorkTarget.GetHex();
-                m_current.reset();
+                processDifficulty(jPrm.get((Json::Value::ArrayIndex)0, 1).asDouble());
             }
         } else if (_method == "mining.set_extranonce") {
             jPrm = responseObject.get("params", Json::Value::null);
@@ -921,6 +1194,99 @@ void StratumClient::processResponse(Json::Value& responseObject)
     }
 }
 
+bool StratumClient::processHotMessage(const StratumParser::Message& msg)
+{
+    // Mirrors processResponse for the messages the parser reads in full,
+    // false hands the message to it
+    if (!msg.method.empty()) {
+        if (!m_conn->StratumModeConfirmed()) {
+            return false;
+        }
+        if (msg.method == "mining.notify" && msg.hasJob) {
+            processNotify(msg.job);
+            return true;
+        }
+        if (msg.method == "mining.set_difficulty" && msg.hasNumber) {
+            processDifficulty(msg.number);
+            return true;
+        }
+        return false;
+    }
+    if (msg.id >= FIRST_SUBMIT_ID && msg.id != 999 && (msg.result == StratumParser::Message::True ||
+                                                      msg.result == StratumParser::Message::False ||
+                                                      msg.result == StratumParser::Message::Null)) {
+        RequestKind kind;
+        std::chrono::milliseconds response_delay_ms(0);
+        if (!dequeue_response_plea(unsigned(msg.id), kind, response_delay_ms)) {
+            // Not awaited any more, processResponse reports it
+            return false;
+        }
+        // A null result without an error counts as accepted, like in processResponse
+        processSubmitResponse(msg.result != StratumParser::Message::False, std::string(), response_delay_ms);
+        return true;
+    }
+    if ((msg.id == 0 || msg.id == 5) && msg.hasJob && m_conn->StratumModeConfirmed() &&
+            m_conn->StratumMode() == StratumClient::NRGPROXY) {
+        // nrg-proxy sends its jobs as results
+        processNotify(msg.job);
+        return true;
+    }
+    return false;
+}
+
+void StratumClient::processNotify(const energi::StratumJobView& job)
+{
+    if (job.coinbase1.empty() || job.coinbase2.empty()) {
+        return;
+    }
+    energi::Work work;
+    try {
+        work = energi::Work(job, m_extraNonce1, m_nextWorkTarget);
+    } catch (const WorkException& ex) {
+        // A malformed job must not take the io thread down, wait for the next one
+        cwarn << "Unusable stratum job " << job.jobName.str() << ": " << ex.what();
+        return;
+    }
+    bool invalidated = rememberJob(work, job.clean);
+    if (invalidated || m_current != work) {
+        // Only drop in-flight work the pool no longer accepts, solutions
+        // for the previous job stay routable through the recent jobs
+        if (invalidated && m_onResetWork) {
+            m_onResetWork();
+        }
+        m_current = work;
+        m_current_timestamp = std::chrono::steady_clock::now();
+        if (m_onWorkReceived) {
+            m_onWorkReceived(m_current);
+        }
+    }
+}
+
+void StratumClient::processDifficulty(double difficulty)
+{
+    double nextWorkDifficulty = std::max(difficulty, 0.0001);
+    diffToTarget(m_nextWorkTarget, nextWorkDifficulty);
+    cnote << "Difficulty set to: "  << nextWorkDifficulty << " = " << m_nextWorkTarget.GetHex();
+    m_current.reset();
+}
+
+void StratumClient::processSubmitResponse(bool accepted, const std::string& errReason,
+                                          const std::chrono::milliseconds& response_delay_ms)
+{
+    if (accepted) {
+        if (m_onSolutionAccepted) {
+            m_onSolutionAccepted(false, response_delay_ms);
+        }
+    } else {
+        if (m_onSolutionRejected) {
+            if (!errReason.empty()) {
+                cwarn << "Reject reason: " << (errReason.empty() ? "Unspecified" : errReason);
+            }
+            m_onSolutionRejected(true, response_delay_ms);
+        }
+    }
+}
+
 void StratumClient::submitHashrate(const std::string& rate)
 {
     if(rate.empty()) {
@@ -937,33 +1303,43 @@ void StratumClient::submitHashrate(const std::string& rate)
 	// actually change the id from 6 to 9
 }
 
-void StratumClient::submitSolution(const Solution& solution)
+bool StratumClient::submitSolution(const Solution& solution)
 {
     if (!m_subscribed.load(std::memory_order_relaxed) ||
             !m_authorized.load(std::memory_order_relaxed)) {
         cwarn << "Not authorized";
-        return;
+        return false;
     }
 
-    const auto &work = solution.getWork();
-
-    if (m_current != work) {
-        // stale
-        return;
+    // Route the solution to the job it was found for, not the newest one
+    if (!isJobLive(solution.getWork())) {
+        cnote << "Dropping solution for invalidated job " << solution.getJobName();
+        return true;
     }
 
-    if (m_response_pleas_count.load(std::memory_order_relaxed) > PARALLEL_REQUEST_LIMIT) {
+    if (pending_submits() > PARALLEL_REQUEST_LIMIT) {
         cwarn << "Reject reason: throttling submitted requests";
 
         if (m_onSolutionRejected) {
             m_onSolutionRejected(true, std::chrono::milliseconds(0));
         }
 
-        return;
+        return true;
+    }
+
+    // Submits are pipelined, each gets its own id to match the response with
+    unsigned id = m_next_submit_id++;
+    if (id == 999 || id < FIRST_SUBMIT_ID) {
+        // 999 is what ethermine.org answers errors with, skip it and the wrap
+        id = m_next_submit_id++;
+        if (id < FIRST_SUBMIT_ID) {
+            m_next_submit_id = FIRST_SUBMIT_ID + 1;
+            id = FIRST_SUBMIT_ID;
+        }
     }
 
     Json::Value jReq;
-    jReq["id"] = unsigned(4);
+    jReq["id"] = id;
     jReq["method"] = "mining.submit";
     jReq["params"] = Json::Value(Json::arrayValue);
 
@@ -975,13 +1351,14 @@ void StratumClient::submitSolution(const Solution& solution)
     jReq["params"].append(solution.getNonce());
     jReq["params"].append(solution.getHashMix().GetHex());
     jReq["params"].append(solution.getBlockTransaction());
-    jReq["params"].append(work.getMerkleRoot().GetHex());
+    jReq["params"].append(solution.getMerkleRoot().GetHex());
     if (m_worker.length()) {
         jReq["worker"] = m_worker;
     }
-    
-    enqueue_response_plea();
+
+    enqueue_response_plea(id, SUBMIT);
     sendSocketData(jReq);
+    return true;
 }
 
 void StratumClient::recvSocketData()
@@ -1005,22 +1382,31 @@ void StratumClient::onRecvSocketDataCompleted(const boost::system::error_code& e
     // before triggering all stack of calls
     setThreadName("stratum");
     if (!ec && bytes_transferred > 0) {
-        // Extract received message
-        std::istream is(&m_recvBuffer);
-        std::string message;
-        getline(is, message);
-        if (isConnected()) {
-            if (!message.empty()) {
-                // Test validity of chunk and process
+        // The line is read in place, the buffer is consumed once it was handled
+        const char* begin = boost::asio::buffer_cast<const char*>(m_recvBuffer.data());
+        const char* end = begin + bytes_transferred - 1;
+        while (end > begin && (end[-1] == '\r' || end[-1] == '\n')) {
+            --end;
+        }
+        const bool connected = isConnected();
+        if (connected && end > begin) {
+            if (m_capture) {
+                m_capture->record(SessionCapture::Received, std::string(begin, end));
+            }
+            // Hot messages skip the DOM, the rest takes the Json::Value path
+            if (!m_parser.parse(begin, end) || !processHotMessage(m_parser.message())) {
                 Json::Value jMsg;
                 Json::Reader jRdr;
-                if (jRdr.parse(message, jMsg)) {
-                    m_io_service.post(boost::bind(&StratumClient::processResponse, this, jMsg));
+                if (jRdr.parse(begin, end, jMsg)) {
+                    processResponse(jMsg);
                 } else {
                     if (g_logVerbosity >= 6)
                         cwarn << "Got invalid Json message: " + jRdr.getFormattedErrorMessages();
                 }
             }
+        }
+        m_recvBuffer.consume(bytes_transferred);
+        if (connected) {
             // Eventually keep reading from socket
             recvSocketData();
         }
@@ -1051,31 +1437,106 @@ void StratumClient::sendSocketData(Json::Value const & jReq)
     if (!isConnected()) {
         return;
     }
-    std::ostream os(&m_sendBuffer);
-    os << m_jWriter.write(jReq);		// Do not add lf. It's added by writer.
+    {
+        std::lock_guard<std::mutex> lock(x_outbox);
+        m_outbox.push_back(m_jWriter.write(jReq));  // Do not add lf. It's added by writer.
+        if (m_capture) {
+            if (jReq.get("method", "").asString() == "mining.authorize") {
+                // Captures get shared, keep the pool password out of them
+                Json::Value jRedacted = jReq;
+                for (Json::Value::ArrayIndex i = 1; i < jRedacted["params"].size(); ++i) {
+                    jRedacted["params"][i] = "<password>";
+                }
+                m_capture->record(SessionCapture::Sent, m_jWriter.write(jRedacted));
+            } else {
+                m_capture->record(SessionCapture::Sent, m_outbox.back());
+            }
+        }
+        if (m_writing) {
+            // Leaves with the next write
+            return;
+        }
+        m_writing = true;
+    }
+    m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::flushSocketData, this)));
+}
+
+void StratumClient::flushSocketData()
+{
+    // Runs on the strand, only one write is in flight at any time
+    auto batch = std::make_shared<std::vector<std::string>>();
+    unsigned generation;
+    {
+        std::lock_guard<std::mutex> lock(x_outbox);
+        if (m_outbox.empty() || !m_socket || !isConnected()) {
+            m_outbox.clear();
+            m_writing = false;
+            return;
+        }
+        batch->swap(m_outbox);
+        generation = m_outboxGeneration;
+    }
+
+    auto handler = m_io_strand.wrap(boost::bind(&StratumClient::onSendSocketDataCompleted, this,
+                boost::asio::placeholders::error, generation, batch));
     if (m_conn->SecLevel() != SecureLevel::NONE) {
-        async_write(*m_securesocket, m_sendBuffer,
-                m_io_strand.wrap(boost::bind(&StratumClient::onSendSocketDataCompleted, this, boost::asio::placeholders::error)));
+        // SSL streams write one buffer per record, join the lines into one
+        if (batch->size() > 1) {
+            for (size_t i = 1; i < batch->size(); ++i) {
+                batch->front() += (*batch)[i];
+            }
+            batch->resize(1);
+        }
+        async_write(*m_securesocket, boost::asio::buffer(batch->front()), handler);
     } else {
-        async_write(*m_nonsecuresocket, m_sendBuffer,
-                m_io_strand.wrap(boost::bind(&StratumClient::onSendSocketDataCompleted, this, boost::asio::placeholders::error)));
+        // One gathered write for everything queued
+        std::vector<boost::asio::const_buffer> buffers;
+        buffers.reserve(batch->size());
+        for (const auto& line : *batch) {
+            buffers.push_back(boost::asio::buffer(line));
+        }
+        async_write(*m_nonsecuresocket, buffers, handler);
     }
 }
 
-void StratumClient::onSendSocketDataCompleted(const boost::system::error_code& ec)
+void StratumClient::onSendSocketDataCompleted(const boost::system::error_code& ec, unsigned generation,
+                                              std::shared_ptr<std::vector<std::string>> batch)
 {
+    (void)batch;  // Held until here, the write reads from it
+    {
+        std::lock_guard<std::mutex> lock(x_outbox);
+        if (generation != m_outboxGeneration) {
+            // Write of a previous connection, the queue belongs to the new one
+            return;
+        }
+        if (ec) {
+            m_outbox.clear();
+            m_writing = false;
+        }
+    }
     if (ec) {
         if ((ec.category() == boost::asio::error::get_ssl_category()) && (SSL_R_PROTOCOL_IS_SHUTDOWN == ERR_GET_REASON(ec.value()))) {
             cnote << "SSL Stream error: " << ec.message();
-            m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this));
-        }
-        if (isConnected()) {
+            m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
+        } else if (isConnected()) {
             setThreadName("stratum");
             cwarn << "Socket write failed: " + ec.message();
-            m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this));
+            m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
         }
+        return;
     }
+    // Whatever was queued meanwhile goes out now
+    flushSocketData();
+}
+
+void StratumClient::clearSocketData()
+{
+    std::lock_guard<std::mutex> lock(x_outbox);
+    m_outbox.clear();
+    m_writing = false;
+    ++m_outboxGeneration;
 }
+
 void StratumClient::onSSLShutdownCompleted(const boost::system::error_code& ec)
 {
     (void)ec;
@@ -1083,43 +1544,71 @@ void StratumClient::onSSLShutdownCompleted(const boost::system::error_code& ec)
     m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::disconnect_finalize, this)));
 }
 
-void StratumClient::enqueue_response_plea()
+void StratumClient::enqueue_response_plea(unsigned id, RequestKind kind)
+{
+    std::lock_guard<std::mutex> lock(x_response_pleas);
+    m_response_pleas[id] = ResponsePlea{kind, std::chrono::steady_clock::now()};
+}
+
+bool StratumClient::dequeue_response_plea(unsigned id, RequestKind& kind, std::chrono::milliseconds& delay)
 {
     using namespace std::chrono;
-    steady_clock::time_point response_plea_time = steady_clock::now();
-    if (m_response_pleas_count++ == 0) {
-        m_response_plea_older.store(
-                response_plea_time.time_since_epoch(), std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(x_response_pleas);
+    auto it = m_response_pleas.find(id);
+    if (it == m_response_pleas.end()) {
+        return false;
     }
-    m_response_plea_times.push(response_plea_time);
+    kind = it->second.kind;
+    delay = duration_cast<milliseconds>(steady_clock::now() - it->second.sent);
+    m_response_pleas.erase(it);
+    m_response_times.add(delay);
+    return true;
 }
 
-std::chrono::milliseconds StratumClient::dequeue_response_plea()
+bool StratumClient::dequeue_oldest_response_plea(RequestKind& kind, std::chrono::milliseconds& delay)
 {
-    using namespace std::chrono;
-    steady_clock::time_point response_plea_time(m_response_plea_older.load(std::memory_order_relaxed));
-    milliseconds response_delay_ms =
-        duration_cast<milliseconds>(steady_clock::now() - response_plea_time);
-    if (m_response_plea_times.pop(response_plea_time)) {
-        m_response_plea_older.store(
-                response_plea_time.time_since_epoch(), std::memory_order_relaxed);
-    }
-    if (m_response_pleas_count.load(std::memory_order_relaxed) > 0) {
-        m_response_pleas_count--;
-        return response_delay_ms;
-    } else {
-        return milliseconds(0);
+    unsigned id;
+    {
+        std::lock_guard<std::mutex> lock(x_response_pleas);
+        auto oldest = m_response_pleas.end();
+        for (auto it = m_response_pleas.begin(); it != m_response_pleas.end(); ++it) {
+            if (oldest == m_response_pleas.end() || it->second.sent < oldest->second.sent) {
+                oldest = it;
+            }
+        }
+        if (oldest == m_response_pleas.end()) {
+            return false;
+        }
+        id = oldest->first;
+    }
+    return dequeue_response_plea(id, kind, delay);
+}
+
+bool StratumClient::oldest_response_plea(std::chrono::steady_clock::time_point& sent) const
+{
+    std::lock_guard<std::mutex> lock(x_response_pleas);
+    if (m_response_pleas.empty()) {
+        return false;
     }
+    sent = m_response_pleas.begin()->second.sent;
+    for (const auto& plea : m_response_pleas) {
+        sent = std::min(sent, plea.second.sent);
+    }
+    return true;
+}
+
+size_t StratumClient::pending_submits() const
+{
+    std::lock_guard<std::mutex> lock(x_response_pleas);
+    size_t count = 0;
+    for (const auto& plea : m_response_pleas) {
+        count += plea.second.kind == SUBMIT;
+    }
+    return count;
 }
 
 void StratumClient::clear_response_pleas()
 {
-    using namespace std::chrono;
-    steady_clock::time_point response_plea_time;
-    m_response_pleas_count.store(0, std::memory_order_relaxed);
-    while (m_response_plea_times.pop(response_plea_time))
-    {
-    };
-    m_response_plea_older.store(((steady_clock::time_point)steady_clock::now()).time_since_epoch(),
-            std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(x_response_pleas);
+    m_response_pleas.clear();
 }
@@ -6,11 +6,17 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
 #include <json/json.h>
+#include <common/LatencyHistogram.h>
 #include <common/Log.h>
 #include <nrgcore/mineplant.h>
 #include <nrgcore/miner.h>
 #include "../PoolClient.h"
-#include <boost/lockfree/queue.hpp>
+#include "StratumParser.h"
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 using namespace energi;
 
@@ -18,6 +24,12 @@ class StratumClient : public PoolClient
 {
 public:
 	static constexpr auto PARALLEL_REQUEST_LIMIT = 10;
+	// Jobs kept around so late solutions for a superseded job can still be submitted
+	static constexpr size_t RECENT_JOBS_LIMIT = 8;
+	// Submits are numbered from here on so their responses can be told apart
+	static constexpr unsigned FIRST_SUBMIT_ID = 10;
+	// Delay before racing the next resolved address while earlier ones still connect
+	static constexpr unsigned CONNECT_STAGGER_MS = 250;
 
 	typedef enum { STRATUM = 0, NRGPROXY, ENERGISTRATUM } StratumProtocol;
 
@@ -41,28 +53,76 @@ public:
     std::string ActiveEndPoint() override { return " [" + toString(m_endpoint) + "]"; };
 
 	void submitHashrate(const std::string& rate) override;
-	void submitSolution(const energi::Solution& solution) override;
+	bool submitSolution(const energi::Solution& solution) override;
 
 private:
     void disconnect_finalize();
 
-    void enqueue_response_plea();
-    std::chrono::milliseconds dequeue_response_plea();
+    // What an awaited response answers. Values are the ids the requests were
+    // always sent with, submits use their own ids from FIRST_SUBMIT_ID on.
+    typedef enum {
+        CONNECTION = 0,
+        SUBSCRIBE = 1,
+        EXTRANONCE_SUBSCRIBE = 2,
+        AUTHORIZE = 3,
+        SUBMIT = 4,
+        HASHRATE = 9
+    } RequestKind;
+
+    struct ResponsePlea
+    {
+        RequestKind kind;
+        std::chrono::steady_clock::time_point sent;
+    };
+
+    void enqueue_response_plea(unsigned id, RequestKind kind);
+    // False when no request with this id is awaited
+    bool dequeue_response_plea(unsigned id, RequestKind& kind, std::chrono::milliseconds& delay);
+    bool dequeue_oldest_response_plea(RequestKind& kind, std::chrono::milliseconds& delay);
+    bool oldest_response_plea(std::chrono::steady_clock::time_point& sent) const;
+    size_t pending_submits() const;
     void clear_response_pleas();
 
     void resolve_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
     void start_connect();
+    // Staggered parallel connects across the resolved addresses, first one wins
+    void launch_racer();
+    void race_timer_elapsed(const boost::system::error_code& ec, unsigned generation);
+    void racer_handler(const boost::system::error_code& ec, std::shared_ptr<boost::asio::ip::tcp::socket> racer,
+                       boost::asio::ip::tcp::endpoint endpoint, unsigned generation);
+    void abort_race();
     void connect_handler(const boost::system::error_code& ec);
+    void handshake_handler(const boost::system::error_code& ec);
+    void begin_session();
     void workloop_timer_elapsed(const boost::system::error_code& ec);
 
     void processResponse(Json::Value& responseObject);
+    bool processHotMessage(const StratumParser::Message& msg);
+    void processNotify(const energi::StratumJobView& job);
+    void processDifficulty(double difficulty);
+    void processSubmitResponse(bool accepted, const std::string& errReason,
+                               const std::chrono::milliseconds& delay);
     std::string processError(Json::Value& erroresponseObject);
     void processExtranonce(std::string& enonce);
 
+    // A job the pool sent and has not invalidated yet
+    struct RecentJob
+    {
+        std::string   id;
+        arith_uint256 target;
+        uint256       prevHash;
+    };
+    bool rememberJob(const energi::Work& work, bool clean);
+    bool isJobLive(const energi::Work& work) const;
+    void clearJobs();
+
     void recvSocketData();
     void onRecvSocketDataCompleted(const boost::system::error_code& ec, std::size_t bytes_transferred);
     void sendSocketData(Json::Value const & jReq);
-    void onSendSocketDataCompleted(const boost::system::error_code& ec);
+    void flushSocketData();
+    void onSendSocketDataCompleted(const boost::system::error_code& ec, unsigned generation,
+                                   std::shared_ptr<std::vector<std::string>> batch);
+    void clearSocketData();
 
     void onSSLShutdownCompleted(const boost::system::error_code& ec);
 
@@ -83,6 +143,9 @@ private:
     int m_workloop_interval = 1000;
 
     energi::Work m_current;
+    // Newest job at the back, touched from the io strand and the submit thread
+    std::deque<RecentJob> m_recentJobs;
+    mutable std::mutex x_recentJobs;
     std::chrono::time_point<std::chrono::steady_clock> m_current_timestamp;
 
     bool m_stale = false;
@@ -96,19 +159,41 @@ private:
     std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>  m_securesocket;
     std::shared_ptr<boost::asio::ip::tcp::socket> m_nonsecuresocket;
 
-    boost::asio::streambuf m_sendBuffer;
     boost::asio::streambuf m_recvBuffer;
+    StratumParser m_parser;
+
+    // Lines waiting for the socket. Requests queued while a write is in flight
+    // leave together in the next one.
+    std::mutex x_outbox;
     Json::FastWriter m_jWriter;
+    std::vector<std::string> m_outbox;
+    bool m_writing = false;
+    // Bumped per connection so completions of an older socket are ignored
+    unsigned m_outboxGeneration = 0;
 
     boost::asio::deadline_timer m_workloop_timer;
 
-    std::atomic<int> m_response_pleas_count = {0};
-    std::atomic<std::chrono::steady_clock::duration> m_response_plea_older;
-    boost::lockfree::queue<std::chrono::steady_clock::time_point> m_response_plea_times;
+    // Awaited responses by request id, submits are sent from the plant threads
+    mutable std::mutex x_response_pleas;
+    std::map<unsigned, ResponsePlea> m_response_pleas;
+    std::atomic<unsigned> m_next_submit_id = { FIRST_SUBMIT_ID };
+    // Round trip times of the current connection
+    LatencyHistogram m_response_times;
 
     boost::asio::ip::tcp::resolver m_resolver;
     std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
 
+    std::vector<boost::asio::ip::tcp::endpoint> m_raceEndpoints;
+    std::vector<std::shared_ptr<boost::asio::ip::tcp::socket>> m_racers;
+    size_t m_raceNext = 0;
+    unsigned m_raceOutstanding = 0;
+    // Bumped per race so late completions of a decided one are ignored
+    unsigned m_raceGeneration = 0;
+    boost::asio::deadline_timer m_raceTimer;
+
+    // Pool the TLS session of this connection is cached under
+    std::string m_tlsSessionKey;
+
     arith_uint256 m_nextWorkTarget;
 
     std::string m_extraNonce1;
@@ -0,0 +1,409 @@
+#include "StratumParser.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using energi::TextRef;
+
+namespace
+{
+
+// Deepest nesting skipped over, pools never come close
+const unsigned c_maxDepth = 32;
+
+bool digits(const TextRef& text, uint64_t& value)
+{
+    if (text.empty() || text.size > 19) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < text.size; ++i) {
+        if (text.data[i] < '0' || text.data[i] > '9') {
+            return false;
+        }
+        value = value * 10 + uint64_t(text.data[i] - '0');
+    }
+    return true;
+}
+
+} // namespace
+
+bool StratumParser::parse(const char* begin, const char* end)
+{
+    m_pos = begin;
+    m_end = end;
+    m_msg.id = 0;
+    m_msg.rpc2 = false;
+    m_msg.method = TextRef();
+    m_msg.result = Message::None;
+    m_msg.hasJob = false;
+    m_msg.job.clear();
+    m_msg.hasNumber = false;
+    m_msg.number = 0;
+
+    skipSpace();
+    if (!object()) {
+        return false;
+    }
+    skipSpace();
+    return m_pos == m_end;
+}
+
+bool StratumParser::object()
+{
+    if (m_pos == m_end || *m_pos != '{') {
+        return false;
+    }
+    ++m_pos;
+    skipSpace();
+    if (m_pos != m_end && *m_pos == '}') {
+        ++m_pos;
+        return true;
+    }
+
+    bool listSeen = false;
+    while (true) {
+        TextRef key;
+        skipSpace();
+        if (!string(key)) {
+            return false;
+        }
+        skipSpace();
+        if (m_pos == m_end || *m_pos != ':') {
+            return false;
+        }
+        ++m_pos;
+        skipSpace();
+        if (m_pos == m_end) {
+            return false;
+        }
+
+        if (key == "id") {
+            TextRef id;
+            if (!literal("null") && !(number(id) && digits(id, m_msg.id))) {
+                return false;
+            }
+        } else if (key == "method") {
+            if (!string(m_msg.method)) {
+                return false;
+            }
+        } else if (key == "jsonrpc") {
+            // Anything but 2.0 is reported by the Json path
+            TextRef version;
+            if (!string(version) || !(version == "2.0")) {
+                return false;
+            }
+            m_msg.rpc2 = true;
+        } else if (key == "params" || key == "result") {
+            const bool isResult = key == "result";
+            if (*m_pos == '[') {
+                if (listSeen || !list()) {
+                    return false;
+                }
+                listSeen = true;
+                if (isResult) {
+                    m_msg.result = Message::List;
+                }
+            } else if (!isResult) {
+                return false;
+            } else if (literal("true")) {
+                m_msg.result = Message::True;
+            } else if (literal("false")) {
+                m_msg.result = Message::False;
+            } else if (literal("null")) {
+                m_msg.result = Message::Null;
+            } else {
+                return false;
+            }
+        } else if (key == "error") {
+            // Errors carry the reason to report, rare enough for Json::Value
+            if (!literal("null")) {
+                return false;
+            }
+        } else if (!skipValue(0)) {
+            return false;
+        }
+
+        skipSpace();
+        if (m_pos == m_end) {
+            return false;
+        }
+        if (*m_pos == '}') {
+            ++m_pos;
+            return true;
+        }
+        if (*m_pos != ',') {
+            return false;
+        }
+        ++m_pos;
+    }
+}
+
+bool StratumParser::list()
+{
+    // Positions of a job: name, prevhash, coinbase1, coinbase2, transactions,
+    // version, bits, time, clean, height
+    auto& job = m_msg.job;
+    bool shaped = true;
+    unsigned index = 0;
+
+    ++m_pos;
+    skipSpace();
+    if (m_pos != m_end && *m_pos == ']') {
+        ++m_pos;
+        return true;
+    }
+    while (true) {
+        skipSpace();
+        if (m_pos == m_end) {
+            return false;
+        }
+        const char c = *m_pos;
+        if (c == '"') {
+            TextRef text;
+            if (!string(text)) {
+                return false;
+            }
+            switch (index) {
+            case 0: job.jobName = text; break;
+            case 1: job.prevHash = text; break;
+            case 2: job.coinbase1 = text; break;
+            case 3: job.coinbase2 = text; break;
+            case 5: job.version = text; break;
+            case 6: job.bits = text; break;
+            case 7: job.time = text; break;
+            default: shaped = shaped && index > 9; break;
+            }
+        } else if (c == '[' && index == 4) {
+            if (!transactions()) {
+                return false;
+            }
+        } else if (c == 't' || c == 'f') {
+            const bool value = c == 't';
+            if (!literal(value ? "true" : "false")) {
+                return false;
+            }
+            if (index == 8) {
+                job.clean = value;
+            } else {
+                shaped = shaped && index > 9;
+            }
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            TextRef text;
+            if (!number(text)) {
+                return false;
+            }
+            uint64_t value = 0;
+            if (index == 0) {
+                // mining.set_difficulty
+                m_msg.hasNumber = true;
+                m_msg.number = std::strtod(text.data, nullptr);
+                shaped = false;
+            } else if (index == 9 && digits(text, value) && value <= UINT32_MAX) {
+                job.height = uint32_t(value);
+            } else {
+                shaped = shaped && index > 9;
+            }
+        } else {
+            if (!skipValue(1)) {
+                return false;
+            }
+            shaped = shaped && index > 9;
+        }
+        ++index;
+
+        skipSpace();
+        if (m_pos == m_end) {
+            return false;
+        }
+        if (*m_pos == ']') {
+            ++m_pos;
+            break;
+        }
+        if (*m_pos != ',') {
+            return false;
+        }
+        ++m_pos;
+    }
+    m_msg.hasJob = shaped && index >= 10;
+    return true;
+}
+
+bool StratumParser::transactions()
+{
+    // [{"data":"<hex>", ...}, ...]
+    ++m_pos;
+    skipSpace();
+    if (m_pos != m_end && *m_pos == ']') {
+        ++m_pos;
+        return true;
+    }
+    while (true) {
+        skipSpace();
+        if (m_pos == m_end || *m_pos != '{') {
+            return false;
+        }
+        ++m_pos;
+        bool found = false;
+        while (true) {
+            TextRef key;
+            skipSpace();
+            if (!string(key)) {
+                return false;
+            }
+            skipSpace();
+            if (m_pos == m_end || *m_pos != ':') {
+                return false;
+            }
+            ++m_pos;
+            skipSpace();
+            if (key == "data" && !found) {
+                TextRef data;
+                if (!string(data)) {
+                    return false;
+                }
+                m_msg.job.transactions.push_back(data);
+                found = true;
+            } else if (!skipValue(2)) {
+                return false;
+            }
+            skipSpace();
+            if (m_pos == m_end) {
+                return false;
+            }
+            if (*m_pos == '}') {
+                ++m_pos;
+                break;
+            }
+            if (*m_pos != ',') {
+                return false;
+            }
+            ++m_pos;
+        }
+        if (!found) {
+            return false;
+        }
+
+        skipSpace();
+        if (m_pos == m_end) {
+            return false;
+        }
+        if (*m_pos == ']') {
+            ++m_pos;
+            return true;
+        }
+        if (*m_pos != ',') {
+            return false;
+        }
+        ++m_pos;
+    }
+}
+
+bool StratumParser::string(TextRef& out)
+{
+    if (m_pos == m_end || *m_pos != '"') {
+        return false;
+    }
+    const char* begin = ++m_pos;
+    while (m_pos != m_end && *m_pos != '"') {
+        if (*m_pos == '\\') {
+            // Escapes would need a copy, pools only use them in error messages
+            return false;
+        }
+        ++m_pos;
+    }
+    if (m_pos == m_end) {
+        return false;
+    }
+    out = TextRef(begin, m_pos - begin);
+    ++m_pos;
+    return true;
+}
+
+bool StratumParser::number(TextRef& out)
+{
+    const char* begin = m_pos;
+    while (m_pos != m_end && ((*m_pos >= '0' && *m_pos <= '9') || *m_pos == '-' || *m_pos == '+' ||
+                              *m_pos == '.' || *m_pos == 'e' || *m_pos == 'E')) {
+        ++m_pos;
+    }
+    out = TextRef(begin, m_pos - begin);
+    return !out.empty();
+}
+
+bool StratumParser::literal(const char* word)
+{
+    const size_t size = std::strlen(word);
+    if (size_t(m_end - m_pos) < size || std::memcmp(m_pos, word, size) != 0) {
+        return false;
+    }
+    m_pos += size;
+    return true;
+}
+
+bool StratumParser::skipValue(unsigned depth)
+{
+    if (depth > c_maxDepth || m_pos == m_end) {
+        return false;
+    }
+    TextRef ignored;
+    switch (*m_pos) {
+    case '"':
+        return string(ignored);
+    case 't':
+        return literal("true");
+    case 'f':
+        return literal("false");
+    case 'n':
+        return literal("null");
+    case '[':
+    case '{': {
+        const bool isObject = *m_pos == '{';
+        const char close = isObject ? '}' : ']';
+        ++m_pos;
+        skipSpace();
+        if (m_pos != m_end && *m_pos == close) {
+            ++m_pos;
+            return true;
+        }
+        while (true) {
+            skipSpace();
+            if (isObject) {
+                if (!string(ignored)) {
+                    return false;
+                }
+                skipSpace();
+                if (m_pos == m_end || *m_pos != ':') {
+                    return false;
+                }
+                ++m_pos;
+                skipSpace();
+            }
+            if (!skipValue(depth + 1)) {
+                return false;
+            }
+            skipSpace();
+            if (m_pos == m_end) {
+                return false;
+            }
+            if (*m_pos == close) {
+                ++m_pos;
+                return true;
+            }
+            if (*m_pos != ',') {
+                return false;
+            }
+            ++m_pos;
+        }
+    }
+    default:
+        return number(ignored);
+    }
+}
+
+void StratumParser::skipSpace()
+{
+    while (m_pos != m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\r' || *m_pos == '\n')) {
+        ++m_pos;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <primitives/block.h>
+
+#include <cstdint>
+
+/**
+ * Single pass reader for the stratum messages that arrive all the time:
+ * mining.notify, mining.set_difficulty and the results of our own requests.
+ *
+ * It reads the line in place in the receive buffer and fills a Message that
+ * is reused from line to line, so once the transaction list had its largest
+ * size a line costs no allocation. The job fields point into the buffer and
+ * are only valid until it is consumed. Anything it does not fully understand,
+ * string ids, error objects, escaped strings or nested results, makes parse()
+ * return false and is left to Json::Value.
+ */
+class StratumParser
+{
+public:
+    struct Message
+    {
+        uint64_t id = 0;         // 0 when missing or null, as for the Json path
+        bool     rpc2 = false;   // carries "jsonrpc":"2.0"
+        energi::TextRef method;  // empty for responses
+
+        enum Result
+        {
+            None,
+            True,
+            False,
+            Null,
+            List
+        };
+        Result result = None;    // kind of the "result" member
+
+        bool     hasJob = false; // params or result hold a mining.notify job
+        energi::StratumJobView job;
+        bool     hasNumber = false; // first entry of params or result is a number
+        double   number = 0;
+    };
+
+    //! [begin, end) is one line without its terminator
+    bool parse(const char* begin, const char* end);
+
+    const Message& message() const
+    {
+        return m_msg;
+    }
+
+private:
+    bool object();
+    bool list();
+    bool transactions();
+    bool string(energi::TextRef& out);
+    bool number(energi::TextRef& out);
+    bool literal(const char* word);
+    bool skipValue(unsigned depth);
+    void skipSpace();
+
+    const char* m_pos = nullptr;
+    const char* m_end = nullptr;
+    Message m_msg;
+};
@@ -1,25 +1,44 @@
+#include <algorithm>
 #include <chrono>
+#include <iomanip>
 
 #include "SimulateClient.h"
 
 using namespace energi;
 
-SimulateClient::SimulateClient(const unsigned* difficulty, const unsigned& block)
+namespace
+{
+
+// Hashes per share are retargeted at most by this factor at a time
+const double c_maxRetarget = 4.0;
+// Retarget early once a window collected this many shares
+const unsigned c_maxWindowShares = 32;
+
+}
+
+SimulateClient::SimulateClient(unsigned block, unsigned blockInterval, unsigned shareInterval)
     : PoolClient()
-    , Worker("simulator")
-    , m_difficulty(difficulty - 1)
-    , m_block(block)
+    , Worker("sim")
+    , m_blockInterval(std::max(blockInterval, 1u))
+    , m_shareInterval(std::max(shareInterval, 1u))
+    , m_height(std::max(block, 1u)) // height 0 is treated as no work
 {
+    m_subscribed.store(true, std::memory_order_relaxed);
+    m_authorized.store(true, std::memory_order_relaxed);
 }
 
 SimulateClient::~SimulateClient()
 {
+    stopWorking();
 }
 
 void SimulateClient::connect()
 {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_connectedAt = std::chrono::steady_clock::now();
+    }
     m_connected.store(true, std::memory_order_relaxed);
-    m_uppDifficulty = false;
 
     if (m_onConnected) {
         m_onConnected();
@@ -39,69 +58,148 @@ void SimulateClient::disconnect()
 void SimulateClient::submitHashrate(const std::string& rate)
 {
     (void)rate;
+}
 
-    auto sec = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - m_time);
-    cnote << "On difficulty" << m_difficulty << " for " << sec.count() << " seconds";
+SimulateClient::Stats SimulateClient::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    auto minutes = std::chrono::duration_cast<std::chrono::duration<double, std::ratio<60>>>(
+            std::chrono::steady_clock::now() - m_connectedAt).count();
+    stats.shareRate = minutes > 0 ? stats.accepted / minutes : 0.0;
+    stats.hashesPerShare = m_hashesPerShare;
+    return stats;
 }
 
-void SimulateClient::submitSolution(const Solution& solution)
+bool SimulateClient::verify(const Job& job)
 {
-    m_uppDifficulty = true;
-    cnote << "Difficulty: " << m_difficulty;
-
-    const auto& work = solution.getWork();
-    auto hash = Miner::GetPOWHash(work);
-    if(UintToArith256 <= work.hashTarget) {
-        if (m_onSolutionAccepted) {
-            m_onSolutionAccepted(false);
-        }
+    // Rebuild everything from the work snapshot instead of trusting what the
+    // miner prepared, this also catches coinbase, merkle and header hash bugs
+    const auto& work = job.getWork();
+    if (job.hashMerkleRoot != work.merkleRoot(job.getExtraNonce2Value())) {
+        return false;
+    }
+    CBlockHeaderTruncatedLE truncated(job);
+    nrghash::h256_t headerHash(&truncated, sizeof(truncated));
+
+    const uint64_t epoch = job.nHeight / nrghash::constants::EPOCH_LENGTH;
+    nrghash::result_t result;
+    const auto& dag = Miner::ActiveDAG();
+    if (dag && dag->epoch() == epoch) {
+        result = nrghash::full::hash(*dag, headerHash, job.nNonce);
     } else {
+        if (!m_cache || m_cache->epoch() != epoch) {
+            cnote << "Simulation: building verification cache for epoch " << epoch;
+            m_cache.reset(new nrghash::cache_t(job.nHeight));
+        }
+        result = nrghash::light::hash(*m_cache, headerHash, job.nNonce);
+    }
+    return uint256(result.mixhash) == job.hashMix &&
+           UintToArith256(uint256(result.value)) <= job.getTarget();
+}
+
+bool SimulateClient::submitSolution(const Solution& solution)
+{
+    const auto& job = solution.getJob();
+    const bool valid = verify(job);
+
+    bool stale = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stale = job.hashPrevBlock != m_prevHash;
+        if (!valid) {
+            ++m_stats.failed;
+        } else if (stale) {
+            ++m_stats.stale;
+        } else {
+            ++m_stats.accepted;
+            ++m_windowShares;
+        }
+    }
+
+    if (!valid) {
+        cwarn << "Simulation: share failed verification, job " << job.getJobName()
+              << " nonce " << job.nNonce;
         if (m_onSolutionRejected) {
-            m_onSolutionRejected(false);
+            m_onSolutionRejected(stale, std::chrono::milliseconds(0));
         }
+    } else if (m_onSolutionAccepted) {
+        m_onSolutionAccepted(stale, std::chrono::milliseconds(0));
     }
+    return true;
 }
 
-void SimulateClient::trun()
+void SimulateClient::retarget(double elapsedSeconds)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const double expected = elapsedSeconds / m_shareInterval;
+    double factor = 1.0 / c_maxRetarget;
+    if (m_windowShares > 0) {
+        factor = std::min(std::max(m_windowShares / expected, 1.0 / c_maxRetarget), c_maxRetarget);
+    }
+    m_hashesPerShare = std::max(1.0, m_hashesPerShare * factor);
+    m_windowShares = 0;
+}
+
+void SimulateClient::pushWork(bool newBlock)
 {
-    cnote << "Preparing DAG for block #" << m_block;
-    BlockHeader genesis;
-    genesis.setNumber(m_block);
-    WorkPackage current = WorkPackage(genesis);
-    m_time = std::chrono::steady_clock::now();
-    while (true) {
-        if (m_connected.load(std::memory_order_relaxed)) {
-            if (m_uppDifficulty) {
-                m_uppDifficulty = false;
-
-                auto sec = duration_cast<seconds>(steady_clock::now() - m_time);
-                cnote << "Took" << sec.count() << "seconds at" << m_difficulty
-                    << "difficulty to find solution";
-
-                if (sec.count() < 12) {
-                    ++m_difficulty;
-                }
-                if (sec.count() > 18) {
-                    --m_difficulty;
-                }
-
-                cnote << "Now using difficulty " << m_difficulty;
-                m_time = std::chrono::steady_clock::now();
-                if (m_onWorkReceived) {
-                    genesis.setDifficulty(u256(1) << m_difficulty);
-                    genesis.noteDirty();
-
-                    current.header = h256::random();
-                    current.boundary = genesis.boundary();
-
-                    m_onWorkReceived(current);
-                }
-            } else {
-                this_thread::sleep_for(chrono::milliseconds(100));
+    Work work;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_sequence;
+        if (newBlock) {
+            if (!m_prevHash.IsNull()) {
+                ++m_height;
             }
-        } else {
-            this_thread::sleep_for(chrono::seconds(5));
+            m_prevHash = ArithToUint256(arith_uint256(m_sequence));
+            ++m_stats.blocks;
         }
+        const uint64_t hashes = uint64_t(std::min(m_hashesPerShare, 9.2e18));
+        const auto target = (~arith_uint256()) / std::max<uint64_t>(hashes, 1);
+        work = Work::synthetic(m_height, m_prevHash, target, "sim" + std::to_string(m_sequence));
+    }
+    if (m_onWorkReceived) {
+        m_onWorkReceived(work);
     }
 }
 
+void SimulateClient::trun()
+{
+    using namespace std::chrono;
+
+    pushWork(true);
+    auto blockStart = steady_clock::now();
+    auto windowStart = blockStart;
+    const auto window = seconds(m_shareInterval * 8);
+
+    while (sleepFor(milliseconds(250))) {
+        if (!m_connected.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        const auto now = steady_clock::now();
+        unsigned shares = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            shares = m_windowShares;
+        }
+
+        bool retargeted = false;
+        if (now - windowStart >= window || shares >= c_maxWindowShares) {
+            retarget(duration_cast<duration<double>>(now - windowStart).count());
+            windowStart = now;
+            retargeted = true;
+        }
+
+        if (now - blockStart >= seconds(m_blockInterval)) {
+            auto s = stats();
+            cnote << "Simulation: block " << s.blocks << ", " << s.accepted << " shares ("
+                  << std::fixed << std::setprecision(2) << s.shareRate << "/min), "
+                  << s.stale << " stale, " << s.failed << " failed verification, "
+                  << std::setprecision(0) << s.hashesPerShare << " hashes/share";
+            pushWork(true);
+            blockStart = now;
+        } else if (retargeted) {
+            pushWork(false);
+        }
+    }
+}
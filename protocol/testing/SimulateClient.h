@@ -1,31 +1,64 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <primitives/worker.h>
 
 #include "../PoolClient.h"
 
+/**
+ * In-process pool used by simulation mode (-Z). Produces synthetic jobs, a new
+ * block every blockInterval seconds, and retargets the share difficulty so the
+ * rig finds about one share every shareInterval seconds. Every submitted share
+ * is verified with nrghash.
+ */
 class SimulateClient : public PoolClient, energi::Worker
 {
 public:
-    SimulateClient(const unsigned& difficulty, const unsigned& block);
+    struct Stats
+    {
+        unsigned blocks = 0;
+        unsigned accepted = 0;
+        unsigned stale = 0;
+        unsigned failed = 0;  // shares whose hash does not verify
+        double   shareRate = 0.0; // shares per minute since connect
+        double   hashesPerShare = 0.0;
+    };
+
+    SimulateClient(unsigned block, unsigned blockInterval, unsigned shareInterval);
     ~SimulateClient();
 
     void connect() override;
     void disconnect() override;
 
-    bool isConnected() override { return m_connected;}
-    bool isPendingState() override { return false;}
-    std::string ActiveEndPoint() override { return "";}
+    bool isConnected() override { return m_connected; }
+    bool isPendingState() override { return false; }
+    std::string ActiveEndPoint() override { return " [simulation]"; }
 
     void submitHashrate(const std::string& rate) override;
-	void submitSolution(const energi::Solution& solution) override;
+    bool submitSolution(const energi::Solution& solution) override;
+
+    Stats stats() const;
 
 private:
     void trun() override;
-    bool m_uppDifficulty = false;
-    unsigned m_difficulty;
-    unsigned m_block;
-    std::chrono::steady_clock::time_point m_time;
+    void pushWork(bool newBlock);
+    void retarget(double elapsedSeconds);
+    bool verify(const energi::Job& job);
+
+    const unsigned m_blockInterval;
+    const unsigned m_shareInterval;
+
+    mutable std::mutex m_mutex;
+    uint32_t           m_height;
+    uint256            m_prevHash;
+    unsigned           m_sequence = 0;
+    double             m_hashesPerShare = 1 << 16;
+    unsigned           m_windowShares = 0;
+    std::chrono::steady_clock::time_point m_connectedAt;
+    Stats              m_stats;
 
+    // Verification runs on the submit thread, the cache is kept per epoch
+    std::unique_ptr<nrghash::cache_t> m_cache;
 };